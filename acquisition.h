@@ -0,0 +1,253 @@
+#pragma once
+// how each position gets measured (-t)
+//   triggered (default): RF on, wait out the settling time, then a counted number of single sweeps
+//                        (INIT:IMM;*OPC?) into max hold. every value says how many sweeps went into it
+//   free:                the old way - the SA free-runs in max hold while RF is on for the dwell.
+//                        sweeps aren't counted, so the sweeps column is 0
+//   zeromean / zeropeak: zero span on the tone with a narrow RBW. each sweep is a short time record of power,
+//                        read back as a trace; powerRx is the mean (in linear power) or the peak over the records.
+//                        no swept span at all, which is where most of a swept measurement's time goes
+// with -k, RF stays on across turntable moves instead of being toggled at every position.
+// it's still switched off whenever the sweep stops (end, ctrl+c, instruments not responding)
+
+#define ACQUISITION_SETTLING_TIME_DEFAULT (100) // ms, after RF comes on or the turntable stops
+#define ACQUISITION_SETTLING_TIME_MAX (60000)
+#define ACQUISITION_SWEEPS_DEFAULT (3) // sweeps that go into each max hold value
+#define ACQUISITION_FREQUENCY_UNCERTAINTY_PPM (2.0) // generator and analyzer references together
+#define ACQUISITION_ZERO_SPAN_RECORD (0.01)  // seconds per time record
+#define ACQUISITION_ZERO_SPAN_POINTS (101)
+#define ACQUISITION_ZERO_SPAN_BW_RES_MIN (1000)    // Hz
+#define ACQUISITION_ZERO_SPAN_BW_RES_MAX (3000000) // Hz
+
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "helperFunctions.h"
+#include "signalGenerator.h"
+#include "fieldfox.h"
+#include "chamberClock.h"
+
+enum acquisitionMode_t {
+	ACQUISITION_TRIGGERED,
+	ACQUISITION_FREE,
+	ACQUISITION_ZERO_SPAN_MEAN,
+	ACQUISITION_ZERO_SPAN_PEAK
+};
+const char* ACQUISITION_MODE_NAMES[] = { "triggered", "free", "zeromean", "zeropeak" }; // same order as acquisitionMode_t
+
+struct acquisitionSettings {
+	acquisitionMode_t mode = ACQUISITION_TRIGGERED;
+	int settlingTime = ACQUISITION_SETTLING_TIME_DEFAULT; // ms
+	bool keepRfOn = false;
+	int sweepsPerPosition = ACQUISITION_SWEEPS_DEFAULT;
+};
+acquisitionSettings sweepAcquisition;
+
+// per position timing, to show the mode's speed and how much it varies
+struct acquisitionStats {
+	int positions = 0;
+	long long sweeps = 0;
+	double sumMs = 0;
+	double sumSquaresMs = 0;
+};
+acquisitionStats sweepAcquisitionStats;
+
+std::string acquisitionModeName(acquisitionMode_t mode) {
+	return ACQUISITION_MODE_NAMES[mode];
+}
+
+bool acquisitionIsZeroSpan(acquisitionMode_t mode) {
+	return mode == ACQUISITION_ZERO_SPAN_MEAN || mode == ACQUISITION_ZERO_SPAN_PEAK;
+}
+
+bool acquisitionCountsSweeps(acquisitionMode_t mode) {
+	return mode != ACQUISITION_FREE;
+}
+
+bool parseAcquisitionMode(const std::string& modeName, acquisitionMode_t* mode) {
+	for (int i = 0; i < (int)(sizeof(ACQUISITION_MODE_NAMES) / sizeof(ACQUISITION_MODE_NAMES[0])); i++) {
+		if (modeName == ACQUISITION_MODE_NAMES[i]) {
+			*mode = (acquisitionMode_t)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// -t argument: a mode name, optionally followed by ",<settling ms>"
+bool parseAcquisitionArgument(const std::string& argument, acquisitionSettings* settings) {
+	size_t comma = argument.find(',');
+	if (!parseAcquisitionMode(argument.substr(0, comma), &((*settings).mode))) {
+		return false;
+	}
+	if (comma != std::string::npos) {
+		char* end = nullptr;
+		long settling = strtol(argument.c_str() + comma + 1, &end, 10);
+		if (end == argument.c_str() + comma + 1 || *end != '\0' || settling < 0 || settling > ACQUISITION_SETTLING_TIME_MAX) {
+			return false;
+		}
+		(*settings).settlingTime = (int)settling;
+	}
+	return true;
+}
+
+// narrowest RBW (1-3 sequence) that still keeps the tone well inside the filter, given the frequency references
+double acquisitionZeroSpanBwRes(double frequency) {
+	double needed = 4 * frequency * ACQUISITION_FREQUENCY_UNCERTAINTY_PPM * 1e-6;
+	for (double decade = ACQUISITION_ZERO_SPAN_BW_RES_MIN; decade <= ACQUISITION_ZERO_SPAN_BW_RES_MAX; decade *= 10) {
+		for (double step : { 1.0, 3.0 }) {
+			if (decade * step >= needed && decade * step <= ACQUISITION_ZERO_SPAN_BW_RES_MAX) {
+				return decade * step;
+			}
+		}
+	}
+	return ACQUISITION_ZERO_SPAN_BW_RES_MAX;
+}
+
+bool configureZeroSpan(double frequency) {
+	if (!std::isfinite(frequency) || frequency <= 0) {
+		return false;
+	}
+	double bwRes = acquisitionZeroSpanBwRes(frequency);
+	debugOut("Zero span at " + std::to_string(frequency) + " Hz, RBW " + std::to_string(bwRes) + " Hz");
+	return setSpectrumAnalyzerZeroSpan(frequency, bwRes, ACQUISITION_ZERO_SPAN_RECORD, ACQUISITION_ZERO_SPAN_POINTS);
+}
+
+// zero span: one time record per sweep, each read back and folded into *powerRx
+int acquireZeroSpanRecords(acquisitionMode_t mode, int recordsWanted, int recordTimeMs, double* powerRx) {
+	int records = 0;
+	double sumMw = 0;
+	double peak = -INFINITY;
+	for (int i = 0; i < recordsWanted; i++) {
+		double recordMean = 0;
+		double recordPeak = 0;
+		if (acquireSpectrumAnalyzerSweeps(1, recordTimeMs) != 1 || !getSpectrumAnalyzerTracePower(&recordMean, &recordPeak)) {
+			continue;
+		}
+		sumMw += std::pow(10, recordMean / 10);
+		peak = (recordPeak > peak) ? recordPeak : peak;
+		records++;
+	}
+	if (records > 0) {
+		*powerRx = (mode == ACQUISITION_ZERO_SPAN_PEAK) ? peak : 10 * std::log10(sumMw / records);
+	}
+	return records;
+}
+
+// before each acquisition; resets max hold (switches through clear/rewrite on its own)
+void resetAcquisitionTrace(const acquisitionSettings& settings) {
+	if (!acquisitionIsZeroSpan(settings.mode)) { // zero span stays in clear/write
+		setSpectrumAnalyzerTraceModeMaxHold();
+	}
+}
+
+// after it; the marker for swept modes, or what acquirePosition() measured in zero span. NaN if unreadable
+double readAcquiredPower(const acquisitionSettings& settings, double zeroSpanPower, std::string* powerText) {
+	if (acquisitionIsZeroSpan(settings.mode)) { // no marker involved
+		*powerText = std::to_string(zeroSpanPower);
+		return zeroSpanPower;
+	}
+	return getSpectrumAnalyzerMarkerValue(1, powerText);
+}
+
+// the selected analyzer's part of a position, with RF already the way it should be
+int acquireOnAnalyzer(const acquisitionSettings& settings, int sweepsWanted, int sweepTimeMs, double* powerRx) {
+	if (settings.mode == ACQUISITION_FREE) {
+		setSpectrumAnalyzerCaptureModeContinuous(true);
+		chamberSleep(sweepTimeMs * sweepsWanted);
+		return 0;
+	} else if (acquisitionIsZeroSpan(settings.mode)) {
+		chamberSleep(settings.settlingTime);
+		return acquireZeroSpanRecords(settings.mode, sweepsWanted, sweepTimeMs, powerRx);
+	}
+	chamberSleep(settings.settlingTime); // RF output and the turntable both need a moment; sweeps only start after it
+	return acquireSpectrumAnalyzerSweeps(sweepsWanted, sweepTimeMs);
+}
+
+// what the other receivers (a plan's [receivers]) measured at the last position, by receiver; [0] is unused,
+// since the fieldfox's goes where it always has
+struct receiverReading {
+	int sweeps = 0;
+	double zeroSpanPower = NAN;
+	double powerRx = NAN;
+	std::string powerText = "";
+	std::vector<float> trace; // with -c
+};
+receiverReading receiverReadings[SPECTRUM_ANALYZERS_MAX];
+
+// readAcquiredPower() for the selected receiver, into its receiverReadings
+void readReceiverPower(const acquisitionSettings& settings, int receiver, bool withTrace) {
+	receiverReading* reading = &receiverReadings[receiver];
+	std::string traceText = "";
+	(*reading).powerRx = readAcquiredPower(settings, (*reading).zeroSpanPower, &(*reading).powerText);
+	(*reading).trace.clear();
+	if (withTrace && getSpectrumAnalyzerTraceData(&traceText)) {
+		parseTraceData(traceText, &(*reading).trace);
+	}
+}
+
+// measures one position. swept modes leave the result in the SA's max hold trace (which the caller has just reset),
+// for the marker to read; zero span modes put it in *powerRx instead (left alone otherwise).
+// withRf false measures with the output off (ie, the noise floor), and isn't counted in the stats.
+// allReceivers has the other receivers measure the same position at the same time, each on its own thread
+// (the caller resets and reads them too; see readReceiverPower).
+// returns the number of completed sweeps; 0 in free mode, where they can't be counted
+int acquirePosition(const acquisitionSettings& settings, int sweepsWanted, int sweepTimeMs, bool withRf, double* powerRx, bool allReceivers) {
+	int sweeps = 0;
+	long long startNs = clockMonotonicNs();
+	if (withRf) {
+		setSignalGenOn(); // no transaction if -k already left it on
+	} else {
+		setSignalGenOff();
+	}
+	if (allReceivers && spectrumAnalyzerCount > 1) {
+		forEachReceiver(0, [&](int receiver) {
+			if (receiver == 0) {
+				sweeps = acquireOnAnalyzer(settings, sweepsWanted, sweepTimeMs, powerRx);
+				return;
+			}
+			receiverReadings[receiver].zeroSpanPower = NAN;
+			receiverReadings[receiver].sweeps = acquireOnAnalyzer(settings, sweepsWanted, sweepTimeMs, &receiverReadings[receiver].zeroSpanPower);
+		});
+	} else {
+		sweeps = acquireOnAnalyzer(settings, sweepsWanted, sweepTimeMs, powerRx);
+	}
+	if (!settings.keepRfOn) {
+		setSignalGenOff();
+	}
+	if (!withRf) {
+		return sweeps;
+	}
+	double elapsedMs = (double)clockElapsedMs(startNs, clockMonotonicNs());
+	sweepAcquisitionStats.positions++;
+	sweepAcquisitionStats.sweeps += sweeps;
+	sweepAcquisitionStats.sumMs += elapsedMs;
+	sweepAcquisitionStats.sumSquaresMs += elapsedMs * elapsedMs;
+	return sweeps;
+}
+
+int acquirePosition(const acquisitionSettings& settings, int sweepsWanted, int sweepTimeMs, bool withRf, double* powerRx) {
+	return acquirePosition(settings, sweepsWanted, sweepTimeMs, withRf, powerRx, false);
+}
+
+// the whole measurement, for when the row timing doesn't matter (ie, references)
+double measurePower(const acquisitionSettings& settings, int sweepsWanted, int sweepTimeMs, bool withRf, int* sweeps, std::string* powerText) {
+	double zeroSpanPower = NAN;
+	resetAcquisitionTrace(settings);
+	*sweeps = acquirePosition(settings, sweepsWanted, sweepTimeMs, withRf, &zeroSpanPower);
+	return readAcquiredPower(settings, zeroSpanPower, powerText);
+}
+
+void printAcquisitionStats(const acquisitionSettings& settings) {
+	const acquisitionStats& stats = sweepAcquisitionStats;
+	if (stats.positions == 0) {
+		return;
+	}
+	double mean = stats.sumMs / stats.positions;
+	double variance = stats.sumSquaresMs / stats.positions - mean * mean;
+	interfaceOut("Acquisition (" + acquisitionModeName(settings.mode) + (settings.keepRfOn ? ", RF kept on" : "") + "): "
+		+ std::to_string((long long)std::llround(mean)) + " ms per position, +/- "
+		+ std::to_string((long long)std::llround(std::sqrt(variance > 0 ? variance : 0))) + " ms"
+		+ (acquisitionCountsSweeps(settings.mode) ? ", " + std::to_string(stats.sweeps) + " sweeps counted" : ""), false);
+}
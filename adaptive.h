@@ -0,0 +1,219 @@
+#pragma once
+// adaptive refinement (-x budget[,minStep,threshold])
+// the -s grid becomes a coarse first pass. after each pass, every measured point is compared with its neighbours one
+// step away along each axis: the difference (gradient) and, where both sides are measured, the second difference
+// (curvature). wherever either reaches the threshold, the midpoint gets measured in the next pass, at half the step.
+// passes continue until nothing changes fast enough, the step would go under minStep, or the point budget is used up.
+// new points are ordered nearest-first from where the turntable is, since both axes move at once.
+//
+// the savestate keeps what the next pass needs (the measured power of every position, the coarse steps and the
+// pass number), so a resume picks up the refinement where it stopped
+
+#define ADAPTIVE_DEFAULT_MIN_STEP (0.25) // degrees
+#define ADAPTIVE_DEFAULT_THRESHOLD (3.0) // dB
+#define ADAPTIVE_ANGLE_KEY_SCALE (1000)  // positions are matched to a thousandth of a degree
+
+#include <string>
+#include <vector>
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "positions.h"
+
+struct adaptivePlan {
+	bool enabled = false;
+	int budget = 0; // total positions, coarse grid included
+	double minStep = ADAPTIVE_DEFAULT_MIN_STEP;
+	double threshold = ADAPTIVE_DEFAULT_THRESHOLD;
+	double coarseAzimuthStep = 0;   // 0 if the grid has a single azimuth
+	double coarseElevationStep = 0;
+	int pass = 0;
+	std::vector<double> measured; // powerRx by position index; NaN until measured
+};
+adaptivePlan sweepAdaptive;
+
+struct adaptiveCandidate {
+	double score; // dB
+	float azimuth;
+	float elevation;
+};
+
+// -x argument: budget[,minStep,threshold]
+bool parseAdaptiveArgument(const std::string& argument, adaptivePlan* plan) {
+	char* end = nullptr;
+	(*plan).budget = (int)strtol(argument.c_str(), &end, 10);
+	if (end == argument.c_str() || (*plan).budget <= 0) {
+		return false;
+	}
+	if (*end == ',') {
+		const char* c = end + 1;
+		(*plan).minStep = strtod(c, &end);
+		if (end == c || *end != ',') {
+			return false;
+		}
+		c = end + 1;
+		(*plan).threshold = strtod(c, &end);
+		if (end == c) {
+			return false;
+		}
+	}
+	if (*end != '\0' || !((*plan).minStep > 0) || !((*plan).threshold > 0)) {
+		return false;
+	}
+	(*plan).enabled = true;
+	return true;
+}
+
+// smallest spacing on each axis of the coarse grid
+void adaptiveSetCoarseSteps(adaptivePlan* plan, const testPosition* positions, int totalPositions) {
+	std::vector<float> azimuths;
+	std::vector<float> elevations;
+	for (int i = 0; i < totalPositions; i++) {
+		azimuths.push_back(positions[i].azimuth);
+		elevations.push_back(positions[i].elevation);
+	}
+	double* steps[2] = { &((*plan).coarseAzimuthStep), &((*plan).coarseElevationStep) };
+	std::vector<float>* axes[2] = { &azimuths, &elevations };
+	for (int axis = 0; axis < 2; axis++) {
+		std::sort((*axes[axis]).begin(), (*axes[axis]).end());
+		*steps[axis] = 0;
+		for (size_t i = 1; i < (*axes[axis]).size(); i++) {
+			double gap = (*axes[axis])[i] - (*axes[axis])[i - 1];
+			if (gap > 1.0 / ADAPTIVE_ANGLE_KEY_SCALE && (*steps[axis] == 0 || gap < *steps[axis])) {
+				*steps[axis] = gap;
+			}
+		}
+	}
+}
+
+void adaptiveRecord(adaptivePlan* plan, int index, double powerRx) {
+	if ((int)(*plan).measured.size() <= index) {
+		(*plan).measured.resize(index + 1, NAN);
+	}
+	(*plan).measured[index] = powerRx;
+}
+
+double adaptiveMeasured(const adaptivePlan& plan, int index) {
+	return (index >= 0 && index < (int)plan.measured.size()) ? plan.measured[index] : NAN;
+}
+
+std::pair<long long, long long> adaptiveKey(double azimuth, double elevation) {
+	return std::make_pair(std::llround(azimuth * ADAPTIVE_ANGLE_KEY_SCALE), std::llround(elevation * ADAPTIVE_ANGLE_KEY_SCALE));
+}
+
+// savestate line: adaptive,budget,minStep,threshold,coarseAzimuthStep,coarseElevationStep,pass
+std::string formatAdaptiveLine(const adaptivePlan& plan) {
+	std::stringstream line;
+	line << "adaptive," << plan.budget << "," << plan.minStep << "," << plan.threshold << ","
+		<< plan.coarseAzimuthStep << "," << plan.coarseElevationStep << "," << plan.pass;
+	return line.str();
+}
+
+bool parseAdaptiveLine(const std::string& line, adaptivePlan* plan) {
+	std::stringstream fields(line);
+	std::string values[7];
+	for (int i = 0; i < 7; i++) {
+		if (!std::getline(fields, values[i], ',')) {
+			return false;
+		}
+	}
+	if (values[0] != "adaptive") {
+		return false;
+	}
+	(*plan).budget = atoi(values[1].c_str());
+	(*plan).minStep = atof(values[2].c_str());
+	(*plan).threshold = atof(values[3].c_str());
+	(*plan).coarseAzimuthStep = atof(values[4].c_str());
+	(*plan).coarseElevationStep = atof(values[5].c_str());
+	(*plan).pass = atoi(values[6].c_str());
+	(*plan).enabled = true;
+	return true;
+}
+
+// the next pass: appends refinement points to *positions, ordered from (azimuth, elevation). returns how many
+int adaptiveRefine(adaptivePlan* plan, testPosition** positions, int* totalPositions, float azimuth, float elevation) {
+	std::map<std::pair<long long, long long>, int> lookup;
+	std::vector<adaptiveCandidate> candidates;
+	double scale = std::pow(2, (*plan).pass);
+	double steps[2] = { (*plan).coarseAzimuthStep / scale, (*plan).coarseElevationStep / scale };
+	for (int i = 0; i < *totalPositions; i++) {
+		lookup[adaptiveKey((*positions)[i].azimuth, (*positions)[i].elevation)] = i;
+	}
+	for (int i = 0; i < *totalPositions; i++) {
+		double here = adaptiveMeasured(*plan, i);
+		if (!std::isfinite(here)) {
+			continue;
+		}
+		for (int axis = 0; axis < 2; axis++) {
+			double step = steps[axis];
+			if (step <= 0 || step / 2 < (*plan).minStep) {
+				continue;
+			}
+			double dAzimuth = (axis == 0) ? step : 0;
+			double dElevation = (axis == 1) ? step : 0;
+			float pAzimuth = (*positions)[i].azimuth;
+			float pElevation = (*positions)[i].elevation;
+			auto next = lookup.find(adaptiveKey(pAzimuth + dAzimuth, pElevation + dElevation));
+			if (next == lookup.end() || !std::isfinite(adaptiveMeasured(*plan, (*next).second))) {
+				continue;
+			}
+			double there = adaptiveMeasured(*plan, (*next).second);
+			double score = std::fabs(there - here); // gradient, per step
+			auto previous = lookup.find(adaptiveKey(pAzimuth - dAzimuth, pElevation - dElevation));
+			if (previous != lookup.end() && std::isfinite(adaptiveMeasured(*plan, (*previous).second))) {
+				score = std::max(score, std::fabs(there - 2 * here + adaptiveMeasured(*plan, (*previous).second))); // curvature
+			}
+			float mAzimuth = (float)(pAzimuth + dAzimuth / 2);
+			float mElevation = (float)(pElevation + dElevation / 2);
+			if (score >= (*plan).threshold && lookup.find(adaptiveKey(mAzimuth, mElevation)) == lookup.end()) {
+				candidates.push_back({ score, mAzimuth, mElevation });
+			}
+		}
+	}
+	(*plan).pass++;
+
+	// biggest changes first, as far as the budget goes
+	std::sort(candidates.begin(), candidates.end(), [](const adaptiveCandidate& a, const adaptiveCandidate& b) { return a.score > b.score; });
+	std::vector<adaptiveCandidate> chosen;
+	for (const adaptiveCandidate& candidate : candidates) {
+		if (*totalPositions + (int)chosen.size() >= (*plan).budget) {
+			break;
+		}
+		if (lookup.insert(std::make_pair(adaptiveKey(candidate.azimuth, candidate.elevation), -1)).second) { // skips duplicates
+			chosen.push_back(candidate);
+		}
+	}
+	if (chosen.empty()) {
+		return 0;
+	}
+
+	// nearest first; the axes move together, so the longer of the two moves is what counts
+	testPosition* grown = new testPosition[*totalPositions + chosen.size()];
+	std::copy(*positions, *positions + *totalPositions, grown);
+	for (size_t n = 0; n < chosen.size(); n++) {
+		size_t nearest = n;
+		double nearestDistance = -1;
+		for (size_t k = n; k < chosen.size(); k++) {
+			double distance = std::max(std::fabs(chosen[k].azimuth - azimuth), std::fabs(chosen[k].elevation - elevation));
+			if (nearestDistance < 0 || distance < nearestDistance) {
+				nearest = k;
+				nearestDistance = distance;
+			}
+		}
+		std::swap(chosen[n], chosen[nearest]);
+		azimuth = chosen[n].azimuth;
+		elevation = chosen[n].elevation;
+		testPosition& added = grown[*totalPositions + n];
+		added = (*positions)[0]; // same frequency and power as the rest of the sweep
+		added.azimuth = chosen[n].azimuth;
+		added.elevation = chosen[n].elevation;
+	}
+	delete[] *positions;
+	*positions = grown;
+	*totalPositions += (int)chosen.size();
+	(*plan).measured.resize(*totalPositions, NAN);
+	return (int)chosen.size();
+}
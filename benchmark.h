@@ -0,0 +1,399 @@
+#pragma once
+// benchmarks (-b), run against a recorded sweep file rather than the instruments
+
+#define BENCHMARK_MIN_DURATION_MS (500) // repeat each benchmark at least this long, for a stable rate
+#define BENCHMARK_REPEATED_TRACE_POINTS (1001) // when the recording has no traces of its own
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <cstring>
+#include <charconv>
+
+#include "helperFunctions.h"
+#include "results.h"
+#include "compression.h"
+#include "instrumentShadow.h"
+#include "scpiCommands.h"
+#include "scpiResponse.h"
+
+// heap allocations made by each thread, so -b can show the command builder allocates nothing.
+// replaces the global operator new; the count is per thread, so it costs an increment and never contends
+thread_local long long benchmarkAllocations = 0;
+void* operator new(size_t size) {
+	benchmarkAllocations++;
+	void* p = malloc(size ? size : 1);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+void operator delete(void* p) noexcept {
+	free(p);
+}
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+bool benchmarkLoadRecording(const std::string& fileName, decompressedResults* recording) {
+	// compressed files are decoded, anything else is read as result csv
+	if (decompressResultFile(fileName, recording)) {
+		return true;
+	}
+	std::ifstream file(fileName);
+	if (!file.is_open()) {
+		return false;
+	}
+	std::string line = "";
+	resultRow row;
+	(*recording).rows.clear();
+	(*recording).traces.clear();
+	while (std::getline(file, line)) {
+		if (parseResultRowCsv(line, &row)) {
+			(*recording).rows.push_back(row);
+			(*recording).traces.emplace_back();
+		}
+	}
+	return !(*recording).rows.empty();
+}
+
+bool benchmarkSameBits(const void* a, const void* b, size_t length) {
+	return memcmp(a, b, length) == 0;
+}
+
+bool benchmarkResultsMatch(const decompressedResults& a, const decompressedResults& b) {
+	if (a.rows.size() != b.rows.size() || a.traces.size() != b.traces.size()) {
+		return false;
+	}
+	for (size_t i = 0; i < a.rows.size(); i++) {
+		const resultRow& x = a.rows[i];
+		const resultRow& y = b.rows[i];
+		if (x.timestampUs != y.timestampUs || x.index != y.index
+			|| !benchmarkSameBits(&x.azimuth, &y.azimuth, sizeof(double)) || !benchmarkSameBits(&x.elevation, &y.elevation, sizeof(double))
+			|| !benchmarkSameBits(&x.frequency, &y.frequency, sizeof(double)) || !benchmarkSameBits(&x.powerTx, &y.powerTx, sizeof(double))
+			|| !benchmarkSameBits(&x.powerRx, &y.powerRx, sizeof(double)) || x.sweeps != y.sweeps || x.referenceId != y.referenceId) {
+			return false;
+		}
+		if (a.traces[i].size() != b.traces[i].size()
+			|| (!a.traces[i].empty() && !benchmarkSameBits(a.traces[i].data(), b.traces[i].data(), sizeof(float) * a.traces[i].size()))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// the same trace at every position (ie, nothing in the beam) packs down to a few bytes per trace, which the decoder
+// has to take even when it's the last record in the file
+bool benchmarkRepeatedTraces(const decompressedResults& recording) {
+	decompressedResults repeated;
+	decompressedResults decoded;
+	std::vector<uint8_t> encoded(COMPRESSED_FILE_MAGIC, COMPRESSED_FILE_MAGIC + COMPRESSED_FILE_MAGIC_LENGTH);
+	compressionState state;
+	std::vector<float> trace(BENCHMARK_REPEATED_TRACE_POINTS, -90.0f);
+	for (size_t i = 0; i < recording.traces.size(); i++) {
+		if (!recording.traces[i].empty()) {
+			trace = recording.traces[i];
+			break;
+		}
+	}
+	compressResetState(&state);
+	for (int i = 0; i < 3; i++) {
+		resultRow row = recording.rows.empty() ? resultRow() : recording.rows[0];
+		row.index = i;
+		repeated.rows.push_back(row);
+		repeated.traces.push_back(trace);
+		compressEncodeRow(&state, row, &encoded);
+		compressEncodeTrace(&state, trace, &encoded);
+	}
+	return decompressResultBuffer(encoded.data(), encoded.size(), &decoded) && benchmarkResultsMatch(repeated, decoded);
+}
+
+void benchmarkCompression(const std::string& fileName) {
+	decompressedResults recording;
+	decompressedResults decoded;
+	std::vector<uint8_t> encoded;
+	compressionState state;
+	long long rawBytes = 0;
+	long long csvBytes = 0;
+	int traceCount = 0;
+	int iterations = 0;
+	long long startNs = 0;
+	long long encodeNs = 0;
+	long long decodeNs = 0;
+
+	if (!benchmarkLoadRecording(fileName, &recording)) {
+		errorOut("Could not read a recorded sweep from " + fileName);
+		return;
+	}
+	for (size_t i = 0; i < recording.rows.size(); i++) {
+		rawBytes += sizeof(long long) + 3 * sizeof(int) + 5 * sizeof(double);
+		csvBytes += formatResultRowCsv(recording.rows[i]).length() + 1;
+		if (!recording.traces[i].empty()) {
+			rawBytes += sizeof(float) * recording.traces[i].size();
+			traceCount++;
+		}
+	}
+
+	// encode
+	startNs = clockMonotonicNs();
+	do {
+		encoded.assign(COMPRESSED_FILE_MAGIC, COMPRESSED_FILE_MAGIC + COMPRESSED_FILE_MAGIC_LENGTH);
+		compressResetState(&state);
+		for (size_t i = 0; i < recording.rows.size(); i++) {
+			compressEncodeRow(&state, recording.rows[i], &encoded);
+			if (!recording.traces[i].empty()) {
+				compressEncodeTrace(&state, recording.traces[i], &encoded);
+			}
+		}
+		iterations++;
+		encodeNs = clockMonotonicNs() - startNs;
+	} while (encodeNs < BENCHMARK_MIN_DURATION_MS * 1000000LL);
+	encodeNs /= iterations;
+
+	// decode, and make sure it round trips bit for bit
+	iterations = 0;
+	startNs = clockMonotonicNs();
+	do {
+		if (!decompressResultBuffer(encoded.data(), encoded.size(), &decoded)) {
+			errorOut("Compression benchmark: decoder rejected its own output!");
+			return;
+		}
+		iterations++;
+		decodeNs = clockMonotonicNs() - startNs;
+	} while (decodeNs < BENCHMARK_MIN_DURATION_MS * 1000000LL);
+	decodeNs /= iterations;
+	bool roundTrip = benchmarkResultsMatch(recording, decoded);
+
+	double rawMB = rawBytes / 1000000.0;
+	interfaceOut("Compression benchmark | " + fileName, false);
+	interfaceOut("  rows: " + std::to_string(recording.rows.size()) + ", traces: " + std::to_string(traceCount)
+		+ ((traceCount == 0) ? " (recorded without -c, so rows only)" : ""), false);
+	interfaceOut("  raw binary: " + std::to_string(rawBytes) + " bytes, csv rows: " + std::to_string(csvBytes)
+		+ " bytes, compressed: " + std::to_string(encoded.size()) + " bytes", false);
+	interfaceOut("  ratio: " + std::to_string((double)rawBytes / encoded.size()) + "x vs raw, "
+		+ std::to_string((double)csvBytes / encoded.size()) + "x vs csv rows", false);
+	interfaceOut("  encode: " + std::to_string(rawMB / (encodeNs / 1e9)) + " MB/s, "
+		+ std::to_string(encodeNs / 1000.0 / recording.rows.size()) + " us per position", false);
+	interfaceOut("  decode: " + std::to_string(rawMB / (decodeNs / 1e9)) + " MB/s", false);
+	interfaceOut(std::string("  lossless round trip: ") + (roundTrip ? "yes" : "NO"), false);
+	interfaceOut(std::string("  repeated traces round trip: ") + (benchmarkRepeatedTraces(recording) ? "yes" : "NO"), false);
+}
+
+// the commands one sweep position sends, built the way the drivers used to (std::to_string concatenation)
+size_t benchmarkCommandsConcatenated(double freq, float power, float azi, float ele) {
+	size_t total = 0;
+	total += ("FREQ " + std::to_string(freq / 1e9) + "E" + std::to_string(9) + "Hz" + "\r\n").length();
+	total += ("POW " + std::to_string(power) + "dBm" + "\r\n").length();
+	total += ("SENS:FREQ:START " + std::to_string((float)(freq - 5e8) / 1e9) + "E" + std::to_string(9) + "Hz" + ";\r\n").length();
+	total += ("SENS:FREQ:STOP " + std::to_string((float)(freq + 5e8) / 1e9) + "E" + std::to_string(9) + "Hz" + ";\r\n").length();
+	total += ("SENS:SWEEP:POINTS " + std::to_string(1001) + ";\r\n").length();
+	total += ("CALC:MARK" + std::to_string(1) + ":X " + std::to_string(freq / 1e9) + "E" + std::to_string(9) + ";\r\n").length();
+	total += ("CALC:MARK" + std::to_string(1) + ":Y?;\r\n").length();
+	total += ("GOTO " + std::to_string((int)azi) + "." + std::to_string((azi - (int)azi) * 100) + "\r\n").length();
+	total += ("GOTO " + std::to_string((int)ele) + "." + std::to_string((ele - (int)ele) * 100) + "\r\n").length();
+	return total;
+}
+
+// the same commands from the templates in scpiCommands.h
+size_t benchmarkCommandsTemplated(double freq, float power, float azi, float ele) {
+	size_t total = 0;
+	scpiCommand command;
+	total += scpiFormat(SCPI_SIGNAL_GEN_FREQUENCY, freq).length;
+	total += scpiFormat(SCPI_SIGNAL_GEN_POWER, power).length;
+	total += scpiFormat(SCPI_SPECTRUM_ANALYZER_FREQ_START, freq - 5e8).length;
+	total += scpiFormat(SCPI_SPECTRUM_ANALYZER_FREQ_STOP, freq + 5e8).length;
+	total += scpiFormat(SCPI_SPECTRUM_ANALYZER_SWEEP_POINTS, 1001).length;
+	scpiBegin(&command);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER, 1);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER_X, freq);
+	total += command.length;
+	scpiBegin(&command);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER, 1);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER_Y_QUERY);
+	total += command.length;
+	total += scpiFormat(SCPI_TURNTABLE_GOTO, azi).length;
+	total += scpiFormat(SCPI_TURNTABLE_GOTO, ele).length;
+	return total;
+}
+
+#define BENCHMARK_COMMANDS_PER_POSITION (9)
+
+void benchmarkCommandBuilder() {
+	size_t (*builders[2])(double, float, float, float) = { benchmarkCommandsConcatenated, benchmarkCommandsTemplated };
+	std::string names[2] = { "to_string concatenation", "scpi templates" };
+	size_t sink = 0; // keeps the compiler from dropping the work
+
+	interfaceOut("Command builder benchmark | " + std::to_string(BENCHMARK_COMMANDS_PER_POSITION) + " commands per position", false);
+	for (int b = 0; b < 2; b++) {
+		long long commands = 0;
+		long long startNs = clockMonotonicNs();
+		long long elapsedNs = 0;
+		long long allocationsBefore = benchmarkAllocations;
+		do {
+			for (int i = 0; i < 1000; i++) {
+				sink += builders[b](2.4e9 + i * 1e6, -10.0f + (i % 16), (float)(i % 360) + 0.25f, (float)(i % 90) - 0.5f);
+			}
+			commands += 1000 * BENCHMARK_COMMANDS_PER_POSITION;
+			elapsedNs = clockMonotonicNs() - startNs;
+		} while (elapsedNs < BENCHMARK_MIN_DURATION_MS * 1000000LL);
+		long long allocations = benchmarkAllocations - allocationsBefore;
+		interfaceOut("  " + names[b] + ": " + std::to_string((double)elapsedNs / commands) + " ns per command, "
+			+ std::to_string((double)allocations / commands) + " allocations per command", false);
+	}
+	debugOut("command builder sink " + std::to_string(sink));
+}
+
+// known answers for the response parser; anything added here is checked on every -b run
+struct benchmarkResponseCase {
+	const char* text;
+	responseUnit_t unit;
+	responseStatus_t status;
+	double value; // checked when status is RESPONSE_OK
+};
+
+const benchmarkResponseCase BENCHMARK_RESPONSE_CORPUS[] = {
+	{ "1", RESPONSE_UNIT_NONE, RESPONSE_OK, 1 },
+	{ " 1", RESPONSE_UNIT_NONE, RESPONSE_OK, 1 },
+	{ "+1\r\n", RESPONSE_UNIT_NONE, RESPONSE_OK, 1 },
+	{ "-0", RESPONSE_UNIT_NONE, RESPONSE_OK, 0 },
+	{ "12.5", RESPONSE_UNIT_NONE, RESPONSE_OK, 12.5 },
+	{ ".5", RESPONSE_UNIT_NONE, RESPONSE_OK, 0.5 },
+	{ "+1.25000000E+01", RESPONSE_UNIT_NONE, RESPONSE_OK, 12.5 },
+	{ "-4.321e-3", RESPONSE_UNIT_NONE, RESPONSE_OK, -0.004321 },
+	{ "+2.40000000000E+09", RESPONSE_UNIT_HERTZ, RESPONSE_OK, 2.4e9 },
+	{ "12000000000", RESPONSE_UNIT_HERTZ, RESPONSE_OK, 12e9 }, // above what an int holds
+	{ "2.4 GHz", RESPONSE_UNIT_HERTZ, RESPONSE_OK, 2.4e9 },
+	{ "2.4GHZ", RESPONSE_UNIT_HERTZ, RESPONSE_OK, 2.4e9 },
+	{ "500 kHz", RESPONSE_UNIT_HERTZ, RESPONSE_OK, 5e5 },
+	{ "-10.00 dBm", RESPONSE_UNIT_DBM, RESPONSE_OK, -10 },
+	{ "-45.2DBM", RESPONSE_UNIT_DBM, RESPONSE_OK, -45.2 },
+	{ "123.45 DEG", RESPONSE_UNIT_DEGREES, RESPONSE_OK, 123.45 },
+	{ "20 ms", RESPONSE_UNIT_SECONDS, RESPONSE_OK, 0.02 },
+	{ "9.91E+37", RESPONSE_UNIT_DBM, RESPONSE_INSTRUMENT_NAN, 0 },
+	{ "+9.91000000E+37", RESPONSE_UNIT_NONE, RESPONSE_INSTRUMENT_NAN, 0 },
+	{ "9.9E37", RESPONSE_UNIT_NONE, RESPONSE_INSTRUMENT_INFINITY, 0 },
+	{ "-9.9E+37", RESPONSE_UNIT_NONE, RESPONSE_INSTRUMENT_INFINITY, 0 },
+	{ "", RESPONSE_UNIT_NONE, RESPONSE_EMPTY, 0 },
+	{ " \r\n", RESPONSE_UNIT_NONE, RESPONSE_EMPTY, 0 },
+	{ "abc", RESPONSE_UNIT_NONE, RESPONSE_NOT_A_NUMBER, 0 },
+	{ "nan", RESPONSE_UNIT_NONE, RESPONSE_NOT_A_NUMBER, 0 },
+	{ "inf", RESPONSE_UNIT_NONE, RESPONSE_NOT_A_NUMBER, 0 },
+	{ "+-1", RESPONSE_UNIT_NONE, RESPONSE_NOT_A_NUMBER, 0 },
+	{ "--1", RESPONSE_UNIT_NONE, RESPONSE_NOT_A_NUMBER, 0 },
+	{ "-", RESPONSE_UNIT_NONE, RESPONSE_NOT_A_NUMBER, 0 },
+	{ ".", RESPONSE_UNIT_NONE, RESPONSE_NOT_A_NUMBER, 0 },
+	{ "1.2.3", RESPONSE_UNIT_NONE, RESPONSE_TRAILING_GARBAGE, 0 },
+	{ "1e", RESPONSE_UNIT_NONE, RESPONSE_TRAILING_GARBAGE, 0 },
+	{ "0x10", RESPONSE_UNIT_NONE, RESPONSE_TRAILING_GARBAGE, 0 },
+	{ "1,2", RESPONSE_UNIT_NONE, RESPONSE_TRAILING_GARBAGE, 0 },
+	{ "5 furlongs", RESPONSE_UNIT_HERTZ, RESPONSE_TRAILING_GARBAGE, 0 },
+	{ "5 Hz", RESPONSE_UNIT_NONE, RESPONSE_WRONG_UNIT, 0 },
+	{ "-10 dBm", RESPONSE_UNIT_HERTZ, RESPONSE_WRONG_UNIT, 0 },
+	{ "1e400", RESPONSE_UNIT_NONE, RESPONSE_OUT_OF_RANGE, 0 },
+	{ "**ERROR**", RESPONSE_UNIT_NONE, RESPONSE_NOT_A_NUMBER, 0 }
+};
+
+#define BENCHMARK_FUZZ_INPUTS (200000)
+
+unsigned long long benchmarkRandom(unsigned long long* state) { // xorshift, so runs are repeatable
+	(*state) ^= (*state) << 13;
+	(*state) ^= (*state) >> 7;
+	(*state) ^= (*state) << 17;
+	return *state;
+}
+
+void benchmarkResponseParser() {
+	int corpusFailures = 0;
+	int fuzzFailures = 0;
+	unsigned long long rng = 0x2545F4914F6CDD1DULL;
+
+	// corpus
+	for (const benchmarkResponseCase& c : BENCHMARK_RESPONSE_CORPUS) {
+		double value = 0;
+		responseStatus_t status = parseResponseNumber(c.text, &value, c.unit);
+		if (status != c.status || (status == RESPONSE_OK && !shadowSameValue(value, c.value))) {
+			errorOut("  parser corpus: \"" + std::string(c.text) + "\" gave " + responseStatusText(status) + " " + std::to_string(value)
+				+ ", expected " + responseStatusText(c.status) + " " + std::to_string(c.value));
+			corpusFailures++;
+		}
+	}
+
+	// fuzz: random text from the characters responses are made of. it must never read out of bounds,
+	// and anything accepted as RESPONSE_OK has to be a finite number
+	const char alphabet[] = "0123456789+-.eE \r\n,;HhZzdDBbMmGgKkSsUuNn9";
+	char input[32];
+	for (int i = 0; i < BENCHMARK_FUZZ_INPUTS; i++) {
+		int length = (int)(benchmarkRandom(&rng) % sizeof(input));
+		for (int j = 0; j < length; j++) {
+			input[j] = alphabet[benchmarkRandom(&rng) % (sizeof(alphabet) - 1)];
+		}
+		double value = 0;
+		responseStatus_t status = parseResponseNumber(std::string_view(input, length), &value, (responseUnit_t)(i % 5));
+		if (status == RESPONSE_OK && !std::isfinite(value)) {
+			fuzzFailures++;
+		}
+	}
+	// fuzz: every finite double has to survive to_chars -> parse exactly, in plain and SCPI NR3 form
+	for (int i = 0; i < BENCHMARK_FUZZ_INPUTS; i++) {
+		unsigned long long bits = benchmarkRandom(&rng);
+		double original = 0;
+		double parsed = 0;
+		memcpy(&original, &bits, sizeof(double));
+		if (!std::isfinite(original) || std::fabs(std::fabs(original) - SCPI_RESPONSE_INFINITY) <= 1e-6 * SCPI_RESPONSE_INFINITY
+			|| std::fabs(original - SCPI_RESPONSE_NAN) <= 1e-6 * SCPI_RESPONSE_NAN) {
+			continue;
+		}
+		std::to_chars_result written = std::to_chars(input, input + sizeof(input), original, (i % 2) ? std::chars_format::scientific : std::chars_format::general);
+		if (written.ec != std::errc()) {
+			continue;
+		}
+		if (parseResponseNumber(std::string_view(input, written.ptr - input), &parsed) != RESPONSE_OK || !benchmarkSameBits(&original, &parsed, sizeof(double))) {
+			fuzzFailures++;
+		}
+	}
+
+	// speed, on the responses a sweep actually sees
+	const char* typical[] = { "+2.40000000000E+09\n", "-1.000000E+01", "+1", "123.45", "-45.1234567", "9.91E+37" };
+	const int typicalCount = sizeof(typical) / sizeof(typical[0]);
+	double sink = 0;
+	long long parses = 0;
+	long long startNs = clockMonotonicNs();
+	long long parserNs = 0;
+	do {
+		for (int i = 0; i < 1000; i++) {
+			double value = 0;
+			parseResponseNumber(typical[i % typicalCount], &value);
+			sink += value;
+		}
+		parses += 1000;
+		parserNs = clockMonotonicNs() - startNs;
+	} while (parserNs < BENCHMARK_MIN_DURATION_MS * 1000000LL);
+	long long strtodParses = 0;
+	long long strtodNs = 0;
+	startNs = clockMonotonicNs();
+	do {
+		for (int i = 0; i < 1000; i++) {
+			std::string text = typical[i % typicalCount]; // the old drivers parsed a std::string copy
+			sink += strtod(text.c_str(), nullptr);
+		}
+		strtodParses += 1000;
+		strtodNs = clockMonotonicNs() - startNs;
+	} while (strtodNs < BENCHMARK_MIN_DURATION_MS * 1000000LL);
+
+	interfaceOut("Response parser benchmark", false);
+	interfaceOut("  corpus: " + std::to_string(sizeof(BENCHMARK_RESPONSE_CORPUS) / sizeof(BENCHMARK_RESPONSE_CORPUS[0])) + " cases, "
+		+ std::to_string(corpusFailures) + " failed", false);
+	interfaceOut("  fuzz: " + std::to_string(2 * BENCHMARK_FUZZ_INPUTS) + " inputs, " + std::to_string(fuzzFailures) + " failed", false);
+	interfaceOut("  parseResponseNumber: " + std::to_string((double)parserNs / parses) + " ns per response, strtod on a copy: "
+		+ std::to_string((double)strtodNs / strtodParses) + " ns", false);
+	debugOut("response parser sink " + std::to_string(sink));
+}
+
+void runBenchmarks(const std::string& recordedSweepFile) {
+	benchmarkResponseParser();
+	benchmarkCommandBuilder();
+	benchmarkCompression(recordedSweepFile);
+}
@@ -0,0 +1,215 @@
+#pragma once
+// boresight search (-e azimuthMin,azimuthMax,elevationMin,elevationMax[,tolerance])
+// finds the peak of the received power inside a window, instead of lining the antennas up by hand with one-off sweeps.
+//   1. azimuth, through the middle elevation: a coarse scan to find the main lobe, then a golden section search
+//      between the scan points either side of the best one
+//   2. elevation, at that azimuth, the same way
+//   3. a small pattern search around the result (both axes, step halving) in case the axes aren't independent
+// each probe is one measurement with the -t acquisition, read from the marker like a sweep position.
+// stops once the steps are under the tolerance, and leaves the turntable on the peak
+
+#define BORESIGHT_TOLERANCE_DEFAULT (0.5) // degrees
+#define BORESIGHT_COARSE_POINTS (7)       // per axis; enough that a sidelobe doesn't win the golden section
+#define BORESIGHT_GOLDEN_RATIO (0.6180339887498949)
+#define BORESIGHT_PROBE_LIMIT (400)       // gives up rather than wander, if the pattern is all noise
+
+#include <string>
+#include <map>
+#include <utility>
+#include <cmath>
+
+#include "helperFunctions.h"
+#include "turntable.h"
+#include "fieldfox.h"
+#include "acquisition.h"
+#include "chamberClock.h"
+
+struct boresightWindow {
+	bool enabled = false;
+	float azimuthMin = 0;
+	float azimuthMax = 0;
+	float elevationMin = 0;
+	float elevationMax = 0;
+	float tolerance = BORESIGHT_TOLERANCE_DEFAULT;
+};
+boresightWindow boresightTarget;
+
+struct boresightProbes {
+	std::map<std::pair<long long, long long>, double> measured; // dBm, by angle to a thousandth of a degree
+	int count = 0;
+	int sweepTimeMs = 0;
+	float bestAzimuth = 0;
+	float bestElevation = 0;
+	double bestPower = -INFINITY;
+};
+
+// -e argument: azimuthMin,azimuthMax,elevationMin,elevationMax[,tolerance]
+bool parseBoresightArgument(const std::string& argument, boresightWindow* window) {
+	float values[5] = { 0, 0, 0, 0, BORESIGHT_TOLERANCE_DEFAULT };
+	const char* c = argument.c_str();
+	char* end = nullptr;
+	int count = 0;
+	do {
+		if (count == 5) {
+			return false; // too many
+		}
+		if (count > 0) {
+			c = end + 1;
+		}
+		values[count] = strtof(c, &end);
+		if (end == c || !std::isfinite(values[count])) {
+			return false;
+		}
+		count++;
+	} while (*end == ',');
+	if (*end != '\0' || count < 4 || values[0] > values[1] || values[2] > values[3] || !(values[4] > 0)) {
+		return false;
+	}
+	(*window).azimuthMin = values[0];
+	(*window).azimuthMax = values[1];
+	(*window).elevationMin = values[2];
+	(*window).elevationMax = values[3];
+	(*window).tolerance = values[4];
+	(*window).enabled = true;
+	return true;
+}
+
+// one measurement at (azimuth, elevation); unreadable power counts as nothing there. repeats aren't measured twice
+double boresightProbe(boresightProbes* probes, float azimuth, float elevation) {
+	std::pair<long long, long long> key = std::make_pair(std::llround(azimuth * 1000.0), std::llround(elevation * 1000.0));
+	auto known = (*probes).measured.find(key);
+	if (known != (*probes).measured.end()) {
+		return (*known).second;
+	}
+	int sweeps = 0;
+	std::string powerText = "";
+	double power = -INFINITY;
+	if (moveTurntable(azimuth, elevation)) {
+		power = measurePower(sweepAcquisition, sweepAcquisition.sweepsPerPosition, (*probes).sweepTimeMs, true, &sweeps, &powerText);
+		power = std::isfinite(power) ? power : -INFINITY;
+	}
+	(*probes).count++;
+	(*probes).measured[key] = power;
+	if (power > (*probes).bestPower) {
+		(*probes).bestPower = power;
+		(*probes).bestAzimuth = azimuth;
+		(*probes).bestElevation = elevation;
+	}
+	debugOut("Boresight probe " + std::to_string((*probes).count) + ": " + std::to_string(azimuth) + ", " + std::to_string(elevation) + " -> " + powerText + " dBm");
+	return power;
+}
+
+bool boresightShouldStop(const boresightProbes& probes) {
+	return shouldSaveAndClose() || probes.count >= BORESIGHT_PROBE_LIMIT;
+}
+
+// peak along one axis (the other held at fixed); returns the position along the axis
+float boresightLineSearch(boresightProbes* probes, bool alongAzimuth, float min, float max, float fixed, float tolerance) {
+	auto probeAt = [&](float x) { return alongAzimuth ? boresightProbe(probes, x, fixed) : boresightProbe(probes, fixed, x); };
+	if (max - min <= tolerance) {
+		return (min + max) / 2;
+	}
+
+	// coarse scan, so the golden section starts around the main lobe
+	int best = 0;
+	double bestPower = -INFINITY;
+	float step = (max - min) / (BORESIGHT_COARSE_POINTS - 1);
+	for (int i = 0; i < BORESIGHT_COARSE_POINTS && !boresightShouldStop(*probes); i++) {
+		double power = probeAt(min + step * i);
+		if (power > bestPower) {
+			bestPower = power;
+			best = i;
+		}
+	}
+	float a = min + step * std::max(best - 1, 0);
+	float b = min + step * std::min(best + 1, BORESIGHT_COARSE_POINTS - 1);
+
+	// golden section; one new probe per step
+	float x1 = b - (float)BORESIGHT_GOLDEN_RATIO * (b - a);
+	float x2 = a + (float)BORESIGHT_GOLDEN_RATIO * (b - a);
+	double p1 = probeAt(x1);
+	double p2 = probeAt(x2);
+	while (b - a > tolerance && !boresightShouldStop(*probes)) {
+		if (p1 >= p2) {
+			b = x2;
+			x2 = x1;
+			p2 = p1;
+			x1 = b - (float)BORESIGHT_GOLDEN_RATIO * (b - a);
+			p1 = probeAt(x1);
+		} else {
+			a = x1;
+			x1 = x2;
+			p1 = p2;
+			x2 = a + (float)BORESIGHT_GOLDEN_RATIO * (b - a);
+			p2 = probeAt(x2);
+		}
+	}
+	return (p1 >= p2) ? x1 : x2;
+}
+
+// compass search around the best probe so far, halving the step until it's under the tolerance
+void boresightPatternSearch(boresightProbes* probes, const boresightWindow& window, float step) {
+	const float moves[4][2] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 } };
+	while (step >= window.tolerance && !boresightShouldStop(*probes)) {
+		bool improved = false;
+		float azimuth = (*probes).bestAzimuth;
+		float elevation = (*probes).bestElevation;
+		for (int i = 0; i < 4 && !boresightShouldStop(*probes); i++) {
+			float nextAzimuth = azimuth + moves[i][0] * step;
+			float nextElevation = elevation + moves[i][1] * step;
+			if (nextAzimuth < window.azimuthMin || window.azimuthMax < nextAzimuth
+				|| nextElevation < window.elevationMin || window.elevationMax < nextElevation) {
+				continue;
+			}
+			double before = (*probes).bestPower;
+			boresightProbe(probes, nextAzimuth, nextElevation);
+			if ((*probes).bestPower > before) {
+				improved = true;
+				break; // carry on from the new best
+			}
+		}
+		if (!improved) {
+			step /= 2;
+		}
+	}
+}
+
+// returns true if a peak was found (the turntable is left on it)
+bool boresightModeStart(const boresightWindow& window) {
+	boresightProbes probes;
+	long long startNs = clockMonotonicNs();
+	spectrumAnalyzerAcquisition acquisition;
+	double sweepSeconds = getSpectrumAnalyzerAcquisition(&acquisition) ? spectrumAnalyzerSweepSeconds(acquisition) : 0;
+	probes.sweepTimeMs = (sweepSeconds > 0) ? (int)std::ceil(sweepSeconds * 1000) : DEFAULT_MEASUREMENT_TIME / sweepAcquisition.sweepsPerPosition;
+
+	interfaceOut("Boresight search: azimuth " + std::to_string(window.azimuthMin) + " to " + std::to_string(window.azimuthMax)
+		+ ", elevation " + std::to_string(window.elevationMin) + " to " + std::to_string(window.elevationMax)
+		+ ", to within " + std::to_string(window.tolerance) + " degrees (" + acquisitionModeName(sweepAcquisition.mode) + " acquisition)", false);
+
+	float middleElevation = (window.elevationMin + window.elevationMax) / 2;
+	float azimuth = boresightLineSearch(&probes, true, window.azimuthMin, window.azimuthMax, middleElevation, window.tolerance);
+	interfaceOut("Boresight azimuth: " + std::to_string(azimuth) + " (" + std::to_string(probes.count) + " probes)", false);
+	float elevation = boresightLineSearch(&probes, false, window.elevationMin, window.elevationMax, azimuth, window.tolerance);
+	interfaceOut("Boresight elevation: " + std::to_string(elevation) + " (" + std::to_string(probes.count) + " probes)", false);
+	boresightPatternSearch(&probes, window, 2 * window.tolerance);
+
+	if (sweepAcquisition.keepRfOn) {
+		setSignalGenOff();
+	}
+	setSpectrumAnalyzerCaptureModeContinuous(true); // back to a live display
+	long long elapsedMs = clockElapsedMs(startNs, clockMonotonicNs());
+	if (!std::isfinite(probes.bestPower)) {
+		errorOut("Boresight search found no readable power.");
+		return false;
+	}
+	if (shouldSaveAndClose()) {
+		errorOut("Boresight search stopped early; best so far is below.");
+	} else if (probes.count >= BORESIGHT_PROBE_LIMIT) {
+		errorOut("Boresight search hit the limit of " + std::to_string(BORESIGHT_PROBE_LIMIT) + " probes; best so far is below.");
+	}
+	moveTurntable(probes.bestAzimuth, probes.bestElevation);
+	interfaceOut("Boresight: azimuth " + std::to_string(probes.bestAzimuth) + ", elevation " + std::to_string(probes.bestElevation)
+		+ ", " + std::to_string(probes.bestPower) + " dBm - " + std::to_string(probes.count) + " probes in "
+		+ std::to_string(elapsedMs / 1000 / 60) + " minutes " + std::to_string(elapsedMs / 1000 % 60) + " seconds", false);
+	return true;
+}
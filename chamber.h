@@ -15,19 +15,32 @@
 // in ms
 #define DEFAULT_TURNTABLE_MOVEMENT_ESTIMATE (4000)
 #define DEFAULT_MEASUREMENT_TIME (10000)
-#define MINIMUM_MEASUREMENT_TIME (1000)
+// per device, for connecting at startup (and kept as the VISA I/O timeout after)
+#define DEVICE_TIMEOUT_TURNTABLE        (3000)
+#define DEVICE_TIMEOUT_SIGNAL_GENERATOR (3000)
+#define DEVICE_TIMEOUT_FIELDFOX         (TELNET_CONNECT_TIMEOUT)
+
+// in seconds; saved measurement timing older than this is measured again
+#define CALIBRATION_MAX_AGE (24 * 60 * 60)
 
 #include "helperFunctions.h"
 #include "inputArgs.h"
 #include "signalGenerator.h"
 #include "fieldfox.h"
 #include "turntable.h"
+#include "acquisition.h"
+#include "reference.h"
+#include "positions.h"
+#include "adaptive.h"
+#include "supervision.h"
 #include "visaHelperFunctions.h"
 
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <thread>
+#include <atomic>
 #include <time.h>
 #include <Windows.h> // for Beep(), and signal handling function
 
@@ -43,16 +56,22 @@ extern float turntableEleLimitMax;
 
 // provide configurable measurement time, and fieldfox options
 int spectrumAnalyzerMeasurementTime = DEFAULT_MEASUREMENT_TIME;
-
-struct testPosition {
-	float elevation;
-	float azimuth;
-	long long frequency; // need range to cover high GHz values, like 12GHz
-	int power;
+bool sweepMeasurementTimeKnown = false; // worked out for the analyzer as it's set up now; cleared when that changes (chamberOps.cpp)
+
+// measurement timing, carried in the savestate so a resume doesn't have to measure it again.
+// only reused while the SA settings that set the sweep time are unchanged
+struct sweepCalibration {
+	bool valid = false;
+	unsigned long long settingsKey = 0; // hash of span, RBW, VBW and points
+	long long measuredAt = 0;           // UTC seconds
+	long long measurementTime = 0;      // ms of SA dwell at each position
+	long long movementAverageTime = DEFAULT_TURNTABLE_MOVEMENT_ESTIMATE; // ms, moving average of turntable moves
+	int movementSamples = 0;
 };
+sweepCalibration savedCalibration;
 
 // provide other files with a "should save and close" functionality
-bool saveAndCloseFlag = false;
+std::atomic<bool> saveAndCloseFlag(false); // set from the ctrl+c handler, and by the daemon's listener on "stop"
 
 // function declarations
 void saveSweepState(testPosition* positions, int totalPositions, int nextIndex); // for sweep mode
@@ -178,11 +197,93 @@ bool verifyDevicesReady() {
 	return verifyDevicesReady(&temp1, &temp2, &temp3, &temp4);
 }
 
+// startup connects to every instrument at once, so it takes as long as the slowest one rather than the sum
+struct deviceBringUp {
+	std::string name = "";
+	bool ready = false;
+	long long elapsedMs = 0;
+};
+
+void deviceBringUpReport(deviceBringUp* device, bool ready, long long startNs) {
+	(*device).ready = ready;
+	(*device).elapsedMs = clockElapsedMs(startNs, clockMonotonicNs());
+	if (ready) {
+		interfaceOut("  " + (*device).name + " ready (" + std::to_string((*device).elapsedMs) + " ms)", false);
+	} else {
+		errorOut("  " + (*device).name + " not ready after " + std::to_string((*device).elapsedMs) + " ms");
+	}
+}
+
+// each of these only touches its own session, receive buffer and status slot, so they can run side by side
+void bringUpTurntableAzimuth(deviceBringUp* device, long long startNs) {
+	deviceBringUpReport(device, openDeviceSession(DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH) && isTurntableAziReady(), startNs);
+}
+void bringUpTurntableElevation(deviceBringUp* device, long long startNs) {
+	deviceBringUpReport(device, openDeviceSession(DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION) && isTurntableEleReady(), startNs);
+}
+void bringUpSignalGen(deviceBringUp* device, long long startNs) {
+	deviceBringUpReport(device, openDeviceSession(DEVICE_STATUS_INDEX_SIGNAL_GENERATOR) && isSignalGenReady(), startNs);
+}
+void bringUpSpectrumAnalyzer(deviceBringUp* device, long long startNs) { // whichever this thread has selected
+	deviceBringUpReport(device, openDeviceSession(spectrumAnalyzerDevice()) && isSpectrumAnalyzerReady(), startNs);
+}
+
+void bringUpDevice(deviceBringUp* devices, int device, long long startNs) {
+	void (*bringUp[DEVICE_STATUS_INDEX_FIELDFOX])(deviceBringUp*, long long) = { bringUpTurntableAzimuth, bringUpTurntableElevation, bringUpSignalGen };
+	if (device < DEVICE_STATUS_INDEX_FIELDFOX) {
+		bringUp[device](&devices[device], startNs);
+		return;
+	}
+	selectSpectrumAnalyzer(device - DEVICE_STATUS_INDEX_FIELDFOX);
+	bringUpSpectrumAnalyzer(&devices[device], startNs);
+	selectSpectrumAnalyzer(0);
+}
+
 bool initiateDevices() {
-	// setup device connections
-	bool visaSuccess = setupVisa();
-	bool turntableLimitsSuccess = getTurntableSoftLimits();
-	bool fieldFoxSuccess = setupTelnet();
+	long long startNs = clockMonotonicNs();
+	int deviceCount = supervisedDeviceCount(); // the other receivers come after the fieldfox
+	deviceBringUp devices[DEVICE_STATUS_DEVICES_MAX];
+	devices[DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH].name   = "Turntable Azimuth";
+	devices[DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION].name = "Turntable Elevation";
+	devices[DEVICE_STATUS_INDEX_SIGNAL_GENERATOR].name    = "Signal Generator";
+	devices[DEVICE_STATUS_INDEX_FIELDFOX].name            = "Field Fox";
+	for (int i = 1; i < spectrumAnalyzerCount; i++) {
+		devices[DEVICE_STATUS_INDEX_FIELDFOX + i].name = "Receiver " + spectrumAnalyzers[i].name;
+	}
+
+	// shared setup first, then one thread per device
+	visaInitResourceManager(&globalVisaResourceManager);
+	telnetInitWSA(&wsaDataConnection);
+	interfaceOut("Connecting to instruments...", false);
+	int readyCount = 0;
+	long long slowestMs = 0;
+	if (simulationActive) { // -d: one at a time, each from the same start on the virtual clock, as if side by side
+		long long endNs = startNs;
+		for (int i = 0; i < deviceCount; i++) {
+			clockSimulatedNs = startNs;
+			bringUpDevice(devices, i, startNs);
+			endNs = std::max(endNs, clockMonotonicNs());
+		}
+		clockSimulatedNs = endNs;
+	} else {
+		std::thread bringUpThreads[DEVICE_STATUS_DEVICES_MAX];
+		for (int i = 0; i < deviceCount; i++) {
+			bringUpThreads[i] = std::thread(bringUpDevice, devices, i, startNs);
+		}
+		for (int i = 0; i < deviceCount; i++) {
+			bringUpThreads[i].join();
+		}
+	}
+	for (int i = 0; i < deviceCount; i++) {
+		readyCount += devices[i].ready ? 1 : 0;
+		slowestMs = std::max(slowestMs, devices[i].elapsedMs);
+	}
+	interfaceOut(std::to_string(readyCount) + " of " + std::to_string(deviceCount) + " instruments ready after " + std::to_string(clockElapsedMs(startNs, clockMonotonicNs()))
+		+ " ms (slowest device " + std::to_string(slowestMs) + " ms).", false);
+	if (simulationActive) {
+		simulationEndConnect();
+	}
+
 	if (getProgFlag(V_FLAG_INDEX)) {
 		printDeviceStatus();
 		if (deviceConnectionStatus[DEVICE_STATUS_INDEX_FIELDFOX] != true) {
@@ -190,7 +291,7 @@ bool initiateDevices() {
 					\nIP: 192.168.0.2 ---------- Subnet mask: 255.255.248.0");
 		}
 	}
-	return visaSuccess && turntableLimitsSuccess && fieldFoxSuccess && verifyDevicesReady();
+	return readyCount == deviceCount;
 }
 
 void interactiveModeStart() { //until quit, display a user interface and allow interaction
@@ -198,33 +299,109 @@ void interactiveModeStart() { //until quit, display a user interface and allow i
 	exit(-1);
 }
 
-bool sweepModeStart(testPosition* positions, int* totalPositions, int* nextIndex) { // returns true if sweep was finished to the end
-	int numMeasurementsDesired = 3; // how many iterations of the fieldfox scan should we wait for?
+// one readback query; the key covers everything that changes how long a sweep takes
+bool calibrationSettingsKey(unsigned long long* key) {
+	double values[6]; // start, stop, rbw, vbw, points, marker
+	responseStatus_t status = RESPONSE_OK;
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_READBACK), &(*spectrumAnalyzer).receiveText);
+	if (parseResponseList((*spectrumAnalyzer).receiveText, values, 6, &status) != 6) {
+		debugOut("Could not read SA settings for the calibration key (" + responseStatusText(status) + ")");
+		return false;
+	}
+	*key = HASH_START;
+	for (int i = 0; i < 5; i++) { // not the marker
+		long long rounded = std::llround(values[i]);
+		*key = hashBytes(*key, &rounded, sizeof(rounded));
+	}
+	return true;
+}
+
+bool calibrationIsUsable(const sweepCalibration& calibration, unsigned long long key) {
+	long long age = chamberTimestamp() - calibration.measuredAt;
+	return calibration.valid && calibration.settingsKey == key && 0 <= age && age <= CALIBRATION_MAX_AGE;
+}
+
+// ms per position for estimates, before sweepModeStart() has worked out the measurement time
+long long sweepPositionEstimateMs() {
+	return (savedCalibration.valid ? savedCalibration.measurementTime : DEFAULT_MEASUREMENT_TIME)
+		+ savedCalibration.movementAverageTime + 6000; // constant for I/O, as in sweepModeStart()
+}
+
+// plans (-l) with several frequencies or powers set this; called before a position whose frequency or power
+// differs from what the instruments were last set to
+void (*sweepRetune)(long long frequency, int power) = nullptr;
+
+// with -x, once a pass is done, the next pass's positions go on the end of the array (see adaptive.h)
+bool sweepNextPass(testPosition** positions, int* totalPositions) {
+	if (!sweepAdaptive.enabled || *totalPositions <= 0) {
+		return false;
+	}
+	testPosition last = (*positions)[*totalPositions - 1]; // where the turntable is now
+	int added = adaptiveRefine(&sweepAdaptive, positions, totalPositions, last.azimuth, last.elevation);
+	if (added > 0) {
+		interfaceOut("Refinement pass " + std::to_string(sweepAdaptive.pass) + ": " + std::to_string(added) + " positions added ("
+			+ std::to_string(*totalPositions) + " of " + std::to_string(sweepAdaptive.budget) + " budgeted)", false);
+	} else {
+		interfaceOut("Refinement finished after " + std::to_string(sweepAdaptive.pass) + " pass(es).", false);
+	}
+	return added > 0;
+}
+
+bool sweepModeStart(testPosition** positionsArray, int* totalPositions, int* nextIndex) { // returns true if sweep was finished to the end
+	testPosition* positions = *positionsArray; // moves when a refinement pass adds positions
+	int numMeasurementsDesired = sweepAcquisition.sweepsPerPosition; // how many fieldfox sweeps go into each max hold value
+	int sweepsCompleted = 0;
 	
-	unsigned long int startTime   = 0;
-	unsigned long int endTime     = 0;
-	unsigned long int elapsedTime = 0;
-	long int movementStartTimestamp = 0;
-	long int movementEndTimestamp   = 0;
-	long int movementAverageTime    = DEFAULT_TURNTABLE_MOVEMENT_ESTIMATE; // moving average; A_(n+1) =  A_(n) + ( x_(n+1) + n*A_(n) ) / ( n + 1 )
+	long long startTime   = 0;
+	long long endTime     = 0;
+	long long elapsedTime = 0;
+	long long movementStartTimestamp = 0;
+	long long movementEndTimestamp   = 0;
+	long long movementAverageTime    = DEFAULT_TURNTABLE_MOVEMENT_ESTIMATE; // moving average; A_(n+1) =  A_(n) + ( x_(n+1) + n*A_(n) ) / ( n + 1 )
 	int remainingPositions = *totalPositions - *nextIndex;
-	unsigned long int remainingTimeEstimate = 0;
-
-	// estimate measurement times more accurately
-	interfaceOut("Estimating Spectrum Analyzer measurement time...", false);
-	setSpectrumAnalyzerTraceModeClearRewriteLive();
-	startTime = timestampMs();
-	setSpectrumAnalyzerCaptureModeImmediate(); // blocking call
-	endTime = timestampMs(); // in seconds
-	setSpectrumAnalyzerCaptureModeContinuous(true); // restore normal operation time
-	setSpectrumAnalyzerTraceModeMaxHold();
-	spectrumAnalyzerMeasurementTime = (endTime - startTime) * numMeasurementsDesired;
-	// enforce a minimum scan time of 5 seconds
-	spectrumAnalyzerMeasurementTime = (spectrumAnalyzerMeasurementTime > MINIMUM_MEASUREMENT_TIME) ?
-																	 spectrumAnalyzerMeasurementTime : MINIMUM_MEASUREMENT_TIME;
-	// reset timers
-	startTime = 0;
-	endTime = 0;
+	long long remainingTimeEstimate = 0;
+	long long tunedFrequency = (*nextIndex < *totalPositions) ? positions[*nextIndex].frequency : 0; // set up before the sweep starts
+	int tunedPower = (*nextIndex < *totalPositions) ? positions[*nextIndex].power : 0;
+	int positionRetries = 0; // of the current position, after an instrument dropped out
+
+	// reuse the last sweep's timing if the SA hasn't been set up again since, or the savestate's if it's set up the same way,
+	// otherwise measure it
+	unsigned long long calibrationKey = 0;
+	bool haveCalibrationKey = !sweepMeasurementTimeKnown && calibrationSettingsKey(&calibrationKey);
+	if (sweepMeasurementTimeKnown) {
+		movementAverageTime = savedCalibration.movementAverageTime;
+		interfaceOut("Using the measurement timing from the last sweep (same SA setup).", false);
+	} else if (haveCalibrationKey && calibrationIsUsable(savedCalibration, calibrationKey)) {
+		spectrumAnalyzerMeasurementTime = (int)savedCalibration.measurementTime;
+		movementAverageTime = savedCalibration.movementAverageTime;
+		sweepMeasurementTimeKnown = true;
+		interfaceOut("Using measurement timing from the savestate (measured "
+			+ std::to_string((chamberTimestamp() - savedCalibration.measuredAt) / 60) + " minutes ago).", false);
+	} else {
+		if (savedCalibration.valid) {
+			interfaceOut("Saved measurement timing is stale, or for different SA settings.", false);
+		}
+		// ask the analyzer how long a sweep takes, instead of timing one (which also timed the telnet delays)
+		spectrumAnalyzerAcquisition acquisition;
+		bool haveAcquisition = getSpectrumAnalyzerAcquisition(&acquisition);
+		double sweepSeconds = haveAcquisition ? spectrumAnalyzerSweepSeconds(acquisition) : 0;
+		if (sweepSeconds > 0) {
+			spectrumAnalyzerMeasurementTime = (int)std::ceil(sweepSeconds * 1000 * numMeasurementsDesired);
+			sweepMeasurementTimeKnown = true;
+			debugOut("SA sweep time " + std::to_string(acquisition.sweepTime) + " s (model " + std::to_string(acquisition.modelSweepTime)
+				+ " s) at span " + std::to_string(acquisition.span) + " Hz, RBW " + std::to_string(acquisition.bwRes)
+				+ " Hz, VBW " + std::to_string(acquisition.bwVideo) + " Hz, " + std::to_string(acquisition.points) + " points");
+		} else {
+			errorOut("Could not work out the SA sweep time; assuming " + std::to_string(DEFAULT_MEASUREMENT_TIME / 1000) + " seconds per position.");
+			spectrumAnalyzerMeasurementTime = DEFAULT_MEASUREMENT_TIME;
+		}
+
+		savedCalibration = sweepCalibration();
+		savedCalibration.valid = haveCalibrationKey && sweepSeconds > 0;
+		savedCalibration.settingsKey = calibrationKey;
+		savedCalibration.measuredAt = chamberTimestamp();
+		savedCalibration.measurementTime = spectrumAnalyzerMeasurementTime;
+	}
 
 	// estimate time of each measurement, seperate from the movement of the turntable
 	remainingTimeEstimate = remainingPositions * (spectrumAnalyzerMeasurementTime + movementAverageTime + 6000); // constant for I/O
@@ -234,12 +411,12 @@ bool sweepModeStart(testPosition* positions, int* totalPositions, int* nextIndex
 	printPositionsTable(positions, (*totalPositions > 10 ? 10 : *totalPositions));
 	interfaceOut("Total Positions: " + std::to_string(*totalPositions) + 
 		((*nextIndex != 0)? "(starting at position " + std::to_string(*nextIndex+1) + ")" : ""), false);
-	interfaceOut("Time of each SA measurement: " + std::to_string(spectrumAnalyzerMeasurementTime/1000)+" seconds", false);
+	interfaceOut("Time of each SA measurement: " + std::to_string(spectrumAnalyzerMeasurementTime) + " ms (" + std::to_string(numMeasurementsDesired) + " sweeps)", false);
 	interfaceOut("Time Estimate:   " + std::to_string(remainingTimeEstimate/1000/60) + " minutes " 
 		                             + std::to_string(remainingTimeEstimate/1000%60) + " seconds", false);
 	infoBeep();
-	if ('n' == ynPrompt("Proceed with these values?")) {
-		if ('y' == ynPrompt("Would you like to savestate your current settings, for inspection?")) {
+	if ('n' == ynPrompt("Proceed with these values?", PROMPT_PROCEED)) {
+		if ('y' == ynPrompt("Would you like to savestate your current settings, for inspection?", PROMPT_SAVESTATE)) {
 			saveSweepState(positions, *totalPositions, *nextIndex);
 			interfaceOut("Savestate created.", false);
 		} else {
@@ -247,7 +424,25 @@ bool sweepModeStart(testPosition* positions, int* totalPositions, int* nextIndex
 		}
 		exit(-1);
 	}
-	interfaceOut("Data format is | timestamp, azimuth, elevation, frequency, powerTx, and powerRx",false);
+	interfaceOut("Acquisition: " + acquisitionModeName(sweepAcquisition.mode)
+		+ (acquisitionCountsSweeps(sweepAcquisition.mode) ? ", " + std::to_string(sweepAcquisition.settlingTime) + " ms settling" : "")
+		+ (sweepAcquisition.keepRfOn ? ", RF kept on between positions" : ""), false);
+	if (sweepAdaptive.enabled) {
+		interfaceOut("Adaptive refinement: up to " + std::to_string(sweepAdaptive.budget) + " positions, down to "
+			+ std::to_string(sweepAdaptive.minStep) + " degree steps where neighbours differ by " + std::to_string(sweepAdaptive.threshold)
+			+ " dB (time estimate is for this pass only)", false);
+	}
+	if (sweepReferences.enabled) {
+		interfaceOut(std::string("References: ") + ((sweepReferences.kind == REFERENCE_BOTH) ? "noise and boresight" : (sweepReferences.kind == REFERENCE_NOISE) ? "noise" : "boresight")
+			+ (sweepReferences.everyRow ? " every elevation row" : " every " + std::to_string(sweepReferences.intervalMinutes) + " minutes")
+			+ ", written to " + REFERENCE_FILE_DEFAULT, false);
+	}
+	interfaceOut("Data format is | timestamp, azimuth, elevation, frequency, powerTx, powerRx, sweeps, and referenceId",false);
+	for (int receiver = 1; receiver < spectrumAnalyzerCount; receiver++) {
+		interfaceOut("Receiver " + spectrumAnalyzers[receiver].name + " measures at every position too, written to "
+			+ receiverFileName(getProgFlag(O_FLAG_INDEX) ? progFlagArgs[O_FLAG_INDEX]
+				: (getProgFlag(C_FLAG_INDEX) ? DATA_FILE_DEFAULT_COMPRESSED : DATA_FILE_DEFAULT), spectrumAnalyzers[receiver].name), false);
+	}
 
 	// move turntable to initial position before starting loop
 	/*
@@ -261,47 +456,94 @@ bool sweepModeStart(testPosition* positions, int* totalPositions, int* nextIndex
 
 	startTime = timestampMs(); // used to determine total elapsed time at end
 
-	while (*(nextIndex) < *(totalPositions) && !shouldSaveAndClose()) { // ctrl+c will trigger shouldSaveAndClose()
+	// ctrl+c will trigger shouldSaveAndClose(); with -x, the end of a pass may add another
+	while (!shouldSaveAndClose() && (*(nextIndex) < *(totalPositions) || sweepNextPass(positionsArray, totalPositions))) {
+		positions = *positionsArray;
 		// need timestamp, azi, ele, frequency, powerTx, and powerRx on each iteration
-		// make sure all the devices are ready
-		for (bool warningIssued = false; !verifyDevicesReady(); warningIssued = true) {
-			if (!warningIssued) { errorOut("Some instruments are not responding..."); }
-			errorBeep();
-			Sleep(10000);
+		// make sure all the devices are ready; any that aren't are reconnected on their own (see supervision.h)
+		if (!superviseDevices(tunedFrequency, tunedPower)) {
+			break; // ctrl+c while waiting for one
+		}
+		long long positionStartNs = clockMonotonicNs();
+		long long positionFaults = transportFaultCount;
+
+		// next frequency or power of a plan; the analyzer keeps its span, so the sweep time carries over
+		if (sweepRetune != nullptr && (positions[*(nextIndex)].frequency != tunedFrequency || positions[*(nextIndex)].power != tunedPower)) {
+			tunedFrequency = positions[*(nextIndex)].frequency;
+			tunedPower = positions[*(nextIndex)].power;
+			interfaceOut("Retuning to " + std::to_string(tunedFrequency) + " Hz, " + std::to_string(tunedPower) + " dBm", false);
+			sweepRetune(tunedFrequency, tunedPower);
 		}
 
+		// noise floor / boresight references, when the schedule says so (see reference.h)
+		runScheduledReferences(positions[*(nextIndex)].elevation, sweepAcquisition, numMeasurementsDesired,
+			spectrumAnalyzerMeasurementTime / numMeasurementsDesired);
+
 		// move turntable
 		movementStartTimestamp = timestampMs();
 		moveTurntable(positions[*(nextIndex)].azimuth, positions[*(nextIndex)].elevation);
 		movementEndTimestamp = timestampMs();
 
-		// reset max hold on spectrum analyzer
-		setSpectrumAnalyzerTraceModeClearRewriteLive();
-		setSpectrumAnalyzerTraceModeMaxHold();
-
-		setSignalGenOn();
-		Sleep(spectrumAnalyzerMeasurementTime);
-		setSignalGenOff();
+		// reset max hold on spectrum analyzer (every receiver at once), then dwell for a counted number of complete sweeps (see acquisition.h)
+		forEachReceiver(0, [](int /*receiver*/) { resetAcquisitionTrace(sweepAcquisition); });
+		double zeroSpanPower = NAN;
+		sweepsCompleted = acquirePosition(sweepAcquisition, numMeasurementsDesired, spectrumAnalyzerMeasurementTime / numMeasurementsDesired, true, &zeroSpanPower, true);
+		if (acquisitionCountsSweeps(sweepAcquisition.mode) && sweepsCompleted < numMeasurementsDesired) {
+			errorOut("Only " + std::to_string(sweepsCompleted) + " of " + std::to_string(numMeasurementsDesired)
+				+ " sweeps completed at position " + std::to_string(*(nextIndex) + 1) + ".");
+		}
 
 		// take measurement - from all instruments // timestamp,azi,ele,freq,pTx,pRx
-		int dataTimestamp = chamberTimestamp(); // should be in seconds
 		std::string dataAziTxt   = "";
 		std::string dataEleTxt   = "";
 		std::string dataFreqTxt  = "";
 		std::string dataPowTxTxt = "";
 		std::string dataPowRxTxt = "";
-		double dataAzi   = getTurntableAziPosition(&dataAziTxt);
-		double dataEle   = getTurntableElePosition(&dataEleTxt);
-		double dataFreq  = getSignalGenFreq();
-		dataFreqTxt = std::to_string(dataFreq);
-		double dataPowTx = getSignalGenPower();
-		dataPowTxTxt = std::to_string(dataPowTx);
-		double dataPowRx = getSpectrumAnalyzerMarkerValue(1, &dataPowRxTxt);
+		resultRow dataRow;
+		dataRow.index     = *(nextIndex);
+		dataRow.sweeps    = sweepsCompleted;
+		dataRow.referenceId = sweepReferenceState.lastId;
+		dataRow.azimuth   = getTurntableAziPosition(&dataAziTxt);
+		dataRow.elevation = getTurntableElePosition(&dataEleTxt);
+		dataRow.frequency = getSignalGenFreq();
+		dataFreqTxt = std::to_string(dataRow.frequency);
+		dataRow.powerTx   = getSignalGenPower();
+		dataPowTxTxt = std::to_string(dataRow.powerTx);
+		long long acquisitionStartNs = clockMonotonicNs();
+		long long acquisitionEndNs = acquisitionStartNs;
+		forEachReceiver(0, [&](int receiver) { // the other receivers read theirs alongside
+			if (receiver > 0) {
+				readReceiverPower(sweepAcquisition, receiver, getProgFlag(C_FLAG_INDEX));
+				return;
+			}
+			dataRow.powerRx = readAcquiredPower(sweepAcquisition, zeroSpanPower, &dataPowRxTxt);
+			acquisitionEndNs = clockMonotonicNs();
+		});
+		// stamp the row at the middle of the marker query, so the instrument latency is split evenly
+		dataRow.timestampUs = clockMonotonicToUtcNs(acquisitionStartNs + (acquisitionEndNs - acquisitionStartNs) / 2) / 1000;
+		std::string dataTimestamp = clockFormatUtc(dataRow.timestampUs * 1000);
+		// compressed output also keeps the full trace, since that's where the storage goes
+		std::vector<float> dataTrace;
+		if (getProgFlag(C_FLAG_INDEX)) {
+			std::string dataTraceTxt = "";
+			getSpectrumAnalyzerTraceData(&dataTraceTxt);
+			if (!parseTraceData(dataTraceTxt, &dataTrace)) { errorOut("Could not read the spectrum analyzer trace."); }
+		}
+
+		// an instrument dropped out part way; once it's back, the whole position is measured again
+		if ((transportFaultCount != positionFaults || std::isnan(dataRow.powerRx)) && positionRetries < SUPERVISION_POSITION_RETRIES) {
+			positionRetries++;
+			errorOut("Position " + std::to_string(*(nextIndex) + 1) + " was interrupted, measuring it again.");
+			supervisionRetryPosition(positionStartNs);
+			continue;
+		}
+		positionRetries = 0;
 
 		// update values for next loop (not index yet)
 		// moving average; A_(n+1) =  A_(n) + ( x_(n+1) + n*A_(n) ) / ( n + 1 )
-		int n = *(nextIndex) + 1; // add 1 so it will never be zero
+		int n = ++savedCalibration.movementSamples; // carries over from the savestate, so a resume keeps its history
 		movementAverageTime = movementAverageTime + (((movementEndTimestamp - movementStartTimestamp) - movementAverageTime) / (n + 1));
+		savedCalibration.movementAverageTime = movementAverageTime;
 		remainingPositions = *totalPositions - (*nextIndex+1);
 		remainingTimeEstimate = remainingPositions * (spectrumAnalyzerMeasurementTime + movementAverageTime + 6000); // constant accounts for some I/O
 
@@ -309,17 +551,31 @@ bool sweepModeStart(testPosition* positions, int* totalPositions, int* nextIndex
 		std::string dataToConsole = "[" + std::to_string(*(nextIndex)+1)+"/" + std::to_string(*(totalPositions)) + "] "
 										+ (std::to_string(remainingTimeEstimate / 1000 / 60)) + " min "
 										+ (std::to_string(remainingTimeEstimate / 1000 % 60)) + " sec left | "
-										+ std::to_string(dataTimestamp) + ","
+										+ dataTimestamp + ","
 										+ dataAziTxt + "," + dataEleTxt + ","
 										+ dataFreqTxt + "," 
-										+ dataPowTxTxt + "," + dataPowRxTxt;
-		std::string dataToFile = std::to_string(dataTimestamp) + "," + std::to_string(*(nextIndex)) + "," 
-								+ std::to_string(dataAzi) + "," + std::to_string(dataEle) + ","
-								+std::to_string(dataFreq) + "," + std::to_string(dataPowTx) + "," + std::to_string(dataPowRx);
+										+ dataPowTxTxt + "," + dataPowRxTxt + ","
+										+ std::to_string(sweepsCompleted) + "," + std::to_string(dataRow.referenceId);
+		for (int receiver = 1; receiver < spectrumAnalyzerCount; receiver++) {
+			dataToConsole += " | " + spectrumAnalyzers[receiver].name + " " + receiverReadings[receiver].powerText;
+		}
 		// output data to console first, in case file operations crash
 		interfaceOut(dataToConsole, false);
-		if (dataOut(dataToFile) == false) { errorOut("Failed to write to file.");errorBeep(); }
+		if (resultOut(dataRow, &dataTrace) == false) { errorOut("Failed to write to file.");errorBeep(); }
 		else{ infoBeep(); }
+		// the other receivers' rows are the same but for what they measured, each in its own file
+		for (int receiver = 1; receiver < spectrumAnalyzerCount; receiver++) {
+			resultRow receiverRow = dataRow;
+			receiverRow.sweeps  = receiverReadings[receiver].sweeps;
+			receiverRow.powerRx = receiverReadings[receiver].powerRx;
+			if (resultOut(receiverRow, &receiverReadings[receiver].trace, receiver) == false) {
+				errorOut("Failed to write to file (receiver " + spectrumAnalyzers[receiver].name + ").");
+				errorBeep();
+			}
+		}
+		if (sweepAdaptive.enabled) {
+			adaptiveRecord(&sweepAdaptive, *(nextIndex), dataRow.powerRx);
+		}
 
 		// update index
 		*(nextIndex) = *(nextIndex) + 1;
@@ -327,8 +583,29 @@ bool sweepModeStart(testPosition* positions, int* totalPositions, int* nextIndex
 
 	endTime = timestampMs();
 	elapsedTime = endTime - startTime;
+	if (sweepAcquisition.keepRfOn) {
+		setSignalGenOff(); // left on between positions, so it's still on here (also after ctrl+c)
+	}
+	setSpectrumAnalyzerCaptureModeContinuous(true); // back to a live display
+	forEachReceiver(1, [](int /*receiver*/) { setSpectrumAnalyzerCaptureModeContinuous(true); });
 
 	interfaceOut("Sweep Run time: " + std::to_string(elapsedTime/1000/60) + " minutes " + std::to_string(elapsedTime/1000%60) + " seconds",false);
+	printAcquisitionStats(sweepAcquisition);
+	printSupervisionSummary();
+	long long analyzerSaved = 0;
+	long long verifyMismatches = signalGenShadow.verifyMismatches;
+	for (int i = 0; i < spectrumAnalyzerCount; i++) {
+		analyzerSaved += spectrumAnalyzers[i].shadow.savedTransactions;
+		verifyMismatches += spectrumAnalyzers[i].shadow.verifyMismatches;
+	}
+	interfaceOut("Instrument transactions skipped by the state cache: "
+		+ std::to_string(signalGenShadow.savedTransactions) + " (signal generator), "
+		+ std::to_string(analyzerSaved) + " (spectrum analyzer" + std::string(spectrumAnalyzerCount > 1 ? "s" : "") + ")", false);
+	if (verifyMismatches > 0) {
+		errorOut("Instrument settings changed during the sweep " + std::to_string(verifyMismatches)
+			+ " time(s) - check the front panels.");
+	}
+	return *(nextIndex) >= *(totalPositions);
 }
 
 /*
@@ -339,19 +616,25 @@ void runSweep(testPosition* positions, int totalPositions, int nextIndex) { //op
 */
 
 // save program state
-const int saveFormatVersion = 1;
+const int saveFormatVersion = 3; // 2 added the calibration line, 3 the adaptive line and measured column; 1 and 2 are still read
 void saveSweepState(testPosition* positions, int totalPositions, int nextIndex) { //from dedicated.dat file in local directory
 	// FORMAT
 	// version (int)
 	// timestamp (int)
 	// nextPosition index (int)
 	// totalPositions
+	// calibration (version 2+): calibration,valid,settingsKey (hex),measuredAt,measurementTime,movementAverageTime,movementSamples
+	// adaptive (version 3+, only with -x): adaptive,budget,minStep,threshold,coarseAzimuthStep,coarseElevationStep,pass
 	// list (format below)
 	// 
-	// azimuth (float), elevation (float), freq in Hz(int), power in dB (int)
+	// azimuth (float), elevation (float), freq in Hz(int), power in dB (int), (with -x) measured powerRx or nan
 
 	bool fileExists = false;
 	char promptResponse = 'q';
+	if (simulationActive) {
+		interfaceOut("Dry run: no savestate written.", false);
+		return;
+	}
 
 	// if dedicated.dat exists, ask if it should be overwritten
 	if (FILE* file = fopen(SAVE_STATE_FILE_DEFAULT, "r")) {
@@ -359,7 +642,7 @@ void saveSweepState(testPosition* positions, int totalPositions, int nextIndex)
 	}
 
 	if (fileExists) {
-		promptResponse = ynPrompt("Should the existing savestate file be overwritten?");
+		promptResponse = ynPrompt("Should the existing savestate file be overwritten?", PROMPT_OVERWRITE);
 		if (promptResponse == 'n'){
 			interfaceOut("Program state will not be saved.",false);
 			return;
@@ -368,20 +651,52 @@ void saveSweepState(testPosition* positions, int totalPositions, int nextIndex)
 
 	std::ofstream savefile;
 	// write to file
-	savefile.open(SAVE_STATE_FILE_DEFAULT, 'w');
+	savefile.open(SAVE_STATE_FILE_DEFAULT, std::ios::out | std::ios::trunc);
 	savefile << saveFormatVersion  << std::endl; // version (int)
-	savefile << chamberTimestamp() << std::endl; // timestamp (int)
+	savefile << chamberTimestamp() << std::endl; // timestamp (seconds, UTC)
 	savefile << nextIndex          << std::endl; // nextPosition index (int)
 	savefile << totalPositions     << std::endl; // totalPositions
+	savefile << "calibration," << (savedCalibration.valid ? 1 : 0) << ","
+		<< std::hex << savedCalibration.settingsKey << std::dec << ","
+		<< savedCalibration.measuredAt << "," << savedCalibration.measurementTime << ","
+		<< savedCalibration.movementAverageTime << "," << savedCalibration.movementSamples << std::endl;
+	if (sweepAdaptive.enabled) {
+		savefile << formatAdaptiveLine(sweepAdaptive) << std::endl;
+	}
 	// list (format below)
 	for (int i = 0; i < totalPositions; i++) {
 		savefile << positions[i].azimuth << ",";
 		savefile << positions[i].elevation << ",";
 		savefile << positions[i].frequency << ",";
-		savefile << positions[i].power << std::endl;
+		savefile << positions[i].power;
+		if (sweepAdaptive.enabled) {
+			savefile << "," << adaptiveMeasured(sweepAdaptive, i);
+		}
+		savefile << std::endl;
 	}
 	savefile.close();
 }
+bool parseCalibrationLine(const std::string& line, sweepCalibration* calibration) {
+	std::stringstream fields(line);
+	std::string field = "";
+	std::string values[7];
+	for (int i = 0; i < 7; i++) {
+		if (!std::getline(fields, field, ',')) {
+			return false;
+		}
+		values[i] = field;
+	}
+	if (values[0] != "calibration") {
+		return false;
+	}
+	(*calibration).valid = (atoi(values[1].c_str()) == 1);
+	(*calibration).settingsKey = strtoull(values[2].c_str(), nullptr, 16);
+	(*calibration).measuredAt = atoll(values[3].c_str());
+	(*calibration).measurementTime = atoll(values[4].c_str());
+	(*calibration).movementAverageTime = atoll(values[5].c_str());
+	(*calibration).movementSamples = atoi(values[6].c_str());
+	return true;
+}
 bool loadSweepState(testPosition** positions, int* nextPosition, int* totalPositions) { //from dedicated.dat file in local directory
 	int version = -1;
 	int lineOfFile = 0;
@@ -389,6 +704,7 @@ bool loadSweepState(testPosition** positions, int* nextPosition, int* totalPosit
 	int subOffset = 0;
 	int subOffset2 = 0;
 	int subOffset3 = 0;
+	size_t subOffset4 = 0;
 	std::ifstream savefile;
 	std::string s = ""; // line by line of file
 	std::string subs = ""; // sub-string to process the comma delineation
@@ -400,13 +716,19 @@ bool loadSweepState(testPosition** positions, int* nextPosition, int* totalPosit
 	// timestamp (int)
 	// nextPosition index (int)
 	// totalPositions
+	// calibration (version 2+)
+	// adaptive (version 3+, optional)
 	// list (format below)
+	int firstTableLine = 4;
+	savedCalibration = sweepCalibration(); // version 1 files have none, so it gets measured
+	sweepAdaptive = adaptivePlan();
 	while (std::getline(savefile, s)) {
 		if (lineOfFile == 0) { // version of file format
 			version = atoi(s.c_str());
-			if (version != saveFormatVersion) {
+			if (version < 1 || version > saveFormatVersion) {
 				errorOut("Can't read savestate file! Wrong version."); exit(-1);
 			}
+			firstTableLine = (version >= 2) ? 5 : 4;
 		} else if(lineOfFile == 1){ // timestamp
 			debugOut("Timestamp read successfully");
 		} else if(lineOfFile == 2){ // nextPositionIndex
@@ -417,7 +739,18 @@ bool loadSweepState(testPosition** positions, int* nextPosition, int* totalPosit
 			debugOut("Loading positions array of size:");
 			int slotsToAllocate = (*totalPositions);
 			*positions = new testPosition[slotsToAllocate];
-		} else if(lineOfFile >= 4){
+		} else if(lineOfFile == 4 && firstTableLine == 5){ // calibration
+			if (!parseCalibrationLine(s, &savedCalibration)) {
+				debugOut("Savestate calibration unreadable; it will be measured again.");
+				savedCalibration = sweepCalibration();
+			}
+		} else if(lineOfFile == firstTableLine && version >= 3 && s.rfind("adaptive,", 0) == 0){ // refinement frontier
+			if (!parseAdaptiveLine(s, &sweepAdaptive)) {
+				errorOut("Savestate adaptive line unreadable; no further refinement passes.");
+				sweepAdaptive = adaptivePlan();
+			}
+			firstTableLine++;
+		} else if(lineOfFile >= firstTableLine){
 			if (lineOfTable >= (*totalPositions)) {
 				errorOut("Date file may be malformed...there is more position data than expected.");
 				break;
@@ -439,6 +772,10 @@ bool loadSweepState(testPosition** positions, int* nextPosition, int* totalPosit
 			subOffset3 = s.find(',', subOffset2+1); 
 				(*positions)[lineOfTable].frequency = atof((s.substr(subOffset2+1, subOffset3 - subOffset2)).c_str());
 				(*positions)[lineOfTable].power     = atoi((s.substr(subOffset3+1, 99999)).c_str());
+			subOffset4 = s.find(',', subOffset3+1);
+			if (sweepAdaptive.enabled && subOffset4 != std::string::npos) { // measured power, for the next refinement pass
+				adaptiveRecord(&sweepAdaptive, lineOfTable, atof((s.substr(subOffset4+1, 99999)).c_str()));
+			}
 			lineOfTable++;
 		} else { // lineOfFile is somehow negative
 			errorOut("Line of File variable is somehow negative. Aborting file read...");
@@ -0,0 +1,83 @@
+#pragma once
+// program clock
+// monotonic nanoseconds are used for measuring intervals (movement, dwell, instrument latency),
+// and a UTC epoch value captured alongside it is used for anything that gets recorded.
+// both are 64 bit everywhere, so ms/ns values don't overflow like the old ftime() based timestampMs()
+
+#include <string>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+
+// first call pins the monotonic clock to the wall clock; every UTC timestamp after that is derived from it,
+// so recorded timestamps stay consistent with measured intervals even if the system clock is adjusted mid-run
+long long clockAnchorMonotonicNs = 0;
+long long clockAnchorUtcNs = 0;
+std::once_flag clockAnchorFlag;
+
+// dry run (-d, see simulation.h): the simulated instruments move this clock on, instead of time passing
+std::atomic<bool> clockSimulated(false);
+std::atomic<long long> clockSimulatedNs(0);
+
+long long clockMonotonicNs() {
+	if (clockSimulated) {
+		return clockSimulatedNs;
+	}
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// starts the virtual clock where the real one is, so timestamps still look like today
+void clockStartSimulated() {
+	clockSimulatedNs = clockMonotonicNs();
+	clockSimulated = true;
+}
+
+void clockAdvanceSimulated(long long ns) {
+	clockSimulatedNs += ns;
+}
+
+long long clockSystemUtcNs() { // reads the wall clock directly; prefer clockUtcNs()
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void clockCaptureAnchor() {
+	std::call_once(clockAnchorFlag, [] {
+		clockAnchorMonotonicNs = clockMonotonicNs();
+		clockAnchorUtcNs = clockSystemUtcNs();
+	});
+}
+
+long long clockMonotonicToUtcNs(long long monotonicNs) {
+	clockCaptureAnchor();
+	return clockAnchorUtcNs + (monotonicNs - clockAnchorMonotonicNs);
+}
+
+long long clockUtcNs() { // nanoseconds since Jan 1, 1970 (UTC)
+	return clockMonotonicToUtcNs(clockMonotonicNs());
+}
+
+long long clockElapsedMs(long long startMonotonicNs, long long endMonotonicNs) {
+	return (endMonotonicNs - startMonotonicNs) / 1000000;
+}
+
+// "seconds.microseconds" since the epoch - still sorts like the old linux timestamps, but resolves sub-millisecond
+std::string clockFormatUtc(long long utcNs) {
+	long long micros = utcNs / 1000;
+	std::string fraction = std::to_string(micros % 1000000);
+	return std::to_string(micros / 1000000) + "." + std::string(6 - fraction.length(), '0') + fraction;
+}
+
+long long chamberTimestamp(std::string* timestampText) { // whole seconds since Jan 1, 1970 (UTC)
+	long long seconds = clockUtcNs() / 1000000000;
+	*(timestampText) = std::to_string(seconds);
+	return seconds;
+}
+
+long long chamberTimestamp() {
+	std::string temp = "";
+	return chamberTimestamp(&temp);
+}
+
+long long timestampMs() { // monotonic - only for measuring intervals
+	return clockMonotonicNs() / 1000000;
+}
@@ -15,7 +15,7 @@
 //#define DEBUG
 //#define SHOULD_PREPRINT_POSITIONS
 #define PROGRAM_VERSION (7)
-#define ACCEPTABLE_ARGUMENTS ("hmsf:p:ro:viyz")
+#define ACCEPTABLE_ARGUMENTS ("a:b:cde:g:hj:kl:mn:sf:p:q:ro:t:uvw:ix:yz")
 
 #define EXPERIMENT_DEFAULT_POSITIONS (nullptr)
 #define EXPERIMENT_DEFAULT_NEXT_POSITION   (-1)
@@ -27,9 +27,10 @@
 #define NAN_DOUBLE (std::numeric_limits<double>::quiet_NaN())
 
 enum programMode_t{
-	SETUP_MODE, SWEEP_MODE, INTERACTIVE_MODE, CLEANUP_MODE
+	SETUP_MODE, SWEEP_MODE, BORESIGHT_MODE, INTERACTIVE_MODE, CLEANUP_MODE
 } programMode;
 
+#define NOMINMAX // std::max/min in the headers below; Windows.h would make them macros
 #include <string>
 #include <iostream>
 #include "inputArgs.h"
@@ -38,18 +39,292 @@ enum programMode_t{
 //#pragma comment(lib, "Ws2_32.lib")
 
 #include "chamber.h"
+#include "instrumentProfile.h"
+#include "sweepOptimizer.h"
+#include "sampling.h"
+#include "boresight.h"
+#include "jobs.h"
+#include "plan.h"
+#include "daemon.h"
+#include "benchmark.h"
 
 void printHelp() {
+	logFlush();
 	std::cout << "chamberOps.exe version " << std::to_string(PROGRAM_VERSION) <<std::endl
+			  << "  -a: optimise SA settings for the fastest sweep, given minLevel,maxLevel,snr (dBm, dBm, dB), ie -a -70,-20,20" << std::endl
+			  << "      (maxLevel sets the input attenuation, minLevel and snr the RBW; one pilot measurement per frequency and power)" << std::endl
+			  << "      (takes a short pilot measurement with RF on and off first)" << std::endl
+			  << "  -b: benchmark result compression on a recorded sweep file (csv or .chz), then exit" << std::endl
+			  << "  -c: compress results, with the full SA trace of each position (default file chamberTurntable.chz)" << std::endl
+			  << "  -d: dry run - run against timing models of the instruments and turntable (see simulation.h), then report the" << std::endl
+			  << "      total time, where it went, bus use, out of limit positions and axis travel. nothing is written" << std::endl
+			  << "  -e: boresight search - find the peak inside azimuthMin,azimuthMax,elevationMin,elevationMax[,tolerance]" << std::endl
+			  << "      (degrees; tolerance defaults to " << BORESIGHT_TOLERANCE_DEFAULT << "), and leave the turntable on it. ALSO REQUIRES -f and -p" << std::endl
 			  << "  -f: targetFreq  (only hz for now, future take suffix of GHz, KHz, etc)" << std::endl
+			  << "  -g: sampling plan for -s - grid (default), rings (azimuth step widens with elevation), equalarea or fibonacci;" << std::endl
+			  << "      the densities apply at the horizon, and the plan is clipped to the turntable soft limits" << std::endl
 			  << "  -i: interactive mode (the default) - NOT YET IMPLEMENTED" << std::endl
+			  << "  -j: run the jobs in a job file back to back, answering prompts by policy (see jobs.h for the format);" << std::endl
+			  << "      other flags set the defaults for every job" << std::endl
+			  << "  -k: keep RF on while the turntable moves, rather than switching it off at every position" << std::endl
+			  << "  -l: run the sweep described by a plan file - axes, frequency and power lists, acquisition, analyzer" << std::endl
+			  << "      settings, instrument addresses, other receivers measuring alongside the fieldfox, and output" << std::endl
+			  << "      (see plan.h for the format), in place of -s, -f and -p" << std::endl
 			  << "  -m: use current fieldfox and signal generator settings (manual override)" << std::endl
+			  << "  -n: reference captures - kind,cadence[,azimuth,elevation] with kind noise (RF off), boresight or both," << std::endl
+			  << "      and cadence row (every elevation row) or <N>m (every N minutes), ie -n both,row,0,0" << std::endl
+			  << "      references go to " << REFERENCE_FILE_DEFAULT << "; each result row has the id of the latest one" << std::endl
 			  << "  -o: sets a name for output file, for data" << std::endl
 			  << "  -p: targetPower (in dbm)" << std::endl
+			  << "  -q: how often (ms) cached instrument settings are read back from the instruments (default 60000)" << std::endl
 			  << "  -r: resume from savestate" << std::endl
 			  << "  -s: sweep mode, taking 4 or 6 arguments for  " << std::endl
 			  << "      azimuthMin, azimuthMax, elevationMin, elevationMax, (optional)aziDensity, (optional)elevDensity" << std::endl
-			  << "      ALSO REQUIRES -f and -p" << std::endl;
+			  << "      ALSO REQUIRES -f and -p" << std::endl
+			  << "  -t: acquisition mode - triggered (default; counted single sweeps), free (free-running SA)," << std::endl
+			  << "      zeromean or zeropeak (zero span on the tone; mean or peak power over short time records)," << std::endl
+			  << "      optionally with a settling time in ms, ie -t triggered,200 (default " << ACQUISITION_SETTLING_TIME_DEFAULT << ")" << std::endl
+			  << "  -u: save the instrument setup as a profile, or recall it if one was saved for the same settings" << std::endl
+			  << "  -w: stay connected and take job files over a local socket at this path, ie -w C:\\chamber\\chamber.sock" << std::endl
+			  << "      one command per line: status, devices, run <job file>, jobs (text, then end), watch, stop, shutdown (see daemon.h)" << std::endl
+			  << "  -x: adaptive refinement of the -s grid - budget[,minStep,threshold], ie -x 2000,0.25,3" << std::endl
+			  << "      adds midpoints, pass by pass, wherever neighbouring positions differ by threshold dB or more (default "
+			  << ADAPTIVE_DEFAULT_THRESHOLD << " dB, down to " << ADAPTIVE_DEFAULT_MIN_STEP << " degrees), up to budget positions in total" << std::endl;
+}
+
+// what prepareInstruments() last worked out, for putting a reconnected instrument back (see restoreInstrument),
+// and for a job that wants the same thing to start without it (see runJobQueue)
+struct preparedInstruments {
+	bool valid = false;
+	long long frequency = 0;
+	double power = 0;
+	acquisitionSettings acquisition;
+	planAnalyzer analyzer;
+	instrumentSetup setup;
+	double zeroSpanFrequency = 0;
+};
+preparedInstruments lastPrepared;
+
+// instrument settings for sweep and boresight modes
+void prepareInstruments(long long targetFrequency, double targetPower) {
+	instrumentSetup setup;
+	sweepMeasurementTimeKnown = false; // whatever it was measured on is about to change
+	if (!getProgFlag(M_FLAG_INDEX)) { // don't change settings if "manual" flag is specified
+		setupFromTarget(&setup, (double)targetFrequency, targetPower);
+		applyPlanAnalyzer(activePlan.analyzer, &setup); // -l; nothing changes without a plan
+		// with -a, a pilot on the default setup replaces its SA settings with the fastest ones that still meet the SNR
+		if (getProgFlag(A_FLAG_INDEX)) {
+			optimizeInstrumentSetup(sweepOptimizerTarget, sweepAcquisition.sweepsPerPosition, &setup);
+		}
+		// with -u, a saved profile for the same settings replaces the command-by-command setup
+		if (!getProgFlag(U_FLAG_INDEX) || !restoreInstrumentProfile(setup)) {
+			applyInstrumentSetup(setup);
+			if (getProgFlag(U_FLAG_INDEX)) {
+				saveInstrumentProfile(setup);
+			}
+		}
+		setSpectrumAnalyzerTraceModeMaxHold(); // resets the trace, so it's done either way
+	} else {
+		interfaceOut("Manual settings on Spectrum Analyzer and Signal Generator will be used.", false);
+	}
+	double zeroSpanFrequency = acquisitionIsZeroSpan(sweepAcquisition.mode) ? getSignalGenFreq() : 0;
+	if (acquisitionIsZeroSpan(sweepAcquisition.mode) && !configureZeroSpan(zeroSpanFrequency)) {
+		errorOut("Could not put the spectrum analyzer in zero span.");
+	}
+	// the other receivers (a plan's [receivers]) get the fieldfox's analyzer settings, all at once;
+	// -a and -u are worked out on the fieldfox only
+	forEachReceiver(1, [&](int receiver) {
+		if (!getProgFlag(M_FLAG_INDEX)) {
+			applySpectrumAnalyzerSetup(setup);
+			setSpectrumAnalyzerTraceModeMaxHold();
+		}
+		if (acquisitionIsZeroSpan(sweepAcquisition.mode) && !configureZeroSpan(zeroSpanFrequency)) {
+			errorOut("Could not put receiver " + spectrumAnalyzers[receiver].name + " in zero span.");
+		}
+	});
+	lastPrepared.valid = true;
+	lastPrepared.frequency = targetFrequency;
+	lastPrepared.power = targetPower;
+	lastPrepared.acquisition = sweepAcquisition;
+	lastPrepared.analyzer = activePlan.analyzer;
+	lastPrepared.setup = setup;
+	lastPrepared.zeroSpanFrequency = zeroSpanFrequency;
+}
+
+// the instruments are already set up the way prepareInstruments() would set them up for this
+bool instrumentsPreparedFor(long long frequency, double power) {
+	const acquisitionSettings& acquisition = lastPrepared.acquisition;
+	const planAnalyzer& analyzer = lastPrepared.analyzer;
+	return lastPrepared.valid && lastPrepared.frequency == frequency && lastPrepared.power == power
+		&& acquisition.mode == sweepAcquisition.mode && acquisition.settlingTime == sweepAcquisition.settlingTime
+		&& acquisition.keepRfOn == sweepAcquisition.keepRfOn && acquisition.sweepsPerPosition == sweepAcquisition.sweepsPerPosition
+		&& analyzer.span == activePlan.analyzer.span && analyzer.bwRes == activePlan.analyzer.bwRes && analyzer.bwVideo == activePlan.analyzer.bwVideo
+		&& analyzer.points == activePlan.analyzer.points && analyzer.detector == activePlan.analyzer.detector;
+}
+
+// a generator or analyzer that was reconnected mid sweep (see supervision.h) gets the setup it had, and nothing else does;
+// the -a pilot and -u profile aren't run again. only if nothing was prepared for this frequency and power yet is it done in full.
+// one reconnected while nothing was running (a negative frequency) is left as it came back, for the next job to set up in full
+void restoreInstrument(int device, long long frequency, int power) {
+	if (frequency < 0) {
+		lastPrepared.valid = false;
+		sweepMeasurementTimeKnown = false;
+		return;
+	}
+	if (!lastPrepared.valid || lastPrepared.frequency != frequency || lastPrepared.power != power) {
+		prepareInstruments(frequency, power);
+		return;
+	}
+	if (device == DEVICE_STATUS_INDEX_SIGNAL_GENERATOR) {
+		if (!getProgFlag(M_FLAG_INDEX)) {
+			applySignalGenSetup(lastPrepared.setup);
+		}
+		return;
+	}
+	int previous = selectSpectrumAnalyzer(device - DEVICE_STATUS_INDEX_FIELDFOX);
+	if (!getProgFlag(M_FLAG_INDEX)) {
+		applySpectrumAnalyzerSetup(lastPrepared.setup);
+		setSpectrumAnalyzerTraceModeMaxHold();
+	}
+	if (acquisitionIsZeroSpan(sweepAcquisition.mode) && !configureZeroSpan(lastPrepared.zeroSpanFrequency)) {
+		errorOut("Could not put the " + supervisedDeviceName(device) + " back in zero span.");
+	}
+	selectSpectrumAnalyzer(previous);
+}
+
+// between a plan's frequency and power passes (see sweepRetune in chamber.h): the setup prepareInstruments() chose
+// moves to the new frequency and power - generator, analyzer window and marker only. no preset, pilot or profile
+void retuneInstruments(long long frequency, int power) {
+	if (!lastPrepared.valid) {
+		prepareInstruments(frequency, power);
+		return;
+	}
+	instrumentSetup setup = retunedSetup(lastPrepared.setup, (double)frequency, power);
+	bool zeroSpan = acquisitionIsZeroSpan(sweepAcquisition.mode);
+	double zeroSpanFrequency = lastPrepared.zeroSpanFrequency;
+	if (!getProgFlag(M_FLAG_INDEX)) {
+		applySignalGenSetup(setup);
+		zeroSpanFrequency = (double)frequency;
+	}
+	forEachReceiver(0, [&](int /*receiver*/) {
+		if (!getProgFlag(M_FLAG_INDEX) && !zeroSpan) {
+			applySpectrumAnalyzerRetune(setup);
+		}
+		if (zeroSpan && !configureZeroSpan(zeroSpanFrequency)) {
+			errorOut("Could not put " + spectrumAnalyzerName() + " in zero span.");
+		}
+	});
+	lastPrepared.frequency = frequency;
+	lastPrepared.power = power;
+	lastPrepared.setup = setup;
+	lastPrepared.zeroSpanFrequency = zeroSpanFrequency;
+}
+
+// -d: positions the turntable would refuse (it reports its soft limits in a dry run too)
+int countRejectedPositions(const testPosition* positions, int totalPositions) {
+	int rejected = 0;
+	for (int i = 0; i < totalPositions; i++) {
+		if (!isTurntablePosValid(positions[i].azimuth, positions[i].elevation)) {
+			rejected++;
+		}
+	}
+	return rejected;
+}
+
+// positions for a job's sweep, like -s and -g; false if there's nothing to measure
+bool createJobPositions(batchJob* job, testPosition** positions) {
+	const samplingRange& range = (*job).range;
+	if ((*job).scheme == SAMPLING_GRID) {
+		(*job).positions = createPositionTargets(positions, (*job).frequency, (int)(*job).power, range.elevationMin, range.elevationMax,
+								range.azimuthMin, range.azimuthMax, range.aziDensity, range.elevDensity);
+	} else {
+		int gridPositions = 0;
+		(*job).positions = createSampledPositionTargets(positions, (*job).scheme, range, (*job).frequency, (int)(*job).power, &gridPositions);
+	}
+	return (*job).positions > 0;
+}
+
+// -j: every job, on the sessions initiateDevices() opened. a job that fails is reported and the queue carries on;
+// ctrl+c stops the queue (and savestates the job it stopped). returns true if every job finished
+bool runJobQueue(std::vector<batchJob>* jobs) {
+	std::vector<testPosition*> plans((*jobs).size(), nullptr);
+	int jobsDone = 0;
+
+	// every plan first, so the ETA covers the whole queue
+	for (size_t i = 0; i < (*jobs).size(); i++) {
+		batchJob& job = (*jobs)[i];
+		if (job.hasSweep && !createJobPositions(&job, &plans[i])) {
+			job.status = JOB_FAILED;
+			job.failure = "no positions inside the turntable limits";
+		}
+		int positions = job.hasSweep ? std::max(job.positions, job.adaptive.enabled ? job.adaptive.budget : 0) : JOB_BORESIGHT_PROBE_ESTIMATE;
+		job.estimateMs = positions * sweepPositionEstimateMs();
+	}
+	interfaceOut("Job queue: " + std::to_string((*jobs).size()) + " jobs, about " + jobMinutesText(jobQueueRemainingMs(*jobs)), false);
+
+	for (size_t i = 0; i < (*jobs).size(); i++) {
+		batchJob& job = (*jobs)[i];
+		if (job.status != JOB_PENDING) {
+			printJobSummary(job);
+			continue;
+		}
+		if (shouldSaveAndClose()) {
+			job.status = JOB_STOPPED;
+			continue;
+		}
+		interfaceOut("Job " + std::to_string(i + 1) + "/" + std::to_string((*jobs).size()) + ": " + job.name
+			+ " (queue has about " + jobMinutesText(jobQueueRemainingMs(*jobs)) + " left)", false);
+		long long startNs = clockMonotonicNs();
+
+		// this job's settings replace the last one's
+		sweepAcquisition = job.acquisition;
+		sweepAcquisitionStats = acquisitionStats();
+		sweepReferences = job.references;
+		sweepReferenceState.haveCapture = false;
+		cleanupResults(); // the last job's compressed file, if any
+		setProgFlag(O_FLAG_INDEX, !job.output.empty(), job.output);
+		setProgFlag(C_FLAG_INDEX, job.compress, "");
+		// the daemon (-w) runs job after job on the same instruments; one that wants what they're set to starts straight away,
+		// with the last sweep's measurement time
+		if (instrumentsPreparedFor(job.frequency, job.power)) {
+			interfaceOut("Instruments are already set up for this job.", false);
+		} else {
+			prepareInstruments(job.frequency, job.power);
+		}
+
+		if (job.hasSweep) {
+			sweepAdaptive = job.adaptive;
+			if (sweepAdaptive.enabled) {
+				adaptiveSetCoarseSteps(&sweepAdaptive, plans[i], job.positions);
+			}
+			job.positionsDone = 0;
+			if (sweepModeStart(&plans[i], &job.positions, &job.positionsDone)) {
+				job.status = JOB_DONE;
+			} else if (shouldSaveAndClose()) {
+				job.status = JOB_STOPPED;
+				saveSweepState(plans[i], job.positions, job.positionsDone);
+			} else {
+				job.status = JOB_FAILED;
+				job.failure = "sweep did not finish";
+			}
+		} else if (boresightModeStart(job.boresight)) {
+			job.status = shouldSaveAndClose() ? JOB_STOPPED : JOB_DONE;
+		} else {
+			job.status = shouldSaveAndClose() ? JOB_STOPPED : JOB_FAILED;
+			job.failure = "no peak found";
+		}
+		job.elapsedMs = clockElapsedMs(startNs, clockMonotonicNs());
+		jobsDone += (job.status == JOB_DONE) ? 1 : 0;
+		printJobSummary(job);
+	}
+	cleanupResults();
+
+	interfaceOut("Job queue finished: " + std::to_string(jobsDone) + " of " + std::to_string((*jobs).size()) + " jobs done.", false);
+	for (size_t i = 0; i < (*jobs).size(); i++) {
+		printJobSummary((*jobs)[i]);
+		cleanupPositionTargets(plans[i]);
+	}
+	return jobsDone == (int)(*jobs).size();
 }
 
 // -v: forces preview of all positions, and setup/progress messages
@@ -81,6 +356,10 @@ int main(int argc, char* argv[]) {
 	double aziDensity  = DEFAULT_AZIMUTH_DENSITY;
 	double elevDensity = DEFAULT_ELEVATION_DENSITY;
 
+	adaptivePlan adaptiveArgument; // -x, only used for new sweeps; a resume carries on with the savestate's
+	samplingScheme_t samplingArgument = SAMPLING_GRID; // -g
+	samplingRange sweepRange = {};
+
 	std::string flagValProcessingBuffer = "";
 
 	programMode = SETUP_MODE; // should be the default mode
@@ -97,6 +376,12 @@ int main(int argc, char* argv[]) {
 		printProgramArguments();
 	}
 
+	// benchmarks run against a recorded sweep, and don't need any instruments
+	if (getProgFlag(B_FLAG_INDEX, &flagValProcessingBuffer)) {
+		runBenchmarks(flagValProcessingBuffer);
+		exit(0);
+	}
+
 	// verify savestate file
 	didReadSaveState = loadSweepState(&experimentPositions, &experimentNextPosition, &experimentTotalPositions);
 	if (didReadSaveState 
@@ -112,6 +397,16 @@ int main(int argc, char* argv[]) {
 		exit(-1);
 	}
 
+	// dry run; from here on everything talks to the models in simulation.h instead of the instruments
+	if (getProgFlag(D_FLAG_INDEX)) {
+		simulationStart();
+		promptPolicy[PROMPT_PROCEED] = 'y';
+		promptPolicy[PROMPT_SAVESTATE] = 'n';
+		interfaceOut("Dry run: simulated instruments and turntable; no results, references, profile or savestate are written.", false);
+	}
+	// a generator or analyzer reconnected part way through a sweep gets its settings again (see supervision.h)
+	supervisionRestore = restoreInstrument;
+
 	////// check flags and set mode arguments
 	// check freq flag - make sure is non the default NAN below, before generating sweep
 	if (getProgFlag(F_FLAG_INDEX, &flagValProcessingBuffer)) {
@@ -129,6 +424,73 @@ int main(int argc, char* argv[]) {
 			exit(-1);
 		}
 	}
+	// check state cache verification interval
+	if (getProgFlag(Q_FLAG_INDEX, &flagValProcessingBuffer)) {
+		long long verifyInterval = atoll(flagValProcessingBuffer.c_str());
+		if (verifyInterval < 0) {
+			errorOut("Verification interval must not be negative.");
+			exit(-1);
+		}
+		setShadowVerifyInterval(&signalGenShadow, verifyInterval);
+		for (int i = 0; i < SPECTRUM_ANALYZERS_MAX; i++) {
+			setShadowVerifyInterval(&spectrumAnalyzers[i].shadow, verifyInterval);
+		}
+	}
+	// check optimiser targets
+	if (getProgFlag(A_FLAG_INDEX, &flagValProcessingBuffer)) {
+		if (!parseOptimizerArgument(flagValProcessingBuffer, &sweepOptimizerTarget)) {
+			errorOut("Optimiser takes minLevel,maxLevel,snr - levels in dBm (min below max), and a positive snr in dB.");
+			exit(-1);
+		}
+	}
+	// check reference schedule
+	if (getProgFlag(N_FLAG_INDEX, &flagValProcessingBuffer)) {
+		if (!parseReferenceArgument(flagValProcessingBuffer, &sweepReferences)) {
+			errorOut("References take kind,cadence[,azimuth,elevation] - ie noise,row or both,10m,0,0.");
+			exit(-1);
+		}
+	}
+	// check acquisition mode
+	if (getProgFlag(T_FLAG_INDEX, &flagValProcessingBuffer)) {
+		if (!parseAcquisitionArgument(flagValProcessingBuffer, &sweepAcquisition)) {
+			errorOut("Acquisition mode must be triggered, free, zeromean or zeropeak, optionally followed by ,<settling ms>.");
+			exit(-1);
+		}
+	}
+	sweepAcquisition.keepRfOn = getProgFlag(K_FLAG_INDEX);
+	// check adaptive refinement
+	if (getProgFlag(X_FLAG_INDEX, &flagValProcessingBuffer)) {
+		if (!parseAdaptiveArgument(flagValProcessingBuffer, &adaptiveArgument)) {
+			errorOut("Adaptive refinement takes budget[,minStep,threshold] - a positive position count, and positive degrees and dB.");
+			exit(-1);
+		}
+	}
+	// check boresight search window
+	if (getProgFlag(E_FLAG_INDEX, &flagValProcessingBuffer)) {
+		if (!parseBoresightArgument(flagValProcessingBuffer, &boresightTarget)) {
+			errorOut("Boresight search takes azimuthMin,azimuthMax,elevationMin,elevationMax[,tolerance], in degrees with min below max.");
+			exit(-1);
+		}
+		if (getProgFlag(S_FLAG_INDEX) || getProgFlag(R_FLAG_INDEX)) {
+			errorOut("Boresight search (-e) can't be combined with a sweep (-s or -r).");
+			exit(-1);
+		}
+		if (!getProgFlag(M_FLAG_INDEX) && (targetSweepFrequency < 0 || 1000000000000 < targetSweepFrequency)) {
+			errorOut("Boresight search requires a target frequency (-f), unless the manual settings are used (-m).");
+			exit(-1);
+		}
+	}
+	// check sampling plan
+	if (getProgFlag(G_FLAG_INDEX, &flagValProcessingBuffer)) {
+		if (!parseSamplingScheme(flagValProcessingBuffer, &samplingArgument)) {
+			errorOut("Sampling plan must be grid, rings, equalarea or fibonacci.");
+			exit(-1);
+		}
+		if (samplingArgument != SAMPLING_GRID && adaptiveArgument.enabled) {
+			errorOut("Adaptive refinement (-x) needs the grid sampling plan.");
+			exit(-1);
+		}
+	}
 	// verify filenamev - do further checks in the future
 	if (getProgFlag(O_FLAG_INDEX,&flagValProcessingBuffer)) {
 		if(flagValProcessingBuffer.empty()){
@@ -137,10 +499,76 @@ int main(int argc, char* argv[]) {
 		}
 		if (getProgFlag(V_FLAG_INDEX)) { interfaceOut("File output set to "+flagValProcessingBuffer, false); }
 	}
+	// plan file (-l) in place of -s's arguments and -f/-p; checked before anything is connected
+	if (getProgFlag(L_FLAG_INDEX, &flagValProcessingBuffer)) {
+		if (getProgFlag(S_FLAG_INDEX) || getProgFlag(E_FLAG_INDEX) || getProgFlag(J_FLAG_INDEX)) {
+			errorOut("A plan file (-l) can't be combined with -s, -e or -j.");
+			exit(-1);
+		}
+		if (!parsePlanFile(flagValProcessingBuffer, &activePlan)) {
+			exit(-1);
+		}
+		if (saveStateFileIsValid && !getProgFlag(R_FLAG_INDEX)
+			&& 'n' == ynPrompt("Proceed with the plan file, rather than savestate? Current savestate may be overwritten.", PROMPT_COMMAND_LINE)) {
+			exit(-1);
+		}
+		applyPlanEndpoints(activePlan);
+		targetSweepFrequency = (long long)std::llround(activePlan.frequency.values[0]);
+		targetSweepPower = activePlan.power.values[0];
+		sweepAcquisition = activePlan.acquisition;
+		sweepReferences = activePlan.references;
+		if (!activePlan.output.empty()) {
+			setProgFlag(O_FLAG_INDEX, true, activePlan.output);
+		}
+		if (activePlan.compress) {
+			setProgFlag(C_FLAG_INDEX, true, "");
+		}
+		sweepRetune = retuneInstruments;
+	}
+	// batch jobs (-j, or -w's over its socket) take the place of -s, -r and -e; the flags above are every job's defaults
+	batchJob commandLine;
+	commandLine.frequency = targetSweepFrequency;
+	commandLine.power = targetSweepPower;
+	commandLine.scheme = samplingArgument;
+	commandLine.acquisition = sweepAcquisition;
+	commandLine.references = sweepReferences;
+	commandLine.adaptive = adaptiveArgument;
+	commandLine.compress = getProgFlag(C_FLAG_INDEX);
+	getProgFlag(O_FLAG_INDEX, &commandLine.output);
+	if (getProgFlag(W_FLAG_INDEX, &flagValProcessingBuffer)) {
+		if (initiateDevices() == false) {
+			errorOut("Failed to connect to some devices; carrying on, they are retried between jobs.");
+		}
+		bool listened = runDaemon(flagValProcessingBuffer, commandLine);
+		cleanupVisa();
+		cleanupTelnet();
+		exit(listened ? 0 : -1);
+	}
+	if (getProgFlag(J_FLAG_INDEX, &flagValProcessingBuffer)) {
+		std::vector<batchJob> jobs;
+		if (!parseJobFile(flagValProcessingBuffer, commandLine, &jobs)) {
+			exit(-1);
+		}
+		if (initiateDevices() == false) {
+			errorOut("Failed to connect to some devices; no jobs were run.");
+			exit(-1);
+		}
+		bool allDone = runJobQueue(&jobs);
+		if (simulationActive) {
+			int positionsDone = 0;
+			for (const batchJob& job : jobs) {
+				positionsDone += job.positionsDone;
+			}
+			printSimulationReport(positionsDone, -1);
+		}
+		cleanupVisa();
+		cleanupTelnet();
+		exit(allDone ? 0 : -1);
+	}
 	// check for sweep mode flags and parameters
 	if (getProgFlag(S_FLAG_INDEX) && nextIndexOfRemainingArguments != -1) {
 		int extraArgs = 0;
-		if (saveStateFileIsValid && 'n' == ynPrompt("Proceed with command line values, rather than savestate? Current savestate may be overwritten.")) {
+		if (saveStateFileIsValid && 'n' == ynPrompt("Proceed with command line values, rather than savestate? Current savestate may be overwritten.", PROMPT_COMMAND_LINE)) {
 			exit(-1);
 		}
 		// arg list in help: azimuthMin, azimuthMax, elevationMin, elevationMax, (optional)aziDensity, (optional)elevDensity"
@@ -180,6 +608,17 @@ int main(int argc, char* argv[]) {
 								elevationRangeMin, elevationRangeMax, azimuthRangeMin, azimuthRangeMax,
 								aziDensity,elevDensity);
 			experimentNextPosition = 0;
+			sweepRange = { (float)azimuthRangeMin, (float)azimuthRangeMax, (float)elevationRangeMin, (float)elevationRangeMax,
+							(float)aziDensity, (float)elevDensity };
+			// the grid becomes the first pass of the refinement (replaces any plan from the savestate)
+			sweepAdaptive = adaptiveArgument;
+			if (sweepAdaptive.enabled) {
+				adaptiveSetCoarseSteps(&sweepAdaptive, experimentPositions, experimentTotalPositions);
+				if (sweepAdaptive.budget <= experimentTotalPositions) {
+					errorOut("Adaptive budget of " + std::to_string(sweepAdaptive.budget) + " leaves nothing for refinement; the grid alone has "
+						+ std::to_string(experimentTotalPositions) + " positions.");
+				}
+			}
 		}
 	}
 
@@ -195,7 +634,7 @@ int main(int argc, char* argv[]) {
 
 	if (initiateDevices() == false) {
 		interfaceOut("Failed to connect to some devices.",false);
-		if ('y' == ynPrompt("Would you like to savestate your current settings, for inspection?")) {
+		if ('y' == ynPrompt("Would you like to savestate your current settings, for inspection?", PROMPT_SAVESTATE)) {
 			saveSweepState(experimentPositions, experimentTotalPositions, experimentNextPosition);
 			interfaceOut("Savestate created.",false);
 		} else {
@@ -204,44 +643,45 @@ int main(int argc, char* argv[]) {
 		exit(-1);
 	}
 
-	// what mode should be run?
-	if ((getProgFlag(R_FLAG_INDEX) || getProgFlag(S_FLAG_INDEX)) && !getProgFlag(I_FLAG_INDEX)) {
-		programMode = SWEEP_MODE;
-		if (!getProgFlag(M_FLAG_INDEX)) { // don't change settings if "manual" flag is specified
-			// set signal generator
-			setSignalGenFreq(targetSweepFrequency,0);
-			setSignalGenPower(targetSweepPower);
-			setSignalGenModOff();
-			setSignalGenOff();
-
-			int frequencyRangeScale = DEFAULT_SPECTRUM_ANALYZER_RANGE_SCALE; // +/- a frequency offset, to create a window
-
-			long long targetFreqStart = targetSweepFrequency - frequencyRangeScale;
-			long long targetFreqStop  = targetSweepFrequency + frequencyRangeScale;
-			if (targetFreqStart < 0) { // fix potential negative frequencies
-				targetFreqStop  += std::abs(targetFreqStart);
-				targetFreqStart += std::abs(targetFreqStart);
-			}
+	// other sampling plans replace the grid, now that the soft limits are known
+	if (getProgFlag(S_FLAG_INDEX) && samplingArgument != SAMPLING_GRID) {
+		int gridPositions = 0;
+		int sampledPositions = createSampledPositionTargets(&experimentPositions, samplingArgument, sweepRange,
+								targetSweepFrequency, (int)targetSweepPower, &gridPositions);
+		if (sampledPositions == 0) {
+			exit(-1);
+		}
+		experimentTotalPositions = sampledPositions;
+		experimentNextPosition = 0;
+		printSamplingSummary(samplingArgument, experimentTotalPositions, gridPositions, sweepPositionEstimateMs());
+	}
 
-			int targetSpectrumAnalyzerBWres  = DEFAULT_SPECTRUM_ANALYZER_BW_RES;
-			int targetSpectrumAnalyzerVidBW  = DEFAULT_SPECTRUM_ANALYZER_VIDEO_BW_RES;
-			int targetSpectrumAnalyzerPoints = DEFAULT_SPECTRUM_ANALYZER_POINTS;
-			
-			presetSpectrumAnalyzer();
-			setSpectrumAnalyzerMode("SA");
-			setSpectrumAnalyzerRangeStart(targetFreqStart,0);
-			setSpectrumAnalyzerRangeStop(targetFreqStop, 0);
-			setSpectrumAnalyzerBandWResolution(targetSpectrumAnalyzerBWres,0);
-			setSpectrumAnalyzerBandWVideo(targetSpectrumAnalyzerVidBW, 0);
-			setSpectrumAnalyzerSweepPoints(targetSpectrumAnalyzerPoints);
-			setSpectrumAnalyzerMarkerNormal(1, targetSweepFrequency, 0);
-			setSpectrumAnalyzerTraceModeMaxHold();
-		} else {
-			interfaceOut("Manual settings on Spectrum Analyzer and Signal Generator will be used.", false);
+	// a plan's positions (unless resuming one); after the instruments are up, for the soft limits
+	if (activePlan.loaded && !getProgFlag(R_FLAG_INDEX)) {
+		int compiledPositions = compilePlanPositions(activePlan, &experimentPositions);
+		if (compiledPositions == 0) {
+			errorOut("The plan has no positions inside the turntable limits.");
+			exit(-1);
 		}
+		experimentTotalPositions = compiledPositions;
+		experimentNextPosition = 0;
+		sweepAdaptive = activePlan.adaptive;
+		if (sweepAdaptive.enabled) {
+			adaptiveSetCoarseSteps(&sweepAdaptive, experimentPositions, experimentTotalPositions);
+		}
+	}
+
+	// what mode should be run?
+	if ((getProgFlag(R_FLAG_INDEX) || getProgFlag(S_FLAG_INDEX) || activePlan.loaded) && !getProgFlag(I_FLAG_INDEX)) {
+		programMode = SWEEP_MODE;
+		prepareInstruments(targetSweepFrequency, targetSweepPower);
 
 		// run sweeps; should be set to one or the other. Sweep values will override resume values if need be
-		sweepModeStart(experimentPositions, &experimentTotalPositions, &experimentNextPosition);
+		sweepModeStart(&experimentPositions, &experimentTotalPositions, &experimentNextPosition);
+	} else if (boresightTarget.enabled && !getProgFlag(I_FLAG_INDEX)) {
+		programMode = BORESIGHT_MODE;
+		prepareInstruments(targetSweepFrequency, targetSweepPower);
+		boresightModeStart(boresightTarget);
 	} else { // start interactive mode as a default (I flag should bring us here too)
 		programMode = INTERACTIVE_MODE;
 		// setup function
@@ -250,7 +690,8 @@ int main(int argc, char* argv[]) {
 	}
 
 	// save state if we were in sweep mode, and the sweep was not finished
-	if (programMode == SWEEP_MODE && (experimentNextPosition < experimentTotalPositions)) {
+	// (a ctrl+c between refinement passes still has passes to go)
+	if (programMode == SWEEP_MODE && (experimentNextPosition < experimentTotalPositions || (sweepAdaptive.enabled && shouldSaveAndClose()))) {
 		programMode = CLEANUP_MODE;
 		saveSweepState(experimentPositions, experimentTotalPositions, experimentNextPosition);
 		interfaceOut("Save state file created. Progress was ["
@@ -263,8 +704,15 @@ int main(int argc, char* argv[]) {
 		programMode = CLEANUP_MODE;
 	}
 
+	if (simulationActive) {
+		bool haveSweep = experimentPositions != nullptr && experimentTotalPositions > 0 && !boresightTarget.enabled;
+		printSimulationReport(haveSweep ? experimentNextPosition : sweepAcquisitionStats.positions,
+			haveSweep ? countRejectedPositions(experimentPositions, experimentTotalPositions) : -1);
+	}
+
 	// cleanup
 	cleanupPositionTargets(experimentPositions);
+	cleanupResults();
 	cleanupVisa();
 	cleanupTelnet();
 
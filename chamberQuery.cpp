@@ -0,0 +1,389 @@
+// chamberQuery - cut extraction from chamberOps result files
+// builds (or reuses) a sorted index over a result csv, keyed by (frequency, elevation, azimuth),
+// then answers point, cut and slice queries by binary search over the memory mapped index and data.
+// doesn't need visa or the instruments, so it builds on analysis machines too
+//
+// examples
+//   chamberQuery -f 2.4e9 -e 0 results.csv          every azimuth at elevation 0 (principal plane cut)
+//   chamberQuery -f 2.4e9 -a 90 results.csv         every elevation at azimuth 90
+//   chamberQuery -f 2.4e9 -m results.csv            whole frequency slice, as an elevation x azimuth matrix
+//   chamberQuery -f 2.4e9 -e 0 -a 15 results.csv    single point
+//   chamberQuery -d results.chz > results.csv       expand a compressed (-c) result file first
+
+#define PROGRAM_VERSION (1)
+#define ACCEPTABLE_ARGUMENTS ("a:de:f:himt:")
+
+#define INDEX_FILE_SUFFIX (".idx")
+#define INDEX_FILE_MAGIC ("CHI2")
+#define INDEX_FILE_MAGIC_LENGTH (4)
+#define INDEX_SOURCE_HASH_BLOCK (4096) // bytes hashed at each end of the result file
+
+// angles are matched in thousandths of a degree, frequency to the Hz
+#define INDEX_ANGLE_SCALE (1000.0)
+#define DEFAULT_ANGLE_TOLERANCE (0.01) // degrees
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+#ifdef _WIN32
+#define NOMINMAX // numeric_limits<>::min/max below
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+extern "C" {
+#include "getopt.h"
+}
+#include "results.h"
+#include "compression.h"
+
+struct indexHeader {
+	char magic[INDEX_FILE_MAGIC_LENGTH];
+	uint32_t entryCount;
+	uint64_t sourceSize; // index is rebuilt when the result file grows (ie, a resumed sweep appended to it)
+	uint64_t sourceWriteTime; // or is rewritten at the same size (ie, a new run of the same plan)
+	uint64_t sourceHash; // of the first and last blocks, in case the write time didn't move
+};
+
+struct indexEntry {
+	int64_t frequency; // Hz
+	int32_t elevation; // millidegrees
+	int32_t azimuth;   // millidegrees
+	uint64_t offset;   // of the row in the result file
+	uint32_t length;
+	float powerRx;     // so matrix output doesn't have to touch the data file at all
+};
+
+struct mappedFile {
+	const char* data;
+	size_t size;
+	uint64_t writeTime; // last write, in the platform's own units
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int file;
+#endif
+};
+
+bool mapFile(const std::string& fileName, mappedFile* mapped) {
+	(*mapped).data = nullptr;
+	(*mapped).size = 0;
+	(*mapped).writeTime = 0;
+#ifdef _WIN32
+	(*mapped).mapping = NULL;
+	(*mapped).file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if ((*mapped).file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx((*mapped).file, &fileSize);
+	(*mapped).size = (size_t)fileSize.QuadPart;
+	FILETIME lastWrite;
+	if (GetFileTime((*mapped).file, NULL, NULL, &lastWrite)) {
+		(*mapped).writeTime = ((uint64_t)lastWrite.dwHighDateTime << 32) | lastWrite.dwLowDateTime;
+	}
+	if ((*mapped).size == 0) {
+		return true;
+	}
+	(*mapped).mapping = CreateFileMappingA((*mapped).file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if ((*mapped).mapping == NULL) {
+		return false;
+	}
+	(*mapped).data = (const char*)MapViewOfFile((*mapped).mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	struct stat fileInfo;
+	(*mapped).file = open(fileName.c_str(), O_RDONLY);
+	if ((*mapped).file < 0 || fstat((*mapped).file, &fileInfo) != 0) {
+		return false;
+	}
+	(*mapped).size = (size_t)fileInfo.st_size;
+	(*mapped).writeTime = (uint64_t)fileInfo.st_mtim.tv_sec * 1000000000 + (uint64_t)fileInfo.st_mtim.tv_nsec;
+	if ((*mapped).size == 0) {
+		return true;
+	}
+	void* view = mmap(nullptr, (*mapped).size, PROT_READ, MAP_PRIVATE, (*mapped).file, 0);
+	(*mapped).data = (view == MAP_FAILED) ? nullptr : (const char*)view;
+#endif
+	return (*mapped).data != nullptr;
+}
+
+void unmapFile(mappedFile* mapped) {
+#ifdef _WIN32
+	if ((*mapped).data != nullptr) { UnmapViewOfFile((*mapped).data); }
+	if ((*mapped).mapping != NULL) { CloseHandle((*mapped).mapping); }
+	if ((*mapped).file != INVALID_HANDLE_VALUE) { CloseHandle((*mapped).file); }
+#else
+	if ((*mapped).data != nullptr) { munmap((void*)(*mapped).data, (*mapped).size); }
+	if ((*mapped).file >= 0) { close((*mapped).file); }
+#endif
+	(*mapped).data = nullptr;
+}
+
+int32_t angleKey(double degrees) {
+	return (int32_t)std::llround(degrees * INDEX_ANGLE_SCALE);
+}
+
+int64_t frequencyKey(double hz) {
+	return (int64_t)std::llround(hz);
+}
+
+// FNV-1a over the first and last blocks; doesn't read the whole file, so reusing an index stays cheap
+uint64_t sourceHash(const mappedFile& results) {
+	uint64_t hash = 14695981039346656037ULL;
+	size_t head = (results.size < INDEX_SOURCE_HASH_BLOCK) ? results.size : INDEX_SOURCE_HASH_BLOCK;
+	size_t tail = (results.size - head < INDEX_SOURCE_HASH_BLOCK) ? results.size - head : INDEX_SOURCE_HASH_BLOCK;
+	for (size_t i = 0; i < head; i++) {
+		hash = (hash ^ (uint8_t)results.data[i]) * 1099511628211ULL;
+	}
+	for (size_t i = results.size - tail; i < results.size; i++) {
+		hash = (hash ^ (uint8_t)results.data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+bool entryLess(const indexEntry& a, const indexEntry& b) {
+	if (a.frequency != b.frequency) { return a.frequency < b.frequency; }
+	if (a.elevation != b.elevation) { return a.elevation < b.elevation; }
+	if (a.azimuth != b.azimuth) { return a.azimuth < b.azimuth; }
+	return a.offset < b.offset; // repeated positions keep file order, so the latest measurement is last
+}
+
+bool buildIndex(const mappedFile& results, const std::string& indexFileName) {
+	std::vector<indexEntry> entries;
+	resultRow row;
+	const char* end = results.data + results.size;
+	for (const char* line = results.data; line < end;) {
+		const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+		if (lineEnd == nullptr) {
+			lineEnd = end;
+		}
+		if (parseResultRowCsv(line, lineEnd, &row)) {
+			indexEntry entry;
+			entry.frequency = frequencyKey(row.frequency);
+			entry.elevation = angleKey(row.elevation);
+			entry.azimuth   = angleKey(row.azimuth);
+			entry.offset    = (uint64_t)(line - results.data);
+			entry.length    = (uint32_t)(lineEnd - line);
+			entry.powerRx   = (float)row.powerRx;
+			entries.push_back(entry);
+		}
+		line = lineEnd + 1;
+	}
+	std::sort(entries.begin(), entries.end(), entryLess);
+
+	indexHeader header;
+	memcpy(header.magic, INDEX_FILE_MAGIC, INDEX_FILE_MAGIC_LENGTH);
+	header.entryCount = (uint32_t)entries.size();
+	header.sourceSize = results.size;
+	header.sourceWriteTime = results.writeTime;
+	header.sourceHash = sourceHash(results);
+	std::ofstream indexFile(indexFileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	if (!indexFile.is_open()) {
+		return false;
+	}
+	indexFile.write((const char*)&header, sizeof(header));
+	indexFile.write((const char*)entries.data(), sizeof(indexEntry) * entries.size());
+	return indexFile.good();
+}
+
+bool indexIsCurrent(const mappedFile& index, const mappedFile& results) {
+	if (index.data == nullptr || index.size < sizeof(indexHeader)) {
+		return false;
+	}
+	const indexHeader* header = (const indexHeader*)index.data;
+	return memcmp((*header).magic, INDEX_FILE_MAGIC, INDEX_FILE_MAGIC_LENGTH) == 0
+		&& (*header).sourceSize == results.size
+		&& (*header).sourceWriteTime == results.writeTime
+		&& (*header).sourceHash == sourceHash(results)
+		&& index.size == sizeof(indexHeader) + sizeof(indexEntry) * (size_t)(*header).entryCount;
+}
+
+// [first, last) of the entries whose key starts with frequency, and then elevation if given
+void equalRange(const indexEntry* entries, size_t count, int64_t frequency, bool matchElevation, int32_t elevationMin, int32_t elevationMax,
+				const indexEntry** first, const indexEntry** last) {
+	indexEntry low;
+	indexEntry high;
+	memset(&low, 0, sizeof(low));
+	low.frequency  = frequency;
+	low.elevation  = matchElevation ? elevationMin : std::numeric_limits<int32_t>::min();
+	low.azimuth    = std::numeric_limits<int32_t>::min();
+	high = low;
+	high.elevation = matchElevation ? elevationMax : std::numeric_limits<int32_t>::max();
+	high.azimuth   = std::numeric_limits<int32_t>::max();
+	high.offset    = std::numeric_limits<uint64_t>::max();
+	*first = std::lower_bound(entries, entries + count, low, entryLess);
+	*last  = std::upper_bound(*first, entries + count, high, entryLess);
+}
+
+void printHelp() {
+	std::cout << "chamberQuery version " << std::to_string(PROGRAM_VERSION) << std::endl
+			  << "usage: chamberQuery [options] resultFile" << std::endl
+			  << "  -f: frequency in Hz (optional if the file only has one)" << std::endl
+			  << "  -e: elevation; with -f alone, gives an azimuth cut" << std::endl
+			  << "  -a: azimuth; with -f alone, gives an elevation cut. with -e too, a single point" << std::endl
+			  << "  -m: print a dense matrix (elevation rows, azimuth columns, powerRx values) instead of csv rows" << std::endl
+			  << "  -t: angle tolerance in degrees (default 0.01)" << std::endl
+			  << "  -i: rebuild the index, even if it looks current" << std::endl
+			  << "  -d: print a compressed (-c) result file as csv, then exit" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	bool hasFrequency = false;
+	bool hasElevation = false;
+	bool hasAzimuth = false;
+	bool matrixOutput = false;
+	bool forceRebuild = false;
+	bool decompressOnly = false;
+	double frequency = 0;
+	double elevation = 0;
+	double azimuth = 0;
+	double tolerance = DEFAULT_ANGLE_TOLERANCE;
+
+	while (true) {
+		int currentArg = getopt(argc, argv, ACCEPTABLE_ARGUMENTS);
+		if (currentArg == -1) {
+			break;
+		}
+		switch (currentArg) {
+		case 'f': hasFrequency = true; frequency = atof(optarg); break;
+		case 'e': hasElevation = true; elevation = atof(optarg); break;
+		case 'a': hasAzimuth = true;   azimuth   = atof(optarg); break;
+		case 't': tolerance = std::fabs(atof(optarg)); break;
+		case 'm': matrixOutput = true; break;
+		case 'i': forceRebuild = true; break;
+		case 'd': decompressOnly = true; break;
+		case 'h':
+		default:
+			printHelp();
+			return (currentArg == 'h') ? 0 : -1;
+		}
+	}
+	if (optind >= argc) {
+		printHelp();
+		return -1;
+	}
+	std::string resultFileName = argv[optind];
+	std::string indexFileName = resultFileName + INDEX_FILE_SUFFIX;
+
+	if (decompressOnly) {
+		decompressedResults decoded;
+		if (!decompressResultFile(resultFileName, &decoded)) {
+			std::cerr << "Could not read " << resultFileName << " as a compressed result file." << std::endl;
+			return -1;
+		}
+		for (size_t i = 0; i < decoded.rows.size(); i++) {
+			std::cout << formatResultRowCsv(decoded.rows[i]) << '\n';
+		}
+		return 0;
+	}
+
+	mappedFile results;
+	mappedFile index;
+	if (!mapFile(resultFileName, &results)) {
+		std::cerr << "Could not open result file " << resultFileName << std::endl;
+		return -1;
+	}
+	if (compressSegmentVersion((const uint8_t*)results.data, results.size) != 0) {
+		std::cerr << "Compressed result file; expand it with -d first." << std::endl;
+		return -1;
+	}
+	bool haveIndex = false;
+	if (!forceRebuild) {
+		haveIndex = mapFile(indexFileName, &index) && indexIsCurrent(index, results);
+		if (!haveIndex) {
+			unmapFile(&index);
+		}
+	}
+	if (!haveIndex) {
+		if (!buildIndex(results, indexFileName) || !mapFile(indexFileName, &index) || !indexIsCurrent(index, results)) {
+			std::cerr << "Could not build index " << indexFileName << std::endl;
+			return -1;
+		}
+	}
+	const indexEntry* entries = (const indexEntry*)(index.data + sizeof(indexHeader));
+	size_t entryCount = (*(const indexHeader*)index.data).entryCount;
+	if (entryCount == 0) {
+		std::cerr << "No result rows in " << resultFileName << std::endl;
+		return -1;
+	}
+
+	// default to the only frequency in the file
+	int64_t frequencyHz = frequencyKey(frequency);
+	if (!hasFrequency) {
+		if (entries[0].frequency != entries[entryCount - 1].frequency) {
+			std::cerr << "File has more than one frequency; pick one with -f." << std::endl;
+			return -1;
+		}
+		frequencyHz = entries[0].frequency;
+	}
+
+	// narrow by frequency (and elevation), then filter azimuth inside that range
+	int32_t toleranceKey = angleKey(tolerance);
+	int32_t elevationKey = angleKey(elevation);
+	int32_t azimuthKey = angleKey(azimuth);
+	const indexEntry* first = nullptr;
+	const indexEntry* last = nullptr;
+	equalRange(entries, entryCount, frequencyHz, hasElevation, elevationKey - toleranceKey, elevationKey + toleranceKey, &first, &last);
+	std::vector<const indexEntry*> matches;
+	for (const indexEntry* e = first; e < last; e++) {
+		if (!hasAzimuth || std::abs((*e).azimuth - azimuthKey) <= toleranceKey) {
+			matches.push_back(e);
+		}
+	}
+	if (matches.empty()) {
+		std::cerr << "No rows match." << std::endl;
+		return 1;
+	}
+
+	if (!matrixOutput) {
+		for (size_t i = 0; i < matches.size(); i++) {
+			std::cout.write(results.data + (*matches[i]).offset, (*matches[i]).length);
+			std::cout << '\n';
+		}
+	} else {
+		// dense grid over every elevation/azimuth seen in the matches; holes are nan, repeats keep the latest value
+		std::vector<int32_t> elevations;
+		std::vector<int32_t> azimuths;
+		for (size_t i = 0; i < matches.size(); i++) {
+			elevations.push_back((*matches[i]).elevation);
+			azimuths.push_back((*matches[i]).azimuth);
+		}
+		std::sort(elevations.begin(), elevations.end());
+		elevations.erase(std::unique(elevations.begin(), elevations.end()), elevations.end());
+		std::sort(azimuths.begin(), azimuths.end());
+		azimuths.erase(std::unique(azimuths.begin(), azimuths.end()), azimuths.end());
+		std::vector<float> grid(elevations.size() * azimuths.size(), std::numeric_limits<float>::quiet_NaN());
+		for (size_t i = 0; i < matches.size(); i++) {
+			size_t row = std::lower_bound(elevations.begin(), elevations.end(), (*matches[i]).elevation) - elevations.begin();
+			size_t col = std::lower_bound(azimuths.begin(), azimuths.end(), (*matches[i]).azimuth) - azimuths.begin();
+			grid[row * azimuths.size() + col] = (*matches[i]).powerRx; // matches are in file order per position, so the latest wins
+		}
+		std::cout << "elevation\\azimuth";
+		for (size_t col = 0; col < azimuths.size(); col++) {
+			std::cout << "," << azimuths[col] / INDEX_ANGLE_SCALE;
+		}
+		std::cout << '\n';
+		for (size_t row = 0; row < elevations.size(); row++) {
+			std::cout << elevations[row] / INDEX_ANGLE_SCALE;
+			for (size_t col = 0; col < azimuths.size(); col++) {
+				std::cout << "," << grid[row * azimuths.size() + col];
+			}
+			std::cout << '\n';
+		}
+	}
+	unmapFile(&index);
+	unmapFile(&results);
+	return 0;
+}
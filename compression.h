@@ -0,0 +1,403 @@
+#pragma once
+// compressed result sink (-c)
+// rows: integer columns are delta encoded, and double columns are XOR'd against either the previous value
+//       or a linear prediction from the previous two (whichever leaves fewer bytes), so values that repeat
+//       row to row (frequency, power) or step evenly (azimuth) take a single byte
+// traces: each sample is XOR'd with the same point of the previous trace, the 32 bit words are split into
+//       byte planes, and each plane goes through a zero-run/literal coder. sign and exponent planes are
+//       almost all zeros after the XOR, which is where most of the saving comes from
+// everything is lossless; doubles and floats are stored bit for bit, not as formatted text
+//
+// file is a series of segments, each starting with COMPRESSED_FILE_MAGIC (appending, ie on resume, starts a
+// new segment and resets the predictors), followed by 'R' row records and 'T' trace records.
+// a trace record belongs to the row record before it
+// CHZ3 rows end with the sweep count and the reference id (varints). CHZ2 segments have only the sweep count,
+// and CHZ1 neither; they still decode, with the missing columns as 0
+
+#define COMPRESSED_FILE_MAGIC ("CHZ3")
+#define COMPRESSED_FILE_MAGIC_V2 ("CHZ2")
+#define COMPRESSED_FILE_MAGIC_V1 ("CHZ1")
+#define COMPRESSED_FILE_VERSION (3)
+#define COMPRESSED_FILE_MAGIC_LENGTH (4)
+#define COMPRESSED_RECORD_ROW   ('R')
+#define COMPRESSED_RECORD_TRACE ('T')
+
+#define COMPRESSED_TRACE_REFERENCE_PREVIOUS_SAMPLE (0) // first trace, or the number of points changed
+#define COMPRESSED_TRACE_REFERENCE_PREVIOUS_TRACE  (1)
+#define COMPRESSED_TRACE_POINTS_MAX (100001) // well past any analyzer; a repeated trace takes only a few bytes, so the record size can't bound it
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+
+#include "results.h"
+
+// predictor state - the encoder and decoder each keep one, and must update it identically
+struct compressionState {
+	resultRow previousRows[2]; // [0] is the most recent
+	int rowsSeen;
+	int segmentVersion; // which columns the rows have, while decoding an older segment
+	std::vector<uint32_t> previousTrace;
+	std::vector<uint8_t> planeScratch;
+};
+
+void compressResetState(compressionState* state) {
+	memset(&((*state).previousRows), 0, sizeof((*state).previousRows));
+	(*state).rowsSeen = 0;
+	(*state).segmentVersion = COMPRESSED_FILE_VERSION;
+	(*state).previousTrace.clear();
+}
+
+void compressPutVarint(std::vector<uint8_t>* out, uint64_t value) {
+	while (value >= 0x80) {
+		(*out).push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	(*out).push_back((uint8_t)value);
+}
+
+bool compressGetVarint(const uint8_t** c, const uint8_t* end, uint64_t* value) {
+	*value = 0;
+	for (int shift = 0; shift < 64 && *c < end; shift += 7) {
+		uint8_t byte = *((*c)++);
+		*value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false; // truncated
+}
+
+uint64_t compressZigzag(int64_t value) {
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+int64_t compressUnzigzag(uint64_t value) {
+	return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+uint64_t compressDoubleBits(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+double compressBitsDouble(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+int compressMeaningfulBytes(uint64_t x, int* leadingZeroBytes) {
+	if (x == 0) {
+		*leadingZeroBytes = 0;
+		return 0;
+	}
+	int lead = 0;
+	int trail = 0;
+	while (((x >> (56 - 8 * lead)) & 0xFF) == 0) { lead++; }
+	while (((x >> (8 * trail)) & 0xFF) == 0) { trail++; }
+	*leadingZeroBytes = lead;
+	return 8 - lead - trail;
+}
+
+// header byte | bit 7 = predictor (0 previous, 1 linear), bits 6-4 = leading zero bytes, bits 3-0 = bytes that follow
+void compressPutDouble(std::vector<uint8_t>* out, double value, double previous, double previous2, bool canPredict) {
+	uint64_t bits = compressDoubleBits(value);
+	uint64_t xorPrevious = bits ^ compressDoubleBits(previous);
+	int lead = 0;
+	int length = compressMeaningfulBytes(xorPrevious, &lead);
+	uint64_t x = xorPrevious;
+	int predictor = 0;
+	if (canPredict && length > 0) {
+		uint64_t xorPredicted = bits ^ compressDoubleBits(previous + (previous - previous2));
+		int predictedLead = 0;
+		int predictedLength = compressMeaningfulBytes(xorPredicted, &predictedLead);
+		if (predictedLength < length) {
+			x = xorPredicted;
+			lead = predictedLead;
+			length = predictedLength;
+			predictor = 1;
+		}
+	}
+	(*out).push_back((uint8_t)((predictor << 7) | (lead << 4) | length));
+	for (int i = 0; i < length; i++) {
+		(*out).push_back((uint8_t)(x >> (56 - 8 * (lead + i))));
+	}
+}
+
+bool compressGetDouble(const uint8_t** c, const uint8_t* end, double previous, double previous2, double* value) {
+	if (*c >= end) { return false; }
+	uint8_t header = *((*c)++);
+	int predictor = header >> 7;
+	int lead = (header >> 4) & 0x7;
+	int length = header & 0xF;
+	if (lead + length > 8 || end - *c < length) { return false; }
+	uint64_t x = 0;
+	for (int i = 0; i < length; i++) {
+		x |= (uint64_t)(*((*c)++)) << (56 - 8 * (lead + i));
+	}
+	double reference = (predictor == 1) ? (previous + (previous - previous2)) : previous;
+	*value = compressBitsDouble(compressDoubleBits(reference) ^ x);
+	return true;
+}
+
+void compressRememberRow(compressionState* state, const resultRow& row) {
+	(*state).previousRows[1] = (*state).previousRows[0];
+	(*state).previousRows[0] = row;
+	(*state).rowsSeen++;
+}
+
+void compressEncodeRow(compressionState* state, const resultRow& row, std::vector<uint8_t>* out) {
+	const resultRow& p1 = (*state).previousRows[0];
+	const resultRow& p2 = (*state).previousRows[1];
+	bool canPredict = (*state).rowsSeen >= 2;
+	(*out).push_back(COMPRESSED_RECORD_ROW);
+	// timestamps are delta-of-delta, the index is a delta from the expected next index
+	int64_t timestampDelta = row.timestampUs - p1.timestampUs;
+	if (canPredict) {
+		timestampDelta -= (p1.timestampUs - p2.timestampUs);
+	}
+	compressPutVarint(out, compressZigzag(timestampDelta));
+	compressPutVarint(out, compressZigzag((int64_t)row.index - p1.index - 1));
+	compressPutDouble(out, row.azimuth,   p1.azimuth,   p2.azimuth,   canPredict);
+	compressPutDouble(out, row.elevation, p1.elevation, p2.elevation, canPredict);
+	compressPutDouble(out, row.frequency, p1.frequency, p2.frequency, canPredict);
+	compressPutDouble(out, row.powerTx,   p1.powerTx,   p2.powerTx,   canPredict);
+	compressPutDouble(out, row.powerRx,   p1.powerRx,   p2.powerRx,   canPredict);
+	compressPutVarint(out, (uint64_t)(row.sweeps < 0 ? 0 : row.sweeps));
+	compressPutVarint(out, (uint64_t)(row.referenceId < 0 ? 0 : row.referenceId));
+	compressRememberRow(state, row);
+}
+
+// *c must point just past the record type byte
+bool compressDecodeRow(compressionState* state, const uint8_t** c, const uint8_t* end, resultRow* row) {
+	const resultRow& p1 = (*state).previousRows[0];
+	const resultRow& p2 = (*state).previousRows[1];
+	bool canPredict = (*state).rowsSeen >= 2;
+	uint64_t value = 0;
+	if (!compressGetVarint(c, end, &value)) { return false; }
+	(*row).timestampUs = p1.timestampUs + compressUnzigzag(value) + (canPredict ? (p1.timestampUs - p2.timestampUs) : 0);
+	if (!compressGetVarint(c, end, &value)) { return false; }
+	(*row).index = (int)(p1.index + 1 + compressUnzigzag(value));
+	if (!compressGetDouble(c, end, p1.azimuth,   p2.azimuth,   &((*row).azimuth)))   { return false; }
+	if (!compressGetDouble(c, end, p1.elevation, p2.elevation, &((*row).elevation))) { return false; }
+	if (!compressGetDouble(c, end, p1.frequency, p2.frequency, &((*row).frequency))) { return false; }
+	if (!compressGetDouble(c, end, p1.powerTx,   p2.powerTx,   &((*row).powerTx)))   { return false; }
+	if (!compressGetDouble(c, end, p1.powerRx,   p2.powerRx,   &((*row).powerRx)))   { return false; }
+	(*row).sweeps = 0;
+	(*row).referenceId = 0;
+	if ((*state).segmentVersion >= 2) {
+		if (!compressGetVarint(c, end, &value) || value > 0x7FFFFFFF) { return false; }
+		(*row).sweeps = (int)value;
+	}
+	if ((*state).segmentVersion >= 3) {
+		if (!compressGetVarint(c, end, &value) || value > 0x7FFFFFFF) { return false; }
+		(*row).referenceId = (int)value;
+	}
+	compressRememberRow(state, *row);
+	return true;
+}
+
+// zero-run/literal coder | repeated (varint zeroRun, varint literalLength, literal bytes) until the plane is covered
+void compressPutPlane(std::vector<uint8_t>* out, const uint8_t* plane, size_t length) {
+	size_t i = 0;
+	while (i < length) {
+		size_t zeroStart = i;
+		while (i < length && plane[i] == 0) { i++; }
+		size_t literalStart = i;
+		// a literal run ends at the next pair of zeros; a lone zero is cheaper to keep inline
+		while (i < length && !(plane[i] == 0 && (i + 1 == length || plane[i + 1] == 0))) { i++; }
+		compressPutVarint(out, literalStart - zeroStart);
+		compressPutVarint(out, i - literalStart);
+		(*out).insert((*out).end(), plane + literalStart, plane + i);
+	}
+}
+
+bool compressGetPlane(const uint8_t** c, const uint8_t* end, uint8_t* plane, size_t length) {
+	size_t i = 0;
+	uint64_t zeroRun = 0;
+	uint64_t literalLength = 0;
+	while (i < length) {
+		if (!compressGetVarint(c, end, &zeroRun) || !compressGetVarint(c, end, &literalLength)) { return false; }
+		if (zeroRun > length - i || literalLength > length - i - zeroRun || (uint64_t)(end - *c) < literalLength) { return false; }
+		memset(plane + i, 0, (size_t)zeroRun);
+		i += (size_t)zeroRun;
+		memcpy(plane + i, *c, (size_t)literalLength);
+		i += (size_t)literalLength;
+		*c += literalLength;
+	}
+	return true;
+}
+
+void compressEncodeTrace(compressionState* state, const std::vector<float>& trace, std::vector<uint8_t>* out) {
+	size_t n = trace.size();
+	std::vector<uint32_t>& previousTrace = (*state).previousTrace;
+	std::vector<uint8_t>& planes = (*state).planeScratch;
+	int reference = (previousTrace.size() == n) ? COMPRESSED_TRACE_REFERENCE_PREVIOUS_TRACE : COMPRESSED_TRACE_REFERENCE_PREVIOUS_SAMPLE;
+	if (reference == COMPRESSED_TRACE_REFERENCE_PREVIOUS_SAMPLE) {
+		previousTrace.assign(n, 0);
+	}
+	planes.resize(4 * n);
+	uint32_t previousSample = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t bits;
+		memcpy(&bits, &(trace[i]), sizeof(bits));
+		uint32_t x = bits ^ ((reference == COMPRESSED_TRACE_REFERENCE_PREVIOUS_TRACE) ? previousTrace[i] : previousSample);
+		planes[i]         = (uint8_t)(x >> 24); // sign/exponent first
+		planes[n + i]     = (uint8_t)(x >> 16);
+		planes[2 * n + i] = (uint8_t)(x >> 8);
+		planes[3 * n + i] = (uint8_t)x;
+		previousSample = bits;
+		previousTrace[i] = bits;
+	}
+	(*out).push_back(COMPRESSED_RECORD_TRACE);
+	compressPutVarint(out, n);
+	(*out).push_back((uint8_t)reference);
+	for (int p = 0; p < 4; p++) {
+		compressPutPlane(out, planes.data() + p * n, n);
+	}
+}
+
+// *c must point just past the record type byte
+bool compressDecodeTrace(compressionState* state, const uint8_t** c, const uint8_t* end, std::vector<float>* trace) {
+	uint64_t n = 0;
+	if (!compressGetVarint(c, end, &n) || *c >= end) { return false; }
+	if (n > COMPRESSED_TRACE_POINTS_MAX) { return false; } // corrupt length
+	int reference = *((*c)++);
+	std::vector<uint32_t>& previousTrace = (*state).previousTrace;
+	std::vector<uint8_t>& planes = (*state).planeScratch;
+	if (reference == COMPRESSED_TRACE_REFERENCE_PREVIOUS_TRACE && previousTrace.size() != n) { return false; }
+	planes.resize(4 * (size_t)n);
+	for (int p = 0; p < 4; p++) {
+		if (!compressGetPlane(c, end, planes.data() + p * n, (size_t)n)) { return false; }
+	}
+	if (reference == COMPRESSED_TRACE_REFERENCE_PREVIOUS_SAMPLE) {
+		previousTrace.assign((size_t)n, 0);
+	}
+	(*trace).resize((size_t)n);
+	uint32_t previousSample = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint32_t x = ((uint32_t)planes[i] << 24) | ((uint32_t)planes[n + i] << 16) | ((uint32_t)planes[2 * n + i] << 8) | planes[3 * n + i];
+		uint32_t bits = x ^ ((reference == COMPRESSED_TRACE_REFERENCE_PREVIOUS_TRACE) ? previousTrace[i] : previousSample);
+		memcpy(&((*trace)[i]), &bits, sizeof(bits));
+		previousSample = bits;
+		previousTrace[i] = bits;
+	}
+	return true;
+}
+
+// writer - keeps the file open for the whole run, unlike dataOut()
+struct compressedResultWriter {
+	std::ofstream file;
+	compressionState state;
+	std::vector<uint8_t> buffer;
+	long long rawBytes;        // what the same data takes uncompressed, in binary
+	long long compressedBytes;
+};
+
+bool compressWriterOpen(compressedResultWriter* writer, const std::string& fileName) {
+	(*writer).file.open(fileName, std::ios_base::app | std::ios_base::binary);
+	if (!(*writer).file.is_open()) {
+		return false;
+	}
+	compressResetState(&((*writer).state));
+	(*writer).rawBytes = 0;
+	(*writer).compressedBytes = COMPRESSED_FILE_MAGIC_LENGTH;
+	(*writer).file.write(COMPRESSED_FILE_MAGIC, COMPRESSED_FILE_MAGIC_LENGTH);
+	return (*writer).file.good();
+}
+
+bool compressWriterFlushBuffer(compressedResultWriter* writer) {
+	(*writer).file.write((const char*)(*writer).buffer.data(), (*writer).buffer.size());
+	(*writer).file.flush(); // rows are minutes apart; don't lose any to a crash
+	(*writer).compressedBytes += (*writer).buffer.size();
+	(*writer).buffer.clear();
+	return (*writer).file.good();
+}
+
+bool compressWriterPutRow(compressedResultWriter* writer, const resultRow& row) {
+	compressEncodeRow(&((*writer).state), row, &((*writer).buffer));
+	(*writer).rawBytes += sizeof(long long) + 3 * sizeof(int) + 5 * sizeof(double);
+	return compressWriterFlushBuffer(writer);
+}
+
+bool compressWriterPutTrace(compressedResultWriter* writer, const std::vector<float>& trace) {
+	if (trace.size() > COMPRESSED_TRACE_POINTS_MAX) {
+		return false; // the reader would take it for a corrupt length; the row is still stored, without its trace
+	}
+	compressEncodeTrace(&((*writer).state), trace, &((*writer).buffer));
+	(*writer).rawBytes += sizeof(float) * trace.size();
+	return compressWriterFlushBuffer(writer);
+}
+
+void compressWriterClose(compressedResultWriter* writer) {
+	if ((*writer).file.is_open()) {
+		(*writer).file.close();
+	}
+}
+
+// reader - rows[i] owns traces[i], which is empty if no trace was recorded for it
+struct decompressedResults {
+	std::vector<resultRow> rows;
+	std::vector<std::vector<float>> traces;
+};
+
+// the format version if a segment header starts at c, 0 if not
+int compressSegmentVersion(const uint8_t* c, size_t available) {
+	if (available < COMPRESSED_FILE_MAGIC_LENGTH) {
+		return 0;
+	}
+	if (memcmp(c, COMPRESSED_FILE_MAGIC, COMPRESSED_FILE_MAGIC_LENGTH) == 0) {
+		return COMPRESSED_FILE_VERSION;
+	}
+	if (memcmp(c, COMPRESSED_FILE_MAGIC_V2, COMPRESSED_FILE_MAGIC_LENGTH) == 0) {
+		return 2;
+	}
+	return (memcmp(c, COMPRESSED_FILE_MAGIC_V1, COMPRESSED_FILE_MAGIC_LENGTH) == 0) ? 1 : 0;
+}
+
+bool decompressResultBuffer(const uint8_t* data, size_t length, decompressedResults* results) {
+	compressionState state;
+	const uint8_t* c = data;
+	const uint8_t* end = data + length;
+	resultRow row;
+	(*results).rows.clear();
+	(*results).traces.clear();
+	compressResetState(&state);
+	if (compressSegmentVersion(data, length) == 0) {
+		return false; // not a compressed result file
+	}
+	while (c < end) {
+		int segmentVersion = compressSegmentVersion(c, (size_t)(end - c));
+		if (segmentVersion != 0) {
+			compressResetState(&state);
+			state.segmentVersion = segmentVersion;
+			c += COMPRESSED_FILE_MAGIC_LENGTH;
+			continue;
+		}
+		uint8_t recordType = *(c++);
+		if (recordType == COMPRESSED_RECORD_ROW) {
+			if (!compressDecodeRow(&state, &c, end, &row)) { return false; }
+			(*results).rows.push_back(row);
+			(*results).traces.emplace_back();
+		} else if (recordType == COMPRESSED_RECORD_TRACE && !(*results).rows.empty()) {
+			if (!compressDecodeTrace(&state, &c, end, &((*results).traces.back()))) { return false; }
+		} else {
+			return false; // unknown record, or a trace without a row
+		}
+	}
+	return true;
+}
+
+bool decompressResultFile(const std::string& fileName, decompressedResults* results) {
+	std::ifstream file(fileName, std::ios_base::in | std::ios_base::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	return decompressResultBuffer(data.data(), data.size(), results);
+}
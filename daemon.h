@@ -0,0 +1,394 @@
+#pragma once
+// service mode (-w socket): connects to the instruments once, then takes job files over a local (AF_UNIX) socket
+// and runs them on the same sessions, so a job starts without the connect and setup of a fresh run.
+// between jobs the sessions are kept warm (see supervision.h). one command per line:
+//
+//   status              ok idle | ok running <jobs>, <n> waiting | last: <progress line>
+//   devices             ok, and each instrument's connection
+//   run <job file>      queues a job file (as -j); "ok queued", then "ok started", events, and "done <n>/<m> jobs"
+//   jobs                queues the job file text that follows, up to a line with just "end"
+//   watch / unwatch     progress events ("event <text>" and "error <text>" lines) from now on; queueing watches too
+//   stop                ctrl+c for the jobs that are running; the daemon carries on
+//   shutdown            exits once the running jobs finish
+//   quit                closes this connection
+//
+// anything else gets "error ...". ctrl+c at the console stops the jobs and the daemon
+
+#define DAEMON_MAX_CLIENTS (8)
+#define DAEMON_POLL_INTERVAL (500) // ms; how often an idle daemon looks for ctrl+c
+#define DAEMON_KEEPALIVE_INTERVAL (30000) // ms between device checks while idle
+#define DAEMON_MAX_LINE_LENGTH (4096)
+#define DAEMON_MAX_JOB_TEXT (65536)
+#define DAEMON_UNIX_PATH_MAX (108)
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cstdio> // for remove()
+
+#include "helperFunctions.h"
+#include "jobs.h"
+#include "supervision.h"
+
+bool runJobQueue(std::vector<batchJob>* jobs); // from chamberOps.cpp
+
+// sockaddr_un, as in afunix.h; that header needs winsock2.h, which can't follow the winsock.h Windows.h brings in
+struct daemonSocketAddress {
+	unsigned short family;
+	char path[DAEMON_UNIX_PATH_MAX];
+};
+
+struct daemonClient {
+	SOCKET socket = INVALID_SOCKET;
+	int id = 0;
+	std::string input = ""; // received, but not a whole line yet
+	bool watching = false;
+	bool collecting = false; // between "jobs" and "end"
+	std::string jobText = "";
+	bool closed = false;
+};
+
+struct daemonRequest {
+	int clientId = 0;
+	std::string fileName = ""; // empty when the jobs came over the socket
+	std::string text = "";
+};
+
+// clients and the queue are shared by the listener thread, the main thread (running jobs) and the log writer (events)
+std::mutex daemonMutex;
+std::condition_variable daemonWake;
+std::vector<daemonClient> daemonClients;
+std::deque<daemonRequest> daemonQueue;
+int daemonNextClientId = 1;
+std::string daemonRunning = ""; // names of the jobs being run, for status
+std::string daemonLastEvent = "";
+std::atomic<bool> daemonStopRequested(false);
+std::atomic<bool> daemonShutdownRequested(false);
+
+// only with daemonMutex held; a client that isn't reading loses the line rather than holding anyone up
+void daemonSendLocked(daemonClient* client, const std::string& line) {
+	std::string text = line + "\n";
+	if (!(*client).closed && send((*client).socket, text.c_str(), (int)text.length(), 0) == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK) {
+		(*client).closed = true;
+	}
+}
+
+void daemonReply(int clientId, const std::string& line) {
+	std::lock_guard<std::mutex> lock(daemonMutex);
+	for (daemonClient& client : daemonClients) {
+		if (client.id == clientId) {
+			daemonSendLocked(&client, line);
+		}
+	}
+}
+
+// the log's sink: every console message goes to the watching clients
+void daemonEvent(logSeverity_t severity, const std::string& text) {
+	std::lock_guard<std::mutex> lock(daemonMutex);
+	if (severity == LOG_SEVERITY_INFO) {
+		daemonLastEvent = text;
+	}
+	for (daemonClient& client : daemonClients) {
+		if (client.watching) {
+			daemonSendLocked(&client, ((severity >= LOG_SEVERITY_WARNING) ? "error " : "event ") + text);
+		}
+	}
+}
+
+void daemonQueueRequest(daemonClient* client, const std::string& fileName, const std::string& text) {
+	daemonRequest request;
+	request.clientId = (*client).id;
+	request.fileName = fileName;
+	request.text = text;
+	daemonQueue.push_back(request);
+	(*client).watching = true;
+	daemonSendLocked(client, "ok queued, " + std::to_string(daemonQueue.size()) + " waiting");
+	daemonWake.notify_one();
+}
+
+// the idle device check stops waiting on a device that stays down once there's a job or a shutdown to get on with
+bool daemonHasWork() {
+	std::lock_guard<std::mutex> lock(daemonMutex);
+	return daemonShutdownRequested || !daemonQueue.empty();
+}
+
+std::string daemonDevicesText() {
+	std::string text = "ok";
+	for (int i = 0; i < supervisedDeviceCount(); i++) {
+		text += std::string(i == 0 ? " " : ", ") + supervisedDeviceName(i) + "=" + (deviceConnectionStatus[i] ? "connected" : "disconnected");
+	}
+	return text;
+}
+
+// one line from a client, with daemonMutex held
+void daemonHandleLine(daemonClient* client, std::string_view line) {
+	if ((*client).collecting) {
+		if (jobTrim(line) == "end") {
+			(*client).collecting = false;
+			daemonQueueRequest(client, "", (*client).jobText);
+			(*client).jobText = "";
+		} else if ((*client).jobText.length() + line.length() > DAEMON_MAX_JOB_TEXT) {
+			(*client).collecting = false;
+			(*client).jobText = "";
+			daemonSendLocked(client, "error job text longer than " + std::to_string(DAEMON_MAX_JOB_TEXT) + " bytes");
+		} else {
+			(*client).jobText.append(line).append("\n");
+		}
+		return;
+	}
+	line = jobTrim(line);
+	size_t space = line.find(' ');
+	std::string_view command = line.substr(0, space);
+	std::string_view argument = (space == std::string_view::npos) ? std::string_view() : jobTrim(line.substr(space + 1));
+	if (command.empty()) {
+		return;
+	} else if (command == "status") {
+		daemonSendLocked(client, (daemonRunning.empty() ? "ok idle" : "ok running " + daemonRunning) + ", "
+			+ std::to_string(daemonQueue.size()) + " waiting" + (daemonLastEvent.empty() ? "" : " | last: " + daemonLastEvent));
+	} else if (command == "devices") {
+		daemonSendLocked(client, daemonDevicesText());
+	} else if (command == "run" && !argument.empty()) {
+		daemonQueueRequest(client, std::string(argument), "");
+	} else if (command == "jobs") {
+		(*client).collecting = true;
+		(*client).jobText = "";
+		daemonSendLocked(client, "ok send the job file, then \"end\"");
+	} else if (command == "watch" || command == "unwatch") {
+		(*client).watching = (command == "watch");
+		daemonSendLocked(client, "ok");
+	} else if (command == "stop") {
+		if (daemonRunning.empty()) {
+			daemonSendLocked(client, "error nothing is running");
+		} else {
+			daemonStopRequested = true;
+			saveAndCloseFlag = true; // the same as ctrl+c, for the running jobs
+			daemonSendLocked(client, "ok stopping");
+		}
+	} else if (command == "shutdown") {
+		daemonShutdownRequested = true;
+		daemonSendLocked(client, "ok shutting down");
+		daemonWake.notify_one();
+	} else if (command == "quit") {
+		daemonSendLocked(client, "ok bye");
+		(*client).closed = true;
+	} else {
+		daemonSendLocked(client, "error unknown command \"" + std::string(command) + "\"");
+	}
+}
+
+// reads what came in on a client; false once it has gone away
+bool daemonReadClient(daemonClient* client) {
+	char buffer[1024];
+	int received = recv((*client).socket, buffer, sizeof(buffer), 0);
+	if (received == 0 || (received < 0 && WSAGetLastError() != WSAEWOULDBLOCK)) {
+		return false;
+	}
+	if (received < 0) {
+		return true;
+	}
+	(*client).input.append(buffer, received);
+	for (size_t newline = (*client).input.find('\n'); newline != std::string::npos; newline = (*client).input.find('\n')) {
+		std::string line = (*client).input.substr(0, newline);
+		(*client).input.erase(0, newline + 1);
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		daemonHandleLine(client, line);
+	}
+	if ((*client).input.length() > DAEMON_MAX_LINE_LENGTH) {
+		daemonSendLocked(client, "error line too long");
+		return false;
+	}
+	return !(*client).closed;
+}
+
+// the listener thread: accepts clients and answers them, so status works while a job is running
+void daemonListen(SOCKET listenSocket) {
+	unsigned long nonBlocking = 1;
+	while (!daemonShutdownRequested) {
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(listenSocket, &readable);
+		SOCKET highest = listenSocket;
+		{
+			std::lock_guard<std::mutex> lock(daemonMutex);
+			for (const daemonClient& client : daemonClients) {
+				FD_SET(client.socket, &readable);
+				highest = std::max(highest, client.socket);
+			}
+		}
+		timeval timeout;
+		timeout.tv_sec = 0;
+		timeout.tv_usec = DAEMON_POLL_INTERVAL * 1000;
+		if (select((int)highest + 1, &readable, nullptr, nullptr, &timeout) <= 0) {
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(daemonMutex);
+		if (FD_ISSET(listenSocket, &readable)) {
+			SOCKET accepted = accept(listenSocket, nullptr, nullptr);
+			if (accepted != INVALID_SOCKET) {
+				daemonClient client;
+				client.socket = accepted;
+				client.id = daemonNextClientId++;
+				ioctlsocket(accepted, FIONBIO, &nonBlocking);
+				daemonClients.push_back(client);
+				if (daemonClients.size() > DAEMON_MAX_CLIENTS) {
+					daemonSendLocked(&daemonClients.back(), "error too many connections");
+					daemonClients.back().closed = true;
+				} else {
+					daemonSendLocked(&daemonClients.back(), "ok chamberOps " + std::to_string(PROGRAM_VERSION) + " daemon | " + daemonDevicesText().substr(3));
+				}
+			}
+		}
+		for (daemonClient& client : daemonClients) {
+			if (!client.closed && FD_ISSET(client.socket, &readable) && !daemonReadClient(&client)) {
+				client.closed = true;
+			}
+		}
+		for (size_t i = 0; i < daemonClients.size(); ) {
+			if (daemonClients[i].closed) {
+				closesocket(daemonClients[i].socket);
+				daemonClients.erase(daemonClients.begin() + i);
+			} else {
+				i++;
+			}
+		}
+	}
+}
+
+bool daemonOpenSocket(const std::string& path, SOCKET* listenSocket) {
+	daemonSocketAddress address = {};
+	if (path.empty() || path.length() >= sizeof(address.path)) {
+		errorOut("The socket path must be 1 to " + std::to_string(sizeof(address.path) - 1) + " characters.");
+		return false;
+	}
+	address.family = AF_UNIX;
+	memcpy(address.path, path.c_str(), path.length());
+
+	// a socket file is left behind by a daemon that didn't shut down; only take it over if nothing answers on it
+	SOCKET probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (probe != INVALID_SOCKET && connect(probe, (sockaddr*)(&address), sizeof(address)) == 0) {
+		closesocket(probe);
+		errorOut("Another daemon is already listening on " + path);
+		return false;
+	}
+	if (probe != INVALID_SOCKET) {
+		closesocket(probe);
+	}
+	remove(path.c_str());
+
+	(*listenSocket) = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((*listenSocket) == INVALID_SOCKET) {
+		errorOut("Could not make the control socket (AF_UNIX needs Windows 10 1803 or later).");
+		return false;
+	}
+	if (bind((*listenSocket), (sockaddr*)(&address), sizeof(address)) != 0 || listen((*listenSocket), DAEMON_MAX_CLIENTS) != 0) {
+		closesocket((*listenSocket));
+		errorOut("Could not listen on " + path);
+		return false;
+	}
+	return true;
+}
+
+// one queued job file, on the main thread with the instrument sessions
+void daemonRunRequest(const daemonRequest& request, const batchJob& commandLine) {
+	std::vector<batchJob> jobs;
+	bool parsed = request.fileName.empty() ? parseJobText(request.text, "(socket)", commandLine, &jobs)
+		: parseJobFile(request.fileName, commandLine, &jobs);
+	if (!parsed) {
+		logFlush(); // so the reason goes out before the reply
+		daemonReply(request.clientId, "error no jobs were run");
+		return;
+	}
+	std::string names = "";
+	for (const batchJob& job : jobs) {
+		names += (names.empty() ? "" : ", ") + job.name;
+	}
+	{
+		std::lock_guard<std::mutex> lock(daemonMutex);
+		daemonRunning = names;
+	}
+	daemonReply(request.clientId, "ok started " + std::to_string(jobs.size()) + " job(s)");
+	runJobQueue(&jobs);
+	int jobsDone = 0;
+	for (const batchJob& job : jobs) {
+		jobsDone += (job.status == JOB_DONE) ? 1 : 0;
+	}
+	{
+		// together, so a "stop" can't land between them and be taken for a ctrl+c
+		std::lock_guard<std::mutex> lock(daemonMutex);
+		daemonRunning = "";
+		if (daemonStopRequested) { // "stop" was for these jobs only; a ctrl+c stops the daemon as well
+			daemonStopRequested = false;
+			saveAndCloseFlag = false;
+		}
+	}
+	logFlush();
+	daemonReply(request.clientId, "done " + std::to_string(jobsDone) + "/" + std::to_string(jobs.size()) + " jobs");
+}
+
+// runs until "shutdown" or ctrl+c. commandLine has the settings from the other flags, as for -j
+bool runDaemon(const std::string& path, const batchJob& commandLine) {
+	WSADATA daemonWsaData; // AF_UNIX is winsock too; started here since a dry run doesn't start it for the fieldfox
+	SOCKET listenSocket = INVALID_SOCKET;
+	WSAStartup(MAKEWORD(2, 2), &daemonWsaData);
+	if (!daemonOpenSocket(path, &listenSocket)) {
+		WSACleanup();
+		return false;
+	}
+	logEventSink = daemonEvent;
+	supervisionIdleInterrupted = daemonHasWork;
+	std::thread listener(daemonListen, listenSocket);
+	interfaceOut("Daemon listening on " + path + " (ctrl+c to stop)", false);
+
+	int idleMs = 0;
+	while (!daemonShutdownRequested && !shouldSaveAndClose()) {
+		daemonRequest request;
+		bool haveRequest = false;
+		{
+			std::unique_lock<std::mutex> lock(daemonMutex);
+			daemonWake.wait_for(lock, std::chrono::milliseconds(DAEMON_POLL_INTERVAL),
+				[] { return !daemonQueue.empty() || daemonShutdownRequested; });
+			if (!daemonQueue.empty()) {
+				request = daemonQueue.front();
+				daemonQueue.pop_front();
+				haveRequest = true;
+			}
+		}
+		if (haveRequest) {
+			daemonRunRequest(request, commandLine);
+			idleMs = 0;
+		} else if ((idleMs += DAEMON_POLL_INTERVAL) >= DAEMON_KEEPALIVE_INTERVAL) {
+			superviseDevices(-1, 0); // keeps the sessions from idling out, and reconnects any that did (until there's a job)
+			idleMs = 0;
+		}
+	}
+
+	daemonShutdownRequested = true;
+	listener.join();
+	logFlush();
+	logEventSink = nullptr;
+	supervisionIdleInterrupted = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(daemonMutex);
+		for (daemonClient& client : daemonClients) {
+			daemonSendLocked(&client, "ok daemon stopped");
+			closesocket(client.socket);
+		}
+		daemonClients.clear();
+		for (const daemonRequest& request : daemonQueue) {
+			interfaceOut("Not run: " + (request.fileName.empty() ? std::string("jobs sent over the socket") : request.fileName), false);
+		}
+		daemonQueue.clear();
+	}
+	closesocket(listenSocket);
+	remove(path.c_str());
+	WSACleanup();
+	interfaceOut("Daemon stopped.", false);
+	return true;
+}
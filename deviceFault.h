@@ -0,0 +1,23 @@
+#pragma once
+// what went wrong on an instrument session, as the transports saw it (the supervisor in supervision.h acts on it)
+
+#include <atomic>
+
+enum deviceFault_t {
+	DEVICE_FAULT_NONE,
+	DEVICE_FAULT_TIMEOUT,      // no answer in time
+	DEVICE_FAULT_DISCONNECTED, // the session or socket is gone
+	DEVICE_FAULT_ERROR_REPLY,  // an answer, but not one that makes sense
+	DEVICE_FAULT_KINDS
+};
+const char* DEVICE_FAULT_NAMES[] = { "none", "timeout", "disconnected", "error reply" }; // same order as deviceFault_t
+
+// every failed send or receive is counted, and the kind of the last one kept.
+// atomic since startup brings the devices up on their own threads
+std::atomic<long long> transportFaultCount(0);
+std::atomic<int> transportLastFault(DEVICE_FAULT_NONE);
+
+void transportFault(deviceFault_t kind) {
+	transportLastFault = kind;
+	transportFaultCount++;
+}
@@ -2,11 +2,15 @@
 // fieldfox functions
 #include <iostream>
 #include <string>
+#include <vector>
 #include <winsock.h>
 #pragma comment(lib, "Ws2_32.lib")
 
 #include "helperFunctions.h"
 #include "telnetHelperFunctions.h"
+#include "instrumentShadow.h"
+#include "scpiCommands.h"
+#include "scpiResponse.h"
 #include <visa.h> //https://edadocs.software.keysight.com/connect/setting-up-a-visual-studio-c++-visa-project-482552069.html
 
 // +/- 0.5 GHz, used to start estimating how far to either side of target frequency the bounds should be
@@ -14,130 +18,312 @@
 #define DEFAULT_SPECTRUM_ANALYZER_BW_RES (500000)
 #define DEFAULT_SPECTRUM_ANALYZER_VIDEO_BW_RES (5000)
 #define DEFAULT_SPECTRUM_ANALYZER_POINTS (1001)
+// a swept analyzer needs about k * span / (RBW * min(RBW, VBW)) seconds; used if the sweep time can't be read
+#define SPECTRUM_ANALYZER_SWEEP_MODEL_K (2.5)
+#define SPECTRUM_ANALYZER_SWEEP_TIMEOUT_MARGIN (5000) // ms on top of the sweep time, before a sweep counts as lost
 
 extern ViSession globalVisaResourceManager;
 extern ViStatus  globalVisaStatus;
-extern std::string visaReceiveText;
 
-extern bool deviceConnectionStatus[4]; // from helper functions
+extern bool deviceConnectionStatus[DEVICE_STATUS_DEVICES_MAX]; // from helper functions
 
 WSADATA wsaDataConnection; // used for telent socket environment
-SOCKET telnetFieldFox;
-std::string telnetReceiveText;
+
+// everything here works on the selected analyzer (spectrumAnalyzer, see helperFunctions.h); the fieldfox unless a receiver was selected
 
 bool isSpectrumAnalyzerConnected() {
-	return deviceConnectionStatus[DEVICE_STATUS_INDEX_FIELDFOX];
+	return deviceConnectionStatus[spectrumAnalyzerDevice()];
 }
-//telnetCommand(&telnetFieldFox, "SYST:PRES;*OPC?\r\n", &telnetReceiveText); // supposed to check status using *OPC?, waiting for a 1
+//telnetCommand(&(*spectrumAnalyzer).socket, "SYST:PRES;*OPC?\r\n", &(*spectrumAnalyzer).receiveText); // supposed to check status using *OPC?, waiting for a 1
 bool isSpectrumAnalyzerReady() {
-	telnetCommand(&telnetFieldFox, TELNET_COMMAND_CHECK_OPERATION_COMPLETE, &telnetReceiveText);
-	if (telnetReceiveText == VISA_RESPONSE_TRUE || telnetReceiveText == VISA_RESPONSE_TRUE_2) {
-		return true;
-	}
-	else if (telnetReceiveText == VISA_RESPONSE_FALSE || telnetReceiveText == VISA_RESPONSE_FALSE_2) {
-		return false;
+	telnetCommand(&(*spectrumAnalyzer).socket, TELNET_COMMAND_CHECK_OPERATION_COMPLETE, &(*spectrumAnalyzer).receiveText);
+	bool ready = false;
+	if (parseResponseBool((*spectrumAnalyzer).receiveText, &ready) == RESPONSE_OK) {
+		return ready;
 	}
 	else {
-		errorOut("Unreconized response from TELNET Device (FieldFox).");
-		errorOut(telnetReceiveText);
+		errorOut("Unreconized response from TELNET Device (" + spectrumAnalyzerName() + ").");
+		errorOut((*spectrumAnalyzer).receiveText);
 		return false;
 	}
 }
 
-int issueSpectrumAnalyzerCommand(std::string command, std::string* receivedText) {
-	return telnetCommand(&telnetFieldFox, command, receivedText);
+int issueSpectrumAnalyzerCommand(const scpiCommand& command, std::string* receivedText) {
+	return telnetCommand(&(*spectrumAnalyzer).socket, command, receivedText);
+}
+int issueSpectrumAnalyzerCommand(const std::string& command, std::string* receivedText) {
+	return telnetCommand(&(*spectrumAnalyzer).socket, command, receivedText);
+}
+
+// writes a setting unless the shadow says the analyzer already has it; a real write is always followed by *OPC?
+bool setSpectrumAnalyzerSetting(int setting, double value, const scpiCommand& command) {
+	if (shadowSkipWrite(&(*spectrumAnalyzer).shadow, setting, value, 2)) { // command, and *OPC?
+		return true;
+	}
+	issueSpectrumAnalyzerCommand(command, &(*spectrumAnalyzer).receiveText);
+	if (isSpectrumAnalyzerReady()) {
+		shadowWritten(&(*spectrumAnalyzer).shadow, setting, value);
+		return true;
+	}
+	shadowForget(&(*spectrumAnalyzer).shadow, setting);
+	return false;
 }
 
 bool presetSpectrumAnalyzer() {
-	issueSpectrumAnalyzerCommand("SYST:PRES;\r\n", &telnetReceiveText);
+	shadowInvalidate(&(*spectrumAnalyzer).shadow);
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_PRESET), &(*spectrumAnalyzer).receiveText);
 	return isSpectrumAnalyzerReady();
 }
 
 bool setSpectrumAnalyzerMode(std::string mode) { // SA, for example
-	issueSpectrumAnalyzerCommand("INST:SEL '" + mode + "';\r\n", &telnetReceiveText);
-	//std::cout << "mode output:" << telnetReceiveText << std::endl;
-	return isSpectrumAnalyzerReady();
+	if (shadowSkipWrite(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MODE, mode, 2)) {
+		return true;
+	}
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_MODE, mode), &(*spectrumAnalyzer).receiveText);
+	//std::cout << "mode output:" << (*spectrumAnalyzer).receiveText << std::endl;
+	if (isSpectrumAnalyzerReady()) {
+		shadowWritten(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MODE, mode);
+		return true;
+	}
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MODE);
+	return false;
 }
 
-bool setSpectrumAnalyzerRangeStart(float freqInHz, int exponent) {
-	issueSpectrumAnalyzerCommand("SENS:FREQ:START " + std::to_string(freqInHz) + "E" + std::to_string(exponent) + "Hz" + ";\r\n",&telnetReceiveText);
-	return isSpectrumAnalyzerReady();
+bool setSpectrumAnalyzerRangeStart(double freqInHz, int exponent) {
+	double freq = freqInHz * pow(10, exponent);
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_CENTER);
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_SPAN);
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_START, freq, scpiFormat(SCPI_SPECTRUM_ANALYZER_FREQ_START, freq));
 }
 
-bool setSpectrumAnalyzerRangeStop(float freqInHz, int exponent) {
-	//"FREQ " + std::to_string(freqInHz) + "E" + std::to_string(exponent) + "Hz" + "\r\n"
-	issueSpectrumAnalyzerCommand("SENS:FREQ:STOP " + std::to_string(freqInHz) + "E" + std::to_string(exponent) + "Hz" + ";\r\n", &telnetReceiveText);
-	return isSpectrumAnalyzerReady();
+bool setSpectrumAnalyzerRangeStop(double freqInHz, int exponent) {
+	double freq = freqInHz * pow(10, exponent);
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_CENTER);
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_SPAN);
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_STOP, freq, scpiFormat(SCPI_SPECTRUM_ANALYZER_FREQ_STOP, freq));
 }
 
-// bool setSpectrumAnalyzerRangeCenter()
-// bool setSpectrumAnalyzerRangeSpan()
+bool setSpectrumAnalyzerRangeCenter(double freqInHz) {
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_START); // start/stop move with the center
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_STOP);
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_CENTER, freqInHz, scpiFormat(SCPI_SPECTRUM_ANALYZER_FREQ_CENTER, freqInHz));
+}
 
-bool setSpectrumAnalyzerBandWResolution(float freqInHz, int exponent) {
-	issueSpectrumAnalyzerCommand("SENS:BAND:RES " + std::to_string(freqInHz) + "E" + std::to_string(exponent) + "Hz" + ";\r\n", &telnetReceiveText);
-	return isSpectrumAnalyzerReady();
+bool setSpectrumAnalyzerRangeSpan(double freqInHz) { // 0 for zero span
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_START);
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_STOP);
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_SPAN, freqInHz, scpiFormat(SCPI_SPECTRUM_ANALYZER_FREQ_SPAN, freqInHz));
 }
 
-bool setSpectrumAnalyzerBandWVideo(float freqInHz, int exponent) {
-	issueSpectrumAnalyzerCommand("SENS:BAND:VID " + std::to_string(freqInHz) + "E" + std::to_string(exponent) + "Hz" + ";\r\n", &telnetReceiveText);
-	return isSpectrumAnalyzerReady();
+bool setSpectrumAnalyzerSweepTime(double seconds) {
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_SWEEP_TIME, seconds, scpiFormat(SCPI_SPECTRUM_ANALYZER_SWEEP_TIME, seconds));
+}
+
+bool setSpectrumAnalyzerBandWResolution(double freqInHz, int exponent) {
+	double freq = freqInHz * pow(10, exponent);
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_BW_RES, freq, scpiFormat(SCPI_SPECTRUM_ANALYZER_BW_RES, freq));
+}
+
+bool setSpectrumAnalyzerBandWVideo(double freqInHz, int exponent) {
+	double freq = freqInHz * pow(10, exponent);
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_BW_VIDEO, freq, scpiFormat(SCPI_SPECTRUM_ANALYZER_BW_VIDEO, freq));
 }
 
 bool setSpectrumAnalyzerSweepPoints(int points) { // usually odd (ie, 401 or 1001) so there is a clear middle point
-	issueSpectrumAnalyzerCommand("SENS:SWEEP:POINTS " + std::to_string(points) + ";\r\n", &telnetReceiveText);
-	return isSpectrumAnalyzerReady();
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_POINTS, points, scpiFormat(SCPI_SPECTRUM_ANALYZER_SWEEP_POINTS, points));
 }
 
-bool setSpectrumAnalyzerCaptureModeContinuous(bool onIfTrue) {
-	std::string status = "ON";
-	if (!onIfTrue) {
-		status = "OFF";
+bool setSpectrumAnalyzerAttenuation(int attenuationDb) { // input attenuator, 0 to 30 dB in 5 dB steps
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_ATTENUATION, attenuationDb, scpiFormat(SCPI_SPECTRUM_ANALYZER_ATTENUATION, attenuationDb));
+}
+
+bool setSpectrumAnalyzerDetector(std::string detector) { // POS, NEG, SAMP, AVER, NORM or AUTO
+	if (shadowSkipWrite(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_DETECTOR, detector, 2)) {
+		return true;
 	}
-	issueSpectrumAnalyzerCommand("INIT:CONT " + status + ";\r\n", &telnetReceiveText);
-	return isSpectrumAnalyzerReady();
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_DETECTOR, detector), &(*spectrumAnalyzer).receiveText);
+	if (isSpectrumAnalyzerReady()) {
+		shadowWritten(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_DETECTOR, detector);
+		return true;
+	}
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_DETECTOR);
+	return false;
+}
+
+bool setSpectrumAnalyzerCaptureModeContinuous(bool onIfTrue) {
+	return setSpectrumAnalyzerSetting(SHADOW_SPECTRUM_ANALYZER_CONTINUOUS, onIfTrue ? 1 : 0,
+		scpiFormat(onIfTrue ? SCPI_SPECTRUM_ANALYZER_CONTINUOUS_ON : SCPI_SPECTRUM_ANALYZER_CONTINUOUS_OFF));
 }
 
 bool setSpectrumAnalyzerCaptureModeImmediate() { // single capture only, starting now; blocking until capture ends!!!
-	issueSpectrumAnalyzerCommand("INIT:CONT OFF;\r\n", &telnetReceiveText);
-	issueSpectrumAnalyzerCommand("INIT:IMM;\r\n", &telnetReceiveText);
-	//issueSpectrumAnalyzerCommand("INIT:CONT ON;\r\n", &telnetReceiveText);
-	return isSpectrumAnalyzerReady();
+	bool continuousWasOff = shadowSkipWrite(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_CONTINUOUS, 0, 1);
+	if (!continuousWasOff) {
+		issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_CONTINUOUS_OFF), &(*spectrumAnalyzer).receiveText);
+	}
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_INIT_IMMEDIATE), &(*spectrumAnalyzer).receiveText);
+	//issueSpectrumAnalyzerCommand("INIT:CONT ON;\r\n", &(*spectrumAnalyzer).receiveText);
+	if (isSpectrumAnalyzerReady()) {
+		shadowWritten(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_CONTINUOUS, 0);
+		return true;
+	}
+	shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_CONTINUOUS);
+	return false;
+}
+
+// the settings that decide how long one sweep takes, as the analyzer reports them
+struct spectrumAnalyzerAcquisition {
+	double sweepTime = 0; // seconds, SENS:SWE:TIME?
+	double span = 0;      // Hz
+	double bwRes = 0;     // Hz
+	double bwVideo = 0;   // Hz
+	int points = 0;
+	double modelSweepTime = 0; // seconds, from span and bandwidths
+};
+
+bool getSpectrumAnalyzerAcquisition(spectrumAnalyzerAcquisition* acquisition) {
+	double values[5]; // sweep time, span, rbw, vbw, points
+	responseStatus_t status = RESPONSE_OK;
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_ACQUISITION), &(*spectrumAnalyzer).receiveText);
+	if (parseResponseList((*spectrumAnalyzer).receiveText, values, 5, &status) != 5) {
+		errorOut("Could not read spectrum analyzer acquisition settings (" + responseStatusText(status) + "): \"" + (*spectrumAnalyzer).receiveText + "\"");
+		return false;
+	}
+	(*acquisition).sweepTime = values[0];
+	(*acquisition).span = values[1];
+	(*acquisition).bwRes = values[2];
+	(*acquisition).bwVideo = values[3];
+	(*acquisition).points = (int)values[4];
+	double narrowest = (values[3] < values[2]) ? values[3] : values[2];
+	(*acquisition).modelSweepTime = (narrowest > 0) ? SPECTRUM_ANALYZER_SWEEP_MODEL_K * values[1] / (values[2] * narrowest) : 0;
+	return true;
+}
+
+// true duration of one sweep in seconds: what the analyzer says, or the model if it says nothing useful
+double spectrumAnalyzerSweepSeconds(const spectrumAnalyzerAcquisition& acquisition) {
+	if (acquisition.sweepTime > 0 && std::isfinite(acquisition.sweepTime)) {
+		return acquisition.sweepTime;
+	}
+	return acquisition.modelSweepTime;
+}
+
+// runs count single sweeps back to back, each confirmed by *OPC?, and returns how many completed.
+// the trace mode (ie max hold) carries across them, so the result covers exactly that many sweeps
+int acquireSpectrumAnalyzerSweeps(int count, int sweepTimeMs) {
+	int completed = 0;
+	setSpectrumAnalyzerCaptureModeContinuous(false);
+	for (int i = 0; i < count; i++) {
+		bool done = false;
+		(*spectrumAnalyzer).receiveText = ""; // a timed out command leaves this alone, so don't let an old "1" count
+		telnetCommand(&(*spectrumAnalyzer).socket, scpiFormat(SCPI_SPECTRUM_ANALYZER_SINGLE_SWEEP), &(*spectrumAnalyzer).receiveText,
+			sweepTimeMs + SPECTRUM_ANALYZER_SWEEP_TIMEOUT_MARGIN);
+		if (parseResponseBool((*spectrumAnalyzer).receiveText, &done) != RESPONSE_OK || !done) {
+			errorOut("Spectrum analyzer sweep " + std::to_string(i + 1) + " of " + std::to_string(count) + " did not complete.");
+			continue;
+		}
+		completed++;
+	}
+	return completed;
 }
 
 bool setSpectrumAnalyzerMarkerNormal(int markerNumber, double freq, int exponent) {
 	if (markerNumber > 6 || markerNumber < 1) {
 		errorOut("Can't activate marker number " + std::to_string(markerNumber) + " (out of range)!");
 	}
-	issueSpectrumAnalyzerCommand("CALC:MARK" + std::to_string(markerNumber) + " NORM;\r\n", &telnetReceiveText);
-	issueSpectrumAnalyzerCommand("CALC:MARK1:X "+ std::to_string(freq) + "E" + std::to_string(exponent) + ";\r\n", &telnetReceiveText);
-	return isSpectrumAnalyzerReady();
+	double freqInHz = freq * pow(10, exponent);
+	if (markerNumber == 1 && shadowSkipWrite(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MARKER_MODE, 1, 0)
+		&& shadowSkipWrite(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MARKER_X, freqInHz, 3)) { // both commands, and *OPC?
+		return true;
+	}
+	scpiCommand command;
+	scpiBegin(&command);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER, markerNumber);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER_NORMAL);
+	issueSpectrumAnalyzerCommand(command, &(*spectrumAnalyzer).receiveText);
+	scpiBegin(&command);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER, markerNumber);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER_X, freqInHz);
+	issueSpectrumAnalyzerCommand(command, &(*spectrumAnalyzer).receiveText);
+	bool ready = isSpectrumAnalyzerReady();
+	if (markerNumber == 1 && ready) {
+		shadowWritten(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MARKER_MODE, 1);
+		shadowWritten(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MARKER_X, freqInHz);
+	} else if (markerNumber == 1) {
+		shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MARKER_MODE);
+		shadowForget(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MARKER_X);
+	}
+	return ready;
 }
 
-double getSpectrumAnalyzerMarkerValue(int markerNumber, std::string* textValue) { // gets a frequency value in text and number
+double getSpectrumAnalyzerMarkerValue(int markerNumber, std::string* textValue) { // gets the marker level (dBm) in text and number; NaN if unreadable
 	isSpectrumAnalyzerReady();
 	if (markerNumber > 6 || markerNumber < 1) {
 		errorOut("Can't read marker number " + std::to_string(markerNumber) + " (out of range)!");
 	}
-	issueSpectrumAnalyzerCommand("CALC:MARK" + std::to_string(markerNumber) + ":Y?;\r\n", &telnetReceiveText);
-	*(textValue) = telnetReceiveText;
+	scpiCommand command;
+	scpiBegin(&command);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER, markerNumber);
+	scpiAppend(&command, SCPI_SPECTRUM_ANALYZER_MARKER_Y_QUERY);
+	issueSpectrumAnalyzerCommand(command, &(*spectrumAnalyzer).receiveText);
+	*(textValue) = (*spectrumAnalyzer).receiveText;
 
-	isSpectrumAnalyzerReady(); // modifies telnetReceiveText, so must come after that value is read
-	return strtod((*(textValue)).c_str(), nullptr);
+	isSpectrumAnalyzerReady(); // modifies (*spectrumAnalyzer).receiveText, so must come after that value is read
+	double value = NAN;
+	responseStatus_t status = parseResponseNumber(*(textValue), &value, RESPONSE_UNIT_DBM);
+	if (status == RESPONSE_INSTRUMENT_NAN) {
+		debugOut("Marker " + std::to_string(markerNumber) + " has no valid value.");
+	} else if (status != RESPONSE_OK) {
+		errorOut("Marker " + std::to_string(markerNumber) + " could not be read (" + responseStatusText(status) + "): \"" + *(textValue) + "\"");
+		return NAN;
+	}
+	return value;
 }
 
 bool setSpectrumAnalyzerTraceModeClearRewriteLive() {
-	telnetCommand(&telnetFieldFox, "TRAC:TYPE CLRW;\r\n", &telnetReceiveText);
+	telnetCommand(&(*spectrumAnalyzer).socket, scpiFormat(SCPI_SPECTRUM_ANALYZER_TRACE_CLEAR), &(*spectrumAnalyzer).receiveText);
 	return isSpectrumAnalyzerReady();
 }
 
 bool setSpectrumAnalyzerTraceModeMaxHold() { // will reset trace by switching to Clear/Rewrite first
 	setSpectrumAnalyzerTraceModeClearRewriteLive();
-	telnetCommand(&telnetFieldFox, "TRAC:TYPE MAXH;\r\n", &telnetReceiveText);
+	telnetCommand(&(*spectrumAnalyzer).socket, scpiFormat(SCPI_SPECTRUM_ANALYZER_TRACE_MAX_HOLD), &(*spectrumAnalyzer).receiveText);
 	return isSpectrumAnalyzerReady();
 }
 
+// zero span: the analyzer sits on one frequency and the trace is power over time, one sweep per time record.
+// the trace is left in clear/write, so every record stands on its own
+bool setSpectrumAnalyzerZeroSpan(double centerHz, double bwResHz, double recordSeconds, int points) {
+	bool success = setSpectrumAnalyzerRangeCenter(centerHz);
+	success = setSpectrumAnalyzerRangeSpan(0) && success;
+	success = setSpectrumAnalyzerBandWResolution(bwResHz, 0) && success;
+	success = setSpectrumAnalyzerBandWVideo(bwResHz, 0) && success; // no extra smoothing on top of the RBW
+	success = setSpectrumAnalyzerSweepPoints(points) && success;
+	success = setSpectrumAnalyzerSweepTime(recordSeconds) && success;
+	success = setSpectrumAnalyzerTraceModeClearRewriteLive() && success;
+	return success;
+}
+
 bool getSpectrumAnalyzerTraceData(std::string* traceData) { // returns full frequency sweep; could allow detecting the strongest frequency automatically
-	issueSpectrumAnalyzerCommand("TRACE:DATA?;\r\n", &telnetReceiveText);
-	*(traceData) = telnetReceiveText;
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_TRACE_DATA), &(*spectrumAnalyzer).receiveText);
+	*(traceData) = (*spectrumAnalyzer).receiveText;
 	return isSpectrumAnalyzerReady();
 }
+
+// mean (in linear power) and peak of the current trace, in dBm; for zero span that's over the time record
+bool getSpectrumAnalyzerTracePower(double* meanDbm, double* peakDbm) {
+	std::string traceText = "";
+	std::vector<float> trace;
+	getSpectrumAnalyzerTraceData(&traceText);
+	if (!parseTraceData(traceText, &trace)) {
+		errorOut("Could not read the spectrum analyzer trace.");
+		return false;
+	}
+	double sumMw = 0;
+	double peak = trace[0];
+	for (float point : trace) {
+		sumMw += pow(10, point / 10.0);
+		peak = (point > peak) ? point : peak;
+	}
+	*meanDbm = 10 * log10(sumMw / trace.size());
+	*peakDbm = peak;
+	return true;
+}
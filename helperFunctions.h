@@ -1,8 +1,8 @@
 #pragma once
 // program helper functions
 
-#define LOG_FILE_DEFAULT ("chamberTurntable.log")
 #define DATA_FILE_DEFAULT ("chamberTurntable.csv")
+#define DATA_FILE_DEFAULT_COMPRESSED ("chamberTurntable.chz")
 
 #define VISA_ADDRESS_TURNTABLE_AZIMUTH   ("GPIB0::18::INSTR")
 #define VISA_ADDRESS_TURNTABLE_ELEVATION ("GPIB0::19::INSTR")
@@ -11,7 +11,10 @@
 #define DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH   (0)
 #define DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION (1)
 #define DEVICE_STATUS_INDEX_SIGNAL_GENERATOR    (2)
-#define DEVICE_STATUS_INDEX_FIELDFOX            (3)
+#define DEVICE_STATUS_INDEX_FIELDFOX            (3) // the first analyzer; any others follow it (see spectrumAnalyzerDriver)
+
+#define SPECTRUM_ANALYZERS_MAX (4)
+#define DEVICE_STATUS_DEVICES_MAX (DEVICE_STATUS_INDEX_FIELDFOX + SPECTRUM_ANALYZERS_MAX)
 
 #define VISA_COMMAND_CHECK_OPERATION_COMPLETE ("*OPC?\r\n")
 #define TELNET_COMMAND_CHECK_OPERATION_COMPLETE ("*OPC?\r\n")
@@ -20,14 +23,21 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <time.h>
-#include <sys/timeb.h> // for ms time
+#include <vector>
+#include <thread>
+#include <functional>
+#include <algorithm>
 #include <visa.h> //https://edadocs.software.keysight.com/connect/setting-up-a-visual-studio-c++-visa-project-482552069.html
 #include <Windows.h> // for Beep()
 
 #include "inputArgs.h"
+#include "chamberClock.h"
+#include "logger.h"
+#include "results.h"
+#include "compression.h"
 #include "visaHelperFunctions.h"
 #include "telnetHelperFunctions.h"
+#include "instrumentShadow.h"
 
 //inopvsy    aefAE   z
 extern bool  progFlags[26];
@@ -35,72 +45,86 @@ extern std::string progFlagArgs[26];
 
 extern ViSession globalVisaResourceManager;
 extern ViStatus  globalVisaStatus;
-extern std::string visaReceiveText;
 
 extern ViSession visaTurntableAzimuthSession    = 0;
 extern ViSession visaTurntableElevationSession  = 0;
 extern ViSession visaSignalGeneratorSession     = 0;
 
+visaReceiveBuffer visaTurntableAzimuthReceive;
+visaReceiveBuffer visaTurntableElevationReceive;
+visaReceiveBuffer visaSignalGeneratorReceive;
+
 extern ViRsrc turntableAzimuthRsrc = ViRsrc(VISA_ADDRESS_TURNTABLE_AZIMUTH);
 extern ViRsrc turntableElevationRsrc = ViRsrc(VISA_ADDRESS_TURNTABLE_ELEVATION);
 extern ViRsrc signalGeneratorRsrc = ViRsrc(VISA_ADDRESS_SIGNAL_GENERATOR);
 
 extern WSADATA wsaDataConnection; // used for telent socket environment
-extern SOCKET telnetFieldFox;
-extern std::string telnetReceiveText;
 
-// track status of each device
-extern bool deviceConnectionStatus[4] = { false, false, false, false };
+// track status of each device; analyzer k is at DEVICE_STATUS_INDEX_FIELDFOX + k
+extern bool deviceConnectionStatus[DEVICE_STATUS_DEVICES_MAX] = {};
 
 int statusTurntableAzimuth = -1;
 int statusTurntableElevation = -1;
 int statusSignalGenerator = -1;
-int statusTelnetFieldFox = -1;
-
-const char telnetFieldFoxIP[] = "192.168.0.1";
-const char telnetBindIP[] = "192.168.0.2";
-const int  telnetFieldFoxPort = 5024;
 
-bool debugFlagIsSet() {
-#ifdef DEBUG
-	return true;
-#endif // DEBUG
-	return false;
+// a plan file (-l) can replace these, and the VISA addresses above
+std::string telnetFieldFoxIP = "192.168.0.1";
+std::string telnetBindIP = "192.168.0.2";
+int telnetFieldFoxPort = 5024;
+
+// one per spectrum analyzer, each with its own connection, buffers and shadow. the fieldfox is always the first;
+// a plan file's [receivers] (see plan.h) adds more, which measure at the same positions alongside it
+struct spectrumAnalyzerDriver {
+	std::string name = "";    // empty for the fieldfox; the others' names go in their results file names
+	std::string address = ""; // empty for the fieldfox, which uses telnetFieldFoxIP and telnetFieldFoxPort
+	int port = 5024;
+	SOCKET socket = INVALID_SOCKET;
+	std::string receiveText = "";
+	instrumentShadow shadow;  // last confirmed settings, see instrumentShadow.h
+	compressedResultWriter resultFile; // -c output; stays open for the run, opened on first row
+	int status = -1;
+};
+spectrumAnalyzerDriver spectrumAnalyzers[SPECTRUM_ANALYZERS_MAX];
+int spectrumAnalyzerCount = 1;
+
+// the one fieldfox.h talks to. per thread, so each receiver can be driven from its own
+thread_local spectrumAnalyzerDriver* spectrumAnalyzer = &spectrumAnalyzers[0];
+
+int selectSpectrumAnalyzer(int receiver) { // returns the one selected before
+	int previous = (int)(spectrumAnalyzer - spectrumAnalyzers);
+	spectrumAnalyzer = &spectrumAnalyzers[receiver];
+	return previous;
 }
 
-int chamberTimestamp(std::string* timestampText) {
-	// timestamp variables; will use to output linux format timestamps (easy to sort, since its only measured in seconds since Jan 1, 1970)
-	time_t currentTime;
-	struct tm* currentTimeInfo;
-	std::stringstream ss;
-
-	// get timestamp
-	time(&currentTime);
-	currentTimeInfo = gmtime(&currentTime);
-	//gmtime_s(currentTimeInfo, &currentTime);  // double check functionality? not sure?
-	currentTime = mktime(currentTimeInfo);
-
-	// convert to string
-	ss << currentTime;
-	*(timestampText) = ss.str();
-	return atoi(ss.str().c_str());
+int spectrumAnalyzerDevice() { // DEVICE_STATUS_INDEX_* of the selected analyzer
+	return DEVICE_STATUS_INDEX_FIELDFOX + (int)(spectrumAnalyzer - spectrumAnalyzers);
 }
 
-int chamberTimestamp() {
-	std::string temp = "";
-	return chamberTimestamp(&temp);
+std::string spectrumAnalyzerName() {
+	return (*spectrumAnalyzer).name.empty() ? "Fieldfox" : "Receiver " + (*spectrumAnalyzer).name;
 }
 
-unsigned long int timestampMs() {
-	struct timeb timeNow;
-	ftime(&timeNow);
-	return 1000 * timeNow.time + timeNow.millitm;
+// FNV-1a (64 bit), for keying saved settings - not for anything security related
+#define HASH_START (14695981039346656037ULL)
+unsigned long long hashBytes(unsigned long long hash, const void* bytes, size_t length) {
+	for (size_t i = 0; i < length; i++) {
+		hash ^= ((const unsigned char*)bytes)[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
 }
 
+bool debugFlagIsSet() {
+#ifdef DEBUG
+	return true;
+#endif // DEBUG
+	return false;
+}
 
 char ynPrompt(std::string prompt) {
 	char ynPromptVal = 'q'; // default to nonsense value
 	bool cinStatus = true;
+	logFlush(); // queued output must reach the console before the question does
 	do {
 		std::cin.clear();
 		std::cout << prompt << "[y/n]";
@@ -122,17 +146,10 @@ char ynPrompt(std::string prompt) {
 void errorOut(std::string mesg) { //suppressed conditionally; error may be placed in a log file
 	if (progFlags[Z_FLAG_INDEX] && !progFlags[V_FLAG_INDEX]) {
 		// print to log file instead of to screen
-		std::ofstream logfile;
-		// write to file
-		logfile.open(LOG_FILE_DEFAULT, 'a');
-		logfile << chamberTimestamp() << " " << mesg << std::endl;
-		logfile.close();
+		logMessage(LOG_SEVERITY_ERROR, LOG_DESTINATION_FILE, true, mesg);
 	}
 	else {
-		if (progFlags[V_FLAG_INDEX]) {
-			std::cerr << chamberTimestamp() << " ";
-		}
-		std::cerr << mesg << std::endl;
+		logMessage(LOG_SEVERITY_ERROR, LOG_DESTINATION_STDERR, progFlags[V_FLAG_INDEX], mesg);
 	}
 }
 
@@ -149,13 +166,31 @@ bool interfaceOut(std::string mesg, bool needsAnswer) { // needed for getting us
 		return false;
 	}
 	else {
-		std::cout << mesg << std::endl;
+		logMessage(LOG_SEVERITY_INFO, LOG_DESTINATION_STDOUT, false, mesg);
 		return true;
 	}
 }
+// unattended runs (-j) answer from a policy instead of the keyboard; 0 asks as usual
+enum promptKind_t {
+	PROMPT_PROCEED,      // "Proceed with these values?"
+	PROMPT_SAVESTATE,    // "...savestate your current settings, for inspection?"
+	PROMPT_OVERWRITE,    // "...existing savestate file be overwritten?"
+	PROMPT_COMMAND_LINE, // "...command line values, rather than savestate?"
+	PROMPT_KINDS
+};
+char promptPolicy[PROMPT_KINDS] = { 0, 0, 0, 0 };
+
+char ynPrompt(std::string prompt, promptKind_t kind) {
+	if (promptPolicy[kind] != 0) {
+		interfaceOut(prompt + " " + promptPolicy[kind] + " (by policy)", false);
+		return promptPolicy[kind];
+	}
+	return ynPrompt(prompt);
+}
+
 void debugOut(std::string mesg) {
 #ifdef DEBUG
-	std::cerr << mesg << std::endl;
+	logMessage(LOG_SEVERITY_DEBUG, LOG_DESTINATION_STDERR, true, mesg);
 #endif // DEBUG
 #ifndef DEBUG
 	return;
@@ -164,11 +199,24 @@ void debugOut(std::string mesg) {
 
 //bool interfaceIn() // handle z flag with a "default" value
 
-bool dataOut(std::string mesg) { // sent to file, or to standard out, depending on settings
+// the other receivers' results go next to the fieldfox's, with the receiver's name before the extension
+std::string receiverFileName(const std::string& fileName, const std::string& receiverName) {
+	if (receiverName.empty()) {
+		return fileName;
+	}
+	size_t dot = fileName.find_last_of('.');
+	size_t folder = fileName.find_last_of("/\\");
+	if (dot == std::string::npos || (folder != std::string::npos && dot < folder)) {
+		return fileName + "." + receiverName;
+	}
+	return fileName.substr(0, dot) + "." + receiverName + fileName.substr(dot);
+}
+
+bool dataOut(std::string mesg, const std::string& receiverName) { // sent to file, or to standard out, depending on settings
 	std::ofstream outputFile;
 	if (progFlags[O_FLAG_INDEX] && progFlagArgs[O_FLAG_INDEX] != "") {
 		// write to file
-		outputFile.open(progFlagArgs[O_FLAG_INDEX], std::ios_base::app); // append mode
+		outputFile.open(receiverFileName(progFlagArgs[O_FLAG_INDEX], receiverName), std::ios_base::app); // append mode
 		if (!outputFile.is_open()) { outputFile.close(); return false; }
 		outputFile << mesg << std::endl;
 		outputFile.close();
@@ -180,7 +228,7 @@ bool dataOut(std::string mesg) { // sent to file, or to standard out, depending
 		return false;
 	}
 	else { // open the default file
-		outputFile.open(DATA_FILE_DEFAULT, std::ios_base::app);
+		outputFile.open(receiverFileName(DATA_FILE_DEFAULT, receiverName), std::ios_base::app);
 		if (!outputFile.is_open()) { outputFile.close(); return false; }
 		outputFile << mesg << std::endl;
 		outputFile.close();
@@ -188,45 +236,100 @@ bool dataOut(std::string mesg) { // sent to file, or to standard out, depending
 	}
 }
 
+bool dataOut(std::string mesg) {
+	return dataOut(mesg, "");
+}
+
+// csv through dataOut(), or the receiver's compressed sink with -c
+bool resultOut(const resultRow& row, const std::vector<float>* trace, int receiver) {
+	spectrumAnalyzerDriver* analyzer = &spectrumAnalyzers[receiver];
+	if (simulationActive) { // -d writes nothing
+		return true;
+	}
+	if (!progFlags[C_FLAG_INDEX]) {
+		return dataOut(formatResultRowCsv(row), (*analyzer).name);
+	}
+	if (!(*analyzer).resultFile.file.is_open()) {
+		std::string fileName = DATA_FILE_DEFAULT_COMPRESSED;
+		if (progFlags[O_FLAG_INDEX] && progFlagArgs[O_FLAG_INDEX] != "") {
+			fileName = progFlagArgs[O_FLAG_INDEX];
+		}
+		if (!compressWriterOpen(&(*analyzer).resultFile, receiverFileName(fileName, (*analyzer).name))) {
+			return false;
+		}
+	}
+	bool writeSuccess = compressWriterPutRow(&(*analyzer).resultFile, row);
+	if (trace != nullptr && !(*trace).empty()) {
+		writeSuccess = compressWriterPutTrace(&(*analyzer).resultFile, *trace) && writeSuccess;
+	}
+	return writeSuccess;
+}
+
+bool resultOut(const resultRow& row, const std::vector<float>* trace) {
+	return resultOut(row, trace, 0);
+}
+
+void cleanupResults() {
+	for (int i = 0; i < spectrumAnalyzerCount; i++) {
+		if (spectrumAnalyzers[i].resultFile.file.is_open()) {
+			debugOut("Compressed results" + std::string(spectrumAnalyzers[i].name.empty() ? "" : " (" + spectrumAnalyzers[i].name + ")") + ": "
+				+ std::to_string(spectrumAnalyzers[i].resultFile.rawBytes) + " bytes stored in " + std::to_string(spectrumAnalyzers[i].resultFile.compressedBytes));
+		}
+		compressWriterClose(&spectrumAnalyzers[i].resultFile);
+	}
+}
+
+// a beep holds the program up as long as it sounds, so a dry run counts it as a wait
 void errorBeep() {
+	if (simulationActive) {
+		chamberSleep(2000);
+		return;
+	}
 	Beep(800, 2000); // example was 523 hertz (C5) for 500 milliseconds
 }
 
 void infoBeep() {
+	if (simulationActive) {
+		chamberSleep(500);
+		return;
+	}
 	Beep(1200, 500); // example was 523 hertz (C5) for 500 milliseconds
 }
 
 // visa session setup
+bool setupVisaInstrument(ViRsrc visaAddress, ViSession* instSession, int statusIndex, int timeoutMs) {
+	bool opened = false;
+	if (simulationActive) { // -d
+		*instSession = (ViSession)simulationOpen(statusIndex);
+		opened = true;
+	} else {
+		opened = (visaOpenInstrument(&globalVisaResourceManager, visaAddress, instSession, timeoutMs) == 0);
+	}
+	deviceConnectionStatus[statusIndex] = opened;
+	return opened;
+}
+
 bool setupVisa() {
 	bool errorFlag = false;
 	// setup instrument connection managers
 	visaInitResourceManager(&globalVisaResourceManager);
 
 	// establish connection to instruments
-	statusTurntableAzimuth = visaOpenInstrument(&globalVisaResourceManager, turntableAzimuthRsrc, &visaTurntableAzimuthSession);
-	statusTurntableElevation = visaOpenInstrument(&globalVisaResourceManager, turntableElevationRsrc, &visaTurntableElevationSession);
-	statusSignalGenerator = visaOpenInstrument(&globalVisaResourceManager, signalGeneratorRsrc, &visaSignalGeneratorSession);
+	statusTurntableAzimuth = setupVisaInstrument(turntableAzimuthRsrc, &visaTurntableAzimuthSession, DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH, VISA_RECEIVE_TIMEOUT) ? 0 : 1;
+	statusTurntableElevation = setupVisaInstrument(turntableElevationRsrc, &visaTurntableElevationSession, DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION, VISA_RECEIVE_TIMEOUT) ? 0 : 1;
+	statusSignalGenerator = setupVisaInstrument(signalGeneratorRsrc, &visaSignalGeneratorSession, DEVICE_STATUS_INDEX_SIGNAL_GENERATOR, VISA_RECEIVE_TIMEOUT) ? 0 : 1;
 
 	if (statusTurntableAzimuth != 0) {
 		errorOut("Turntable (Azi) did not open properly.");
-		deviceConnectionStatus[DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH] = false;
 		errorFlag = true;
-	} else {
-		deviceConnectionStatus[DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH] = true;
 	}
 	if (statusTurntableElevation != 0) {
 		errorOut("Turntable (Ele) did not open properly.");
-		deviceConnectionStatus[DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION] = false;
 		errorFlag = true;
-	} else {
-		deviceConnectionStatus[DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION] = true;
 	}
 	if (statusSignalGenerator != 0) {
 		errorOut("Signal Generator did not open properly");
-		deviceConnectionStatus[DEVICE_STATUS_INDEX_SIGNAL_GENERATOR] = false;
 		errorFlag = true;
-	} else {
-		deviceConnectionStatus[DEVICE_STATUS_INDEX_SIGNAL_GENERATOR] = true;
 	}
 
 	// check error flag
@@ -241,27 +344,78 @@ void cleanupVisa() {
 	visaCloseResourceManager(&globalVisaResourceManager);
 }
 
-bool setupTelnet() {
-	telnetInitWSA(&wsaDataConnection);
-	statusTelnetFieldFox = telnetStartControl(&telnetFieldFox, telnetFieldFoxIP, telnetFieldFoxPort, telnetBindIP);
-	if (statusTelnetFieldFox != 0) {
-		deviceConnectionStatus[DEVICE_STATUS_INDEX_FIELDFOX] = false;
-		errorOut("Fieldfox did not open properly.");
-		return false;
+bool setupTelnet(int timeoutMs) { // for the selected analyzer; WSA must already be started (telnetInitWSA)
+	spectrumAnalyzerDriver* analyzer = spectrumAnalyzer;
+	int device = spectrumAnalyzerDevice();
+	if (simulationActive) { // -d
+		(*analyzer).socket = (SOCKET)simulationOpen(device);
+		(*analyzer).status = 0;
+	} else if ((*analyzer).address.empty()) {
+		(*analyzer).status = telnetStartControl(&(*analyzer).socket, telnetFieldFoxIP.c_str(), telnetFieldFoxPort, telnetBindIP.c_str(), timeoutMs);
 	} else {
-		// connection established
-		deviceConnectionStatus[DEVICE_STATUS_INDEX_FIELDFOX] = true;
-		unsigned long on = 1;
-		unsigned long off = 0;
-		ioctlsocket(telnetFieldFox, FIONBIO, &on); // disable socket blocking
-		return true;
+		(*analyzer).status = telnetStartControl(&(*analyzer).socket, (*analyzer).address.c_str(), (*analyzer).port, telnetBindIP.c_str(), timeoutMs);
 	}
+	if ((*analyzer).status != 0) {
+		deviceConnectionStatus[device] = false;
+		errorOut(spectrumAnalyzerName() + " did not open properly"
+			+ std::string(((*analyzer).status == 4) ? " (no answer within " + std::to_string(timeoutMs) + " ms)." : "."));
+		return false;
+	}
+	// connection established, socket is non-blocking
+	deviceConnectionStatus[device] = true;
+	return true;
 }
 
-void cleanupTelnet() {
-	telnetStopControl(&telnetFieldFox);
+bool setupTelnet() {
+	telnetInitWSA(&wsaDataConnection);
+	return setupTelnet(TELNET_CONNECT_TIMEOUT);
+}
+
+void cleanupTelnet() { // every analyzer
+	for (int i = 0; i < spectrumAnalyzerCount; i++) {
+		telnetStopControl(&spectrumAnalyzers[i].socket);
+		deviceConnectionStatus[DEVICE_STATUS_INDEX_FIELDFOX + i] = false;
+	}
 	telnetCleanupWSA(&wsaDataConnection);
-	deviceConnectionStatus[DEVICE_STATUS_INDEX_FIELDFOX] = false;
+}
+
+// work(receiver) for each analyzer from first on, each on its own thread with that analyzer selected; first runs on this one.
+// a dry run (-d) takes them one at a time instead, each from the same moment on the virtual clock, as if side by side
+void forEachReceiver(int first, const std::function<void(int)>& work) {
+	if (simulationActive) {
+		long long startNs = clockMonotonicNs();
+		long long endNs = startNs;
+		long long waitStartNs = simulationWaitNs; // the waits overlap too, for the report
+		long long waitNs = 0;
+		int previous = selectSpectrumAnalyzer(first);
+		for (int i = first; i < spectrumAnalyzerCount; i++) {
+			clockSimulatedNs = startNs;
+			simulationWaitNs = waitStartNs;
+			selectSpectrumAnalyzer(i);
+			work(i);
+			endNs = std::max(endNs, clockMonotonicNs());
+			waitNs = std::max(waitNs, simulationWaitNs - waitStartNs);
+		}
+		clockSimulatedNs = endNs;
+		simulationWaitNs = waitStartNs + waitNs;
+		selectSpectrumAnalyzer(previous);
+		return;
+	}
+	std::vector<std::thread> receiverThreads;
+	for (int i = first + 1; i < spectrumAnalyzerCount; i++) {
+		receiverThreads.push_back(std::thread([&work, i]() {
+			selectSpectrumAnalyzer(i);
+			work(i);
+		}));
+	}
+	if (first < spectrumAnalyzerCount) {
+		int previous = selectSpectrumAnalyzer(first);
+		work(first);
+		selectSpectrumAnalyzer(previous);
+	}
+	for (std::thread& receiverThread : receiverThreads) {
+		receiverThread.join();
+	}
 }
 
 void printDeviceStatus() // check which instruments are connected, print status to console, then send data to setup instruments if required
@@ -293,4 +447,12 @@ void printDeviceStatus() // check which instruments are connected, print status
 	else {
 		interfaceOut("Field Fox:           DISCONNECTED", false);
 	}
+
+	for (int i = 1; i < spectrumAnalyzerCount; i++) {
+		std::string label = "Receiver " + spectrumAnalyzers[i].name + ":";
+		while (label.length() < 21) {
+			label += " ";
+		}
+		interfaceOut(label + (deviceConnectionStatus[DEVICE_STATUS_INDEX_FIELDFOX + i] ? "CONNECTED" : "DISCONNECTED"), false);
+	}
 }
\ No newline at end of file
@@ -120,4 +120,14 @@ bool getProgFlag(int progFlagIndex, std::string *flagArgValue) {
 bool getProgFlag(int progFlagIndex) {
 	std::string tempStr = "";
 	return getProgFlag(progFlagIndex, &tempStr);
+}
+
+// for settings that come from somewhere other than argv (ie, a job file)
+void setProgFlag(int progFlagIndex, bool isSet, const std::string& flagArgValue) {
+	if (progFlagIndex < 0 || 26 <= progFlagIndex) {
+		std::cerr << "Bad arg flag index: " << std::to_string(progFlagIndex) << std::endl;
+		return;
+	}
+	progFlags[progFlagIndex] = isSet;
+	progFlagArgs[progFlagIndex] = isSet ? flagArgValue : "";
 }
\ No newline at end of file
@@ -0,0 +1,269 @@
+#pragma once
+// instrument configuration profiles (-u)
+// the first run with a given setup configures the instruments command by command, then saves that state on the
+// instruments themselves (*SAV on the generator, a state file on the fieldfox) along with a hash of the setup.
+// later runs with the same setup recall it in one command each, and check it with a single readback query per instrument
+
+#define PROFILE_FILE_DEFAULT (".chamber-profile.dat")
+#define PROFILE_FILE_VERSION (1)
+#define PROFILE_SIGNAL_GEN_REGISTER (7) // *SAV/*RCL register, away from the low ones people use from the front panel
+#define PROFILE_SPECTRUM_ANALYZER_STATE_FILE ("chamberOps.sta")
+
+#define PROFILE_SIGNAL_GEN_READBACK_VALUES (4)        // freq, power, modulation, output
+#define PROFILE_SPECTRUM_ANALYZER_READBACK_VALUES (6)  // start, stop, rbw, vbw, points, marker
+
+#include <string>
+#include <fstream>
+#include <cmath>
+
+#include "helperFunctions.h"
+#include "signalGenerator.h"
+#include "fieldfox.h"
+#include "scpiCommands.h"
+#include "scpiResponse.h"
+
+extern ViSession visaSignalGeneratorSession;
+extern visaReceiveBuffer visaSignalGeneratorReceive;
+
+// everything the sweep setup sends to the instruments
+struct instrumentSetup {
+	double signalGenFrequency = 0; // Hz
+	double signalGenPower = 0;     // dBm
+	double spectrumAnalyzerStart = 0;
+	double spectrumAnalyzerStop = 0;
+	double spectrumAnalyzerBwRes = DEFAULT_SPECTRUM_ANALYZER_BW_RES;
+	double spectrumAnalyzerBwVideo = DEFAULT_SPECTRUM_ANALYZER_VIDEO_BW_RES;
+	int spectrumAnalyzerPoints = DEFAULT_SPECTRUM_ANALYZER_POINTS;
+	std::string spectrumAnalyzerDetector = ""; // empty leaves the preset's detector alone
+	int spectrumAnalyzerAttenuation = -1;      // dB; -1 leaves the preset's (auto) attenuation alone
+	double markerFrequency = 0;
+};
+
+void setupFromTarget(instrumentSetup* setup, double targetFrequency, double targetPower) {
+	double frequencyRangeScale = DEFAULT_SPECTRUM_ANALYZER_RANGE_SCALE; // +/- a frequency offset, to create a window
+	(*setup).signalGenFrequency = targetFrequency;
+	(*setup).signalGenPower = targetPower;
+	(*setup).spectrumAnalyzerStart = targetFrequency - frequencyRangeScale;
+	(*setup).spectrumAnalyzerStop  = targetFrequency + frequencyRangeScale;
+	if ((*setup).spectrumAnalyzerStart < 0) { // fix potential negative frequencies
+		(*setup).spectrumAnalyzerStop  += std::fabs((*setup).spectrumAnalyzerStart);
+		(*setup).spectrumAnalyzerStart += std::fabs((*setup).spectrumAnalyzerStart);
+	}
+	(*setup).markerFrequency = targetFrequency;
+}
+
+// the selected analyzer's half of it; the other receivers get only this
+void applySpectrumAnalyzerSetup(const instrumentSetup& setup) {
+	presetSpectrumAnalyzer();
+	setSpectrumAnalyzerMode("SA");
+	setSpectrumAnalyzerRangeStart(setup.spectrumAnalyzerStart, 0);
+	setSpectrumAnalyzerRangeStop(setup.spectrumAnalyzerStop, 0);
+	setSpectrumAnalyzerBandWResolution(setup.spectrumAnalyzerBwRes, 0);
+	setSpectrumAnalyzerBandWVideo(setup.spectrumAnalyzerBwVideo, 0);
+	setSpectrumAnalyzerSweepPoints(setup.spectrumAnalyzerPoints);
+	if (!setup.spectrumAnalyzerDetector.empty()) {
+		setSpectrumAnalyzerDetector(setup.spectrumAnalyzerDetector);
+	}
+	if (setup.spectrumAnalyzerAttenuation >= 0) {
+		setSpectrumAnalyzerAttenuation(setup.spectrumAnalyzerAttenuation);
+	}
+	setSpectrumAnalyzerMarkerNormal(1, setup.markerFrequency, 0);
+}
+
+// the generator's half; leaves RF off
+void applySignalGenSetup(const instrumentSetup& setup) {
+	setSignalGenFreq(setup.signalGenFrequency, 0);
+	setSignalGenPower((float)setup.signalGenPower);
+	setSignalGenModOff();
+	setSignalGenOff();
+}
+
+// the same setup on another frequency and power: the SA window keeps its width and recentres on the tone, with the marker
+instrumentSetup retunedSetup(const instrumentSetup& setup, double frequency, double power) {
+	instrumentSetup retuned = setup;
+	double span = setup.spectrumAnalyzerStop - setup.spectrumAnalyzerStart;
+	retuned.signalGenFrequency = frequency;
+	retuned.signalGenPower = power;
+	retuned.spectrumAnalyzerStart = std::max(frequency - span / 2, 0.0);
+	retuned.spectrumAnalyzerStop = retuned.spectrumAnalyzerStart + span;
+	retuned.markerFrequency = frequency;
+	return retuned;
+}
+
+// just the selected analyzer's window and marker, without the preset; everything else it was set to stays
+void applySpectrumAnalyzerRetune(const instrumentSetup& setup) {
+	setSpectrumAnalyzerRangeStart(setup.spectrumAnalyzerStart, 0);
+	setSpectrumAnalyzerRangeStop(setup.spectrumAnalyzerStop, 0);
+	setSpectrumAnalyzerMarkerNormal(1, setup.markerFrequency, 0);
+}
+
+// the full command-by-command configuration
+void applyInstrumentSetup(const instrumentSetup& setup) {
+	applySignalGenSetup(setup);
+	applySpectrumAnalyzerSetup(setup);
+}
+
+// hashed over the commands the setup turns into, so anything that changes what gets sent changes the hash
+unsigned long long profileSetupHash(const instrumentSetup& setup) {
+	const scpiCommand commands[] = {
+		scpiFormat(SCPI_SIGNAL_GEN_FREQUENCY, setup.signalGenFrequency),
+		scpiFormat(SCPI_SIGNAL_GEN_POWER, setup.signalGenPower),
+		scpiFormat(SCPI_SIGNAL_GEN_MOD_OFF),
+		scpiFormat(SCPI_SIGNAL_GEN_OUTPUT_OFF),
+		scpiFormat(SCPI_SPECTRUM_ANALYZER_MODE, std::string("SA")),
+		scpiFormat(SCPI_SPECTRUM_ANALYZER_FREQ_START, setup.spectrumAnalyzerStart),
+		scpiFormat(SCPI_SPECTRUM_ANALYZER_FREQ_STOP, setup.spectrumAnalyzerStop),
+		scpiFormat(SCPI_SPECTRUM_ANALYZER_BW_RES, setup.spectrumAnalyzerBwRes),
+		scpiFormat(SCPI_SPECTRUM_ANALYZER_BW_VIDEO, setup.spectrumAnalyzerBwVideo),
+		scpiFormat(SCPI_SPECTRUM_ANALYZER_SWEEP_POINTS, setup.spectrumAnalyzerPoints),
+		scpiFormat(SCPI_SPECTRUM_ANALYZER_MARKER_X, setup.markerFrequency)
+	};
+	unsigned long long hash = HASH_START;
+	for (const scpiCommand& command : commands) {
+		hash = hashBytes(hash, command.text, command.length);
+	}
+	if (!setup.spectrumAnalyzerDetector.empty()) { // only when sent, so profiles saved without one still match
+		scpiCommand detector = scpiFormat(SCPI_SPECTRUM_ANALYZER_DETECTOR, setup.spectrumAnalyzerDetector);
+		hash = hashBytes(hash, detector.text, detector.length);
+	}
+	if (setup.spectrumAnalyzerAttenuation >= 0) { // the same
+		scpiCommand attenuation = scpiFormat(SCPI_SPECTRUM_ANALYZER_ATTENUATION, setup.spectrumAnalyzerAttenuation);
+		hash = hashBytes(hash, attenuation.text, attenuation.length);
+	}
+	return hash;
+}
+
+// readback values are rounded to a thousandth before hashing, so formatting differences don't matter
+unsigned long long profileDigest(const double* values, int count) {
+	unsigned long long hash = HASH_START;
+	for (int i = 0; i < count; i++) {
+		long long rounded = std::isfinite(values[i]) ? std::llround(values[i] * 1000) : 0;
+		hash = hashBytes(hash, &rounded, sizeof(rounded));
+	}
+	return hash;
+}
+
+// one query per instrument, answering every configured setting at once
+bool profileReadBack(double* signalGenValues, double* spectrumAnalyzerValues) {
+	std::string_view response;
+	responseStatus_t status = RESPONSE_OK;
+	visaCommand(&visaSignalGeneratorSession, scpiFormat(SCPI_SIGNAL_GEN_READBACK), &visaSignalGeneratorReceive, &response);
+	if (parseResponseList(response, signalGenValues, PROFILE_SIGNAL_GEN_READBACK_VALUES, &status) != PROFILE_SIGNAL_GEN_READBACK_VALUES) {
+		errorOut("Signal generator readback could not be read (" + responseStatusText(status) + "): \"" + std::string(response) + "\"");
+		return false;
+	}
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_READBACK), &(*spectrumAnalyzer).receiveText);
+	if (parseResponseList((*spectrumAnalyzer).receiveText, spectrumAnalyzerValues, PROFILE_SPECTRUM_ANALYZER_READBACK_VALUES, &status) != PROFILE_SPECTRUM_ANALYZER_READBACK_VALUES) {
+		errorOut("Spectrum analyzer readback could not be read (" + responseStatusText(status) + "): \"" + (*spectrumAnalyzer).receiveText + "\"");
+		return false;
+	}
+	return true;
+}
+
+// after a verified recall the shadows hold the real settings, so the setters that follow skip their writes
+void profileConfirmShadows(const double* signalGenValues, const double* spectrumAnalyzerValues) {
+	shadowConfirm(&signalGenShadow, SHADOW_SIGNAL_GEN_FREQUENCY, signalGenValues[0]);
+	shadowConfirm(&signalGenShadow, SHADOW_SIGNAL_GEN_POWER, signalGenValues[1]);
+	shadowConfirm(&signalGenShadow, SHADOW_SIGNAL_GEN_MODULATION, signalGenValues[2]);
+	shadowConfirm(&signalGenShadow, SHADOW_SIGNAL_GEN_OUTPUT, signalGenValues[3]);
+	shadowConfirm(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MODE, std::string("SA"));
+	shadowConfirm(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_START, spectrumAnalyzerValues[0]);
+	shadowConfirm(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_STOP, spectrumAnalyzerValues[1]);
+	shadowConfirm(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_BW_RES, spectrumAnalyzerValues[2]);
+	shadowConfirm(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_BW_VIDEO, spectrumAnalyzerValues[3]);
+	shadowConfirm(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_POINTS, spectrumAnalyzerValues[4]);
+	shadowConfirm(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MARKER_MODE, 1);
+	shadowConfirm(&(*spectrumAnalyzer).shadow, SHADOW_SPECTRUM_ANALYZER_MARKER_X, spectrumAnalyzerValues[5]);
+}
+
+struct instrumentProfile {
+	int version = 0;
+	unsigned long long setupHash = 0;
+	unsigned long long signalGenDigest = 0;
+	unsigned long long spectrumAnalyzerDigest = 0;
+};
+
+bool loadInstrumentProfile(instrumentProfile* profile) {
+	std::ifstream file(PROFILE_FILE_DEFAULT);
+	if (!file.is_open()) {
+		return false;
+	}
+	file >> (*profile).version >> std::hex >> (*profile).setupHash >> (*profile).signalGenDigest >> (*profile).spectrumAnalyzerDigest;
+	return !file.fail() && (*profile).version == PROFILE_FILE_VERSION;
+}
+
+bool writeInstrumentProfile(const instrumentProfile& profile) {
+	if (simulationActive) { // a simulated setup isn't one to recall on the real instruments
+		return true;
+	}
+	std::ofstream file(PROFILE_FILE_DEFAULT, std::ios::trunc);
+	if (!file.is_open()) {
+		return false;
+	}
+	file << profile.version << std::endl << std::hex
+		<< profile.setupHash << std::endl << profile.signalGenDigest << std::endl << profile.spectrumAnalyzerDigest << std::endl;
+	return !file.fail();
+}
+
+// true if the instruments were put in the profile's state and it read back correctly; false means configure normally
+bool restoreInstrumentProfile(const instrumentSetup& setup) {
+	instrumentProfile profile;
+	double signalGenValues[PROFILE_SIGNAL_GEN_READBACK_VALUES];
+	double spectrumAnalyzerValues[PROFILE_SPECTRUM_ANALYZER_READBACK_VALUES];
+	long long startNs = clockMonotonicNs();
+
+	if (!loadInstrumentProfile(&profile)) {
+		interfaceOut("No instrument profile yet; configuring normally, then saving one.", false);
+		return false;
+	}
+	if (profile.setupHash != profileSetupHash(setup)) {
+		interfaceOut("Instrument profile was saved for different settings; configuring normally, then replacing it.", false);
+		return false;
+	}
+	// a recall changes everything at once
+	shadowInvalidate(&signalGenShadow);
+	shadowInvalidate(&(*spectrumAnalyzer).shadow);
+	visaSend(&visaSignalGeneratorSession, scpiFormat(SCPI_SIGNAL_GEN_RECALL, PROFILE_SIGNAL_GEN_REGISTER));
+	bool recalled = isSignalGenReady();
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_STATE_LOAD, std::string(PROFILE_SPECTRUM_ANALYZER_STATE_FILE)), &(*spectrumAnalyzer).receiveText);
+	recalled = isSpectrumAnalyzerReady() && recalled;
+	if (!recalled || !profileReadBack(signalGenValues, spectrumAnalyzerValues)) {
+		errorOut("Instrument profile recall failed; configuring normally.");
+		return false;
+	}
+	if (profileDigest(signalGenValues, PROFILE_SIGNAL_GEN_READBACK_VALUES) != profile.signalGenDigest
+		|| profileDigest(spectrumAnalyzerValues, PROFILE_SPECTRUM_ANALYZER_READBACK_VALUES) != profile.spectrumAnalyzerDigest) {
+		errorOut("Instruments don't match the saved profile after recall (state changed on the instrument?); configuring normally.");
+		return false;
+	}
+	profileConfirmShadows(signalGenValues, spectrumAnalyzerValues);
+	interfaceOut("Instrument profile restored and verified in " + std::to_string(clockElapsedMs(startNs, clockMonotonicNs())) + " ms.", false);
+	return true;
+}
+
+// call right after applyInstrumentSetup()
+bool saveInstrumentProfile(const instrumentSetup& setup) {
+	instrumentProfile profile;
+	double signalGenValues[PROFILE_SIGNAL_GEN_READBACK_VALUES];
+	double spectrumAnalyzerValues[PROFILE_SPECTRUM_ANALYZER_READBACK_VALUES];
+
+	visaSend(&visaSignalGeneratorSession, scpiFormat(SCPI_SIGNAL_GEN_SAVE, PROFILE_SIGNAL_GEN_REGISTER));
+	bool saved = isSignalGenReady();
+	issueSpectrumAnalyzerCommand(scpiFormat(SCPI_SPECTRUM_ANALYZER_STATE_SAVE, std::string(PROFILE_SPECTRUM_ANALYZER_STATE_FILE)), &(*spectrumAnalyzer).receiveText);
+	saved = isSpectrumAnalyzerReady() && saved;
+	if (!saved || !profileReadBack(signalGenValues, spectrumAnalyzerValues)) {
+		errorOut("Could not save the instrument profile.");
+		return false;
+	}
+	profile.version = PROFILE_FILE_VERSION;
+	profile.setupHash = profileSetupHash(setup);
+	profile.signalGenDigest = profileDigest(signalGenValues, PROFILE_SIGNAL_GEN_READBACK_VALUES);
+	profile.spectrumAnalyzerDigest = profileDigest(spectrumAnalyzerValues, PROFILE_SPECTRUM_ANALYZER_READBACK_VALUES);
+	if (!writeInstrumentProfile(profile)) {
+		errorOut("Could not write " + std::string(PROFILE_FILE_DEFAULT));
+		return false;
+	}
+	profileConfirmShadows(signalGenValues, spectrumAnalyzerValues);
+	interfaceOut("Instrument profile saved; later runs with these settings can use -u to recall it.", false);
+	return true;
+}
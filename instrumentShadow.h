@@ -0,0 +1,152 @@
+#pragma once
+// shadow instrument state
+// each instrument keeps the last value it confirmed for every setting the drivers touch.
+// setters skip writes that wouldn't change anything (and the *OPC? that follows them), and getters answer
+// from the shadow until a verification is due - either the interval ran out, or shadowRequestVerify() was called.
+// presets, resets and reconnects must call shadowInvalidate(), since the instrument state is unknown after them
+
+#define SHADOW_MAX_SETTINGS (16)
+#define SHADOW_DEFAULT_VERIFY_INTERVAL (60000) // in ms; how long a readback can be answered from the shadow
+
+// signal generator settings
+#define SHADOW_SIGNAL_GEN_FREQUENCY  (0)
+#define SHADOW_SIGNAL_GEN_POWER      (1)
+#define SHADOW_SIGNAL_GEN_OUTPUT     (2)
+#define SHADOW_SIGNAL_GEN_MODULATION (3)
+
+// spectrum analyzer settings
+#define SHADOW_SPECTRUM_ANALYZER_MODE        (0)
+#define SHADOW_SPECTRUM_ANALYZER_START       (1)
+#define SHADOW_SPECTRUM_ANALYZER_STOP        (2)
+#define SHADOW_SPECTRUM_ANALYZER_BW_RES      (3)
+#define SHADOW_SPECTRUM_ANALYZER_BW_VIDEO    (4)
+#define SHADOW_SPECTRUM_ANALYZER_POINTS      (5)
+#define SHADOW_SPECTRUM_ANALYZER_CONTINUOUS  (6)
+#define SHADOW_SPECTRUM_ANALYZER_MARKER_MODE (7) // marker 1 only - the one read for data
+#define SHADOW_SPECTRUM_ANALYZER_MARKER_X    (8)
+#define SHADOW_SPECTRUM_ANALYZER_DETECTOR    (9)
+#define SHADOW_SPECTRUM_ANALYZER_CENTER      (10)
+#define SHADOW_SPECTRUM_ANALYZER_SPAN        (11)
+#define SHADOW_SPECTRUM_ANALYZER_SWEEP_TIME  (12)
+#define SHADOW_SPECTRUM_ANALYZER_ATTENUATION (13)
+
+#include <string>
+#include <cmath>
+
+#include "chamberClock.h"
+
+struct shadowSetting {
+	bool known = false;
+	double value = 0;
+	std::string text = ""; // for settings that are names rather than numbers (ie, SA mode)
+	long long confirmedNs = 0; // when the instrument last acknowledged or read back this value
+};
+
+struct instrumentShadow {
+	std::string name = "";
+	shadowSetting settings[SHADOW_MAX_SETTINGS];
+	long long verifyIntervalMs = SHADOW_DEFAULT_VERIFY_INTERVAL;
+	long long verifyRequestedNs = 0; // settings confirmed before this have to be read back again
+	long long savedTransactions = 0; // round trips (commands, queries, *OPC? checks) that never went out
+	long long verifyMismatches = 0;  // readbacks that disagreed with the shadow
+};
+
+void shadowInvalidate(instrumentShadow* shadow) {
+	for (int i = 0; i < SHADOW_MAX_SETTINGS; i++) {
+		(*shadow).settings[i].known = false;
+	}
+}
+
+void setShadowVerifyInterval(instrumentShadow* shadow, long long intervalMs) {
+	(*shadow).verifyIntervalMs = intervalMs;
+}
+
+void shadowRequestVerify(instrumentShadow* shadow) { // next readback of every setting goes to the instrument
+	(*shadow).verifyRequestedNs = clockMonotonicNs();
+}
+
+bool shadowSameValue(double a, double b) {
+	double scale = std::fmax(1.0, std::fmax(std::fabs(a), std::fabs(b)));
+	return std::fabs(a - b) <= 1e-9 * scale;
+}
+
+bool shadowVerifyDue(instrumentShadow* shadow, int setting) {
+	const shadowSetting& s = (*shadow).settings[setting];
+	return !s.known || s.confirmedNs <= (*shadow).verifyRequestedNs
+		|| clockElapsedMs(s.confirmedNs, clockMonotonicNs()) >= (*shadow).verifyIntervalMs;
+}
+
+// call after the instrument acknowledged a write; the new value replaces the old one, which is no mismatch
+void shadowWritten(instrumentShadow* shadow, int setting, double value) {
+	shadowSetting& s = (*shadow).settings[setting];
+	s.known = true;
+	s.value = value;
+	s.confirmedNs = clockMonotonicNs();
+}
+
+void shadowWritten(instrumentShadow* shadow, int setting, const std::string& text) {
+	shadowSetting& s = (*shadow).settings[setting];
+	s.known = true;
+	s.text = text;
+	s.confirmedNs = clockMonotonicNs();
+}
+
+// call after the instrument answered a readback
+// returns false if a previously confirmed value disagrees (someone changed it on the front panel, or it was clamped)
+bool shadowConfirm(instrumentShadow* shadow, int setting, double value) {
+	shadowSetting& s = (*shadow).settings[setting];
+	bool matched = !s.known || shadowSameValue(s.value, value);
+	if (!matched) {
+		(*shadow).verifyMismatches++;
+	}
+	s.known = true;
+	s.value = value;
+	s.confirmedNs = clockMonotonicNs();
+	return matched;
+}
+
+bool shadowConfirm(instrumentShadow* shadow, int setting, const std::string& text) {
+	shadowSetting& s = (*shadow).settings[setting];
+	bool matched = !s.known || s.text == text;
+	if (!matched) {
+		(*shadow).verifyMismatches++;
+	}
+	s.known = true;
+	s.text = text;
+	s.confirmedNs = clockMonotonicNs();
+	return matched;
+}
+
+void shadowForget(instrumentShadow* shadow, int setting) { // a write failed, so the instrument could be in either state
+	(*shadow).settings[setting].known = false;
+}
+
+// setters: true means the instrument already has this value, and the write (plus its checks) can be skipped.
+// once a verification is due the write goes out anyway, which re-confirms the value for free
+bool shadowSkipWrite(instrumentShadow* shadow, int setting, double value, int transactionsSaved) {
+	const shadowSetting& s = (*shadow).settings[setting];
+	if (!shadowVerifyDue(shadow, setting) && shadowSameValue(s.value, value)) {
+		(*shadow).savedTransactions += transactionsSaved;
+		return true;
+	}
+	return false;
+}
+
+bool shadowSkipWrite(instrumentShadow* shadow, int setting, const std::string& text, int transactionsSaved) {
+	const shadowSetting& s = (*shadow).settings[setting];
+	if (!shadowVerifyDue(shadow, setting) && s.text == text) {
+		(*shadow).savedTransactions += transactionsSaved;
+		return true;
+	}
+	return false;
+}
+
+// getters: true (and *value set) when the readback can be answered without asking the instrument
+bool shadowRead(instrumentShadow* shadow, int setting, double* value) {
+	if (shadowVerifyDue(shadow, setting)) {
+		return false;
+	}
+	*value = (*shadow).settings[setting].value;
+	(*shadow).savedTransactions++;
+	return true;
+}
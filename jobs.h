@@ -0,0 +1,278 @@
+#pragma once
+// batch job files (-j file)
+// a queue of sweeps and boresight searches, run back to back on one set of instrument sessions, with the
+// prompts answered by policy instead of waiting at the keyboard. the whole file is checked before anything runs.
+//
+//   # comment
+//   [policy]              overwrite = y|n (savestate of an interrupted job), savestate = y|n (inspection savestates)
+//   [defaults]            any job key; applies to every job after it
+//   [job <name>]          one job, in file order
+//     sweep = azimuthMin,azimuthMax,elevationMin,elevationMax[,aziDensity,elevDensity]   (as -s)
+//     boresight = azimuthMin,azimuthMax,elevationMin,elevationMax[,tolerance]              (as -e, instead of sweep)
+//     frequency = Hz, power = dBm, output = file, compress = y|n,
+//     sampling = (as -g), acquisition = (as -t), keeprf = y|n, references = (as -n), adaptive = (as -x)
+
+#define JOB_BORESIGHT_PROBE_ESTIMATE (60) // probes a boresight search usually takes, for the ETA
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include "helperFunctions.h"
+#include "signalGenerator.h"
+#include "acquisition.h"
+#include "reference.h"
+#include "adaptive.h"
+#include "sampling.h"
+#include "boresight.h"
+
+enum jobStatus_t {
+	JOB_PENDING,
+	JOB_DONE,
+	JOB_FAILED,
+	JOB_STOPPED // ctrl+c; the rest of the queue doesn't run
+};
+const char* JOB_STATUS_NAMES[] = { "pending", "done", "FAILED", "stopped" }; // same order as jobStatus_t
+
+struct batchJob {
+	std::string name = "";
+	int line = 0; // of the [job] header
+	bool hasSweep = false;
+	samplingRange range = { 0, 0, 0, 0, 1, 1 };
+	samplingScheme_t scheme = SAMPLING_GRID;
+	boresightWindow boresight;
+	long long frequency = -1;
+	double power = 0;
+	std::string output = "";
+	bool compress = false;
+	acquisitionSettings acquisition;
+	referenceSchedule references;
+	adaptivePlan adaptive;
+
+	// filled in by the run
+	jobStatus_t status = JOB_PENDING;
+	int positions = 0;
+	int positionsDone = 0;
+	long long estimateMs = 0;
+	long long elapsedMs = 0;
+	std::string failure = "";
+};
+
+std::string_view jobTrim(std::string_view text) {
+	size_t first = text.find_first_not_of(" \t\r");
+	if (first == std::string_view::npos) {
+		return std::string_view();
+	}
+	size_t last = text.find_last_not_of(" \t\r");
+	return text.substr(first, last - first + 1);
+}
+
+// the line starting at *start, trimmed, and *start moved past it; false once the text is used up
+bool jobNextLine(const std::string& text, size_t* start, std::string_view* line) {
+	if (*start > text.size()) {
+		return false;
+	}
+	size_t newline = text.find('\n', *start);
+	*line = jobTrim(std::string_view(text).substr(*start, (newline == std::string::npos) ? std::string::npos : newline - *start));
+	*start = (newline == std::string::npos) ? text.size() + 1 : newline + 1;
+	return true;
+}
+
+bool jobParseYesNo(std::string_view value, bool* result) {
+	if (value == "y" || value == "yes" || value == "1") {
+		*result = true;
+	} else if (value == "n" || value == "no" || value == "0") {
+		*result = false;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+// one key = value line into a job; false (with *problem set) if it doesn't make sense
+bool jobSetKey(batchJob* job, std::string_view key, std::string_view value, std::string* problem) {
+	std::string text(value);
+	char* end = nullptr;
+	bool ok = true;
+	if (key == "sweep") {
+		ok = parseSamplingRange(text, &((*job).range));
+		(*job).hasSweep = ok;
+		(*job).boresight.enabled = false;
+	} else if (key == "boresight") {
+		ok = parseBoresightArgument(text, &((*job).boresight));
+		(*job).hasSweep = false;
+	} else if (key == "frequency") {
+		double frequency = strtod(text.c_str(), &end);
+		ok = (end != text.c_str() && *end == '\0' && 0 <= frequency && frequency <= 1000000000000);
+		(*job).frequency = (long long)std::llround(frequency);
+	} else if (key == "power") {
+		(*job).power = strtod(text.c_str(), &end);
+		ok = (end != text.c_str() && *end == '\0' && SIG_GEN_MIN_POWER <= (*job).power && (*job).power <= SIG_GEN_MAX_POWER);
+	} else if (key == "output") {
+		(*job).output = text;
+		ok = !text.empty();
+	} else if (key == "compress") {
+		ok = jobParseYesNo(value, &((*job).compress));
+	} else if (key == "sampling") {
+		ok = parseSamplingScheme(text, &((*job).scheme));
+	} else if (key == "acquisition") {
+		ok = parseAcquisitionArgument(text, &((*job).acquisition));
+	} else if (key == "keeprf") {
+		ok = jobParseYesNo(value, &((*job).acquisition.keepRfOn));
+	} else if (key == "references") {
+		ok = parseReferenceArgument(text, &((*job).references));
+	} else if (key == "adaptive") {
+		ok = parseAdaptiveArgument(text, &((*job).adaptive));
+	} else {
+		*problem = "unknown key \"" + std::string(key) + "\"";
+		return false;
+	}
+	if (!ok) {
+		*problem = "bad value for " + std::string(key) + ": \"" + text + "\"";
+	}
+	return ok;
+}
+
+// what a job needs before it can run
+bool jobIsComplete(const batchJob& job, std::string* problem) {
+	if (!job.hasSweep && !job.boresight.enabled) {
+		*problem = "needs a sweep or a boresight window";
+	} else if (job.frequency < 0 && !getProgFlag(M_FLAG_INDEX)) {
+		*problem = "needs a frequency (or -m, for the manual settings)";
+	} else if (job.hasSweep && job.adaptive.enabled && job.scheme != SAMPLING_GRID) {
+		*problem = "adaptive refinement needs the grid sampling plan";
+	} else {
+		return true;
+	}
+	return false;
+}
+
+bool jobPolicyKey(std::string_view key, std::string_view value, std::string* problem) {
+	bool answer = false;
+	if (!jobParseYesNo(value, &answer)) {
+		*problem = "policy answers are y or n";
+		return false;
+	}
+	if (key == "overwrite") {
+		promptPolicy[PROMPT_OVERWRITE] = answer ? 'y' : 'n';
+	} else if (key == "savestate") {
+		promptPolicy[PROMPT_SAVESTATE] = answer ? 'y' : 'n';
+	} else {
+		*problem = "unknown policy \"" + std::string(key) + "\"";
+		return false;
+	}
+	return true;
+}
+
+// checks the whole text; false (nothing queued) on the first problem. sets the prompt policy too.
+// commandLine has the settings from the other flags, which the text's [defaults] and jobs then override.
+// fileName is only for the messages
+bool parseJobText(const std::string& text, const std::string& fileName, const batchJob& commandLine, std::vector<batchJob>* jobs) {
+	// batch defaults: always go ahead, and keep an interrupted job's savestate
+	promptPolicy[PROMPT_PROCEED] = 'y';
+	promptPolicy[PROMPT_SAVESTATE] = 'n';
+	promptPolicy[PROMPT_OVERWRITE] = 'y';
+	promptPolicy[PROMPT_COMMAND_LINE] = 'y';
+
+	enum { SECTION_NONE, SECTION_POLICY, SECTION_DEFAULTS, SECTION_JOB } section = SECTION_NONE;
+	batchJob defaults = commandLine;
+	batchJob* current = nullptr;
+	std::string problem = "";
+	int lineNumber = 0;
+	(*jobs).clear();
+	size_t start = 0;
+	std::string_view line;
+	while (jobNextLine(text, &start, &line)) {
+		lineNumber++;
+		if (line.empty() || line[0] == '#' || line[0] == ';') {
+			continue;
+		}
+		if (line.front() == '[') {
+			if (line.back() != ']') {
+				problem = "unclosed section header";
+			} else if (line == "[policy]") {
+				section = SECTION_POLICY;
+			} else if (line == "[defaults]") {
+				section = SECTION_DEFAULTS;
+			} else if (line.substr(0, 5) == "[job " || line == "[job]") {
+				section = SECTION_JOB;
+				(*jobs).push_back(defaults);
+				current = &((*jobs).back());
+				(*current).name = std::string(jobTrim(line.substr(4, line.size() - 5)));
+				(*current).line = lineNumber;
+				if ((*current).name.empty()) {
+					(*current).name = "job " + std::to_string((*jobs).size());
+				}
+			} else {
+				problem = "unknown section " + std::string(line);
+			}
+		} else {
+			size_t equals = line.find('=');
+			if (equals == std::string_view::npos) {
+				problem = "expected key = value";
+			} else {
+				std::string_view key = jobTrim(line.substr(0, equals));
+				std::string_view value = jobTrim(line.substr(equals + 1));
+				if (section == SECTION_POLICY) {
+					jobPolicyKey(key, value, &problem);
+				} else if (section == SECTION_DEFAULTS) {
+					jobSetKey(&defaults, key, value, &problem);
+				} else if (section == SECTION_JOB) {
+					jobSetKey(current, key, value, &problem);
+				} else {
+					problem = "key outside of a section";
+				}
+			}
+		}
+		if (!problem.empty()) {
+			errorOut(fileName + " line " + std::to_string(lineNumber) + ": " + problem);
+			return false;
+		}
+	}
+	for (const batchJob& job : *jobs) {
+		if (!jobIsComplete(job, &problem)) {
+			errorOut(fileName + " line " + std::to_string(job.line) + " (" + job.name + "): " + problem);
+			return false;
+		}
+	}
+	if ((*jobs).empty()) {
+		errorOut(fileName + " has no jobs.");
+		return false;
+	}
+	return true;
+}
+
+bool parseJobFile(const std::string& fileName, const batchJob& commandLine, std::vector<batchJob>* jobs) {
+	std::ifstream file(fileName);
+	if (!file.is_open()) {
+		errorOut("Could not open job file " + fileName);
+		return false;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	return parseJobText(contents.str(), fileName, commandLine, jobs);
+}
+
+long long jobQueueRemainingMs(const std::vector<batchJob>& jobs) {
+	long long remaining = 0;
+	for (const batchJob& job : jobs) {
+		if (job.status == JOB_PENDING) {
+			remaining += job.estimateMs;
+		}
+	}
+	return remaining;
+}
+
+std::string jobMinutesText(long long ms) {
+	return std::to_string(ms / 1000 / 60) + " min " + std::to_string(ms / 1000 % 60) + " sec";
+}
+
+void printJobSummary(const batchJob& job) {
+	interfaceOut("Job " + job.name + ": " + JOB_STATUS_NAMES[job.status]
+		+ (job.hasSweep ? ", " + std::to_string(job.positionsDone) + "/" + std::to_string(job.positions) + " positions" : ", boresight")
+		+ " in " + jobMinutesText(job.elapsedMs) + " (estimated " + jobMinutesText(job.estimateMs) + ")"
+		+ (job.output.empty() ? "" : ", results in " + job.output)
+		+ (job.failure.empty() ? "" : " - " + job.failure), false);
+}
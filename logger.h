@@ -0,0 +1,212 @@
+#pragma once
+// asynchronous program logger
+// messages are copied into a bounded ring buffer, and a background thread does all formatting and I/O,
+// so the sweep loop and instrument helpers never wait on the console or the log file
+
+#define LOG_FILE_DEFAULT ("chamberTurntable.log")
+
+#define LOG_RING_CAPACITY (512)
+#define LOG_MESSAGE_MAX_LENGTH (480) // longer messages are truncated
+#define LOG_FLUSH_TIMEOUT (2000) // in ms
+
+#include <string>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdlib> // for atexit()
+
+#include "chamberClock.h"
+
+enum logSeverity_t {
+	LOG_SEVERITY_DEBUG, LOG_SEVERITY_INFO, LOG_SEVERITY_WARNING, LOG_SEVERITY_ERROR
+};
+
+enum logDestination_t {
+	LOG_DESTINATION_STDOUT, LOG_DESTINATION_STDERR, LOG_DESTINATION_FILE
+};
+
+struct logEntry {
+	long long timestampNs; // monotonic, taken by the caller
+	logSeverity_t severity;
+	logDestination_t destination;
+	bool showTimestamp;
+	int length;
+	char text[LOG_MESSAGE_MAX_LENGTH];
+};
+
+// ring buffer - only touched while holding logMutex, except for slots the writer thread has claimed
+logEntry logRing[LOG_RING_CAPACITY];
+int logRingTail  = 0; // next entry to be written out
+int logRingCount = 0; // entries queued, including ones the writer is currently working on
+int logRingInFlight = 0; // entries claimed by the writer, but not yet released
+long long logDroppedMessages = 0;
+bool logStopRequested = false;
+
+std::mutex logMutex;
+std::condition_variable logWakeWriter;
+std::condition_variable logWakeFlush;
+std::thread logWriterThread;
+std::once_flag logStartFlag;
+std::ofstream logFile; // opened once, on first use
+
+// writer-side state for collapsing repeated messages (only used on the writer thread)
+std::string logLastText = "";
+logDestination_t logLastDestination = LOG_DESTINATION_STDOUT;
+int logLastRepeats = 0;
+
+void logStop();
+
+// also handed every console message, on the writer thread, so nothing waits on it (see daemon.h)
+typedef void (*logSink_t)(logSeverity_t severity, const std::string& text);
+std::atomic<logSink_t> logEventSink(nullptr);
+
+std::string logSeverityName(logSeverity_t severity) {
+	switch (severity) {
+	case LOG_SEVERITY_DEBUG:   return "DEBUG";
+	case LOG_SEVERITY_INFO:    return "INFO";
+	case LOG_SEVERITY_WARNING: return "WARN";
+	case LOG_SEVERITY_ERROR:   return "ERROR";
+	default:                   return "?";
+	}
+}
+
+std::ostream& logStream(logDestination_t destination) {
+	if (destination == LOG_DESTINATION_FILE) {
+		if (!logFile.is_open()) {
+			logFile.open(LOG_FILE_DEFAULT, std::ios_base::app);
+		}
+		if (logFile.is_open()) {
+			return logFile;
+		}
+		return std::cerr; // could not open the log file, so don't lose the message
+	} else if (destination == LOG_DESTINATION_STDERR) {
+		return std::cerr;
+	}
+	return std::cout;
+}
+
+void logWriteLine(logDestination_t destination, bool showTimestamp, long long timestampNs, logSeverity_t severity, const std::string& text) {
+	std::ostream& out = logStream(destination);
+	if (showTimestamp) {
+		// UTC, like the old chamberTimestamp(); the log file is appended to across runs, and lines get matched to result rows
+		out << clockFormatUtc(clockMonotonicToUtcNs(timestampNs)) << " [" << logSeverityName(severity) << "] ";
+	}
+	out << text << '\n';
+}
+
+void logWriteRepeatSummary() {
+	if (logLastRepeats > 0) {
+		logStream(logLastDestination) << "(previous message repeated " << logLastRepeats << " times)" << '\n';
+		logLastRepeats = 0;
+	}
+}
+
+void logWriteEntry(const logEntry& entry) {
+	std::string text(entry.text, entry.length);
+	// collapse floods of identical warnings/errors (ie, a device that stopped responding) into one line
+	if (entry.severity >= LOG_SEVERITY_WARNING && entry.destination == logLastDestination && text == logLastText) {
+		logLastRepeats++;
+		return;
+	}
+	logWriteRepeatSummary();
+	logWriteLine(entry.destination, entry.showTimestamp, entry.timestampNs, entry.severity, text);
+	logSink_t sink = logEventSink;
+	if (sink != nullptr && entry.destination != LOG_DESTINATION_FILE) {
+		sink(entry.severity, text);
+	}
+	logLastText = text;
+	logLastDestination = entry.destination;
+}
+
+void logWriterLoop() {
+	std::unique_lock<std::mutex> lock(logMutex);
+	while (true) {
+		logWakeWriter.wait(lock, [] { return logRingCount > 0 || logDroppedMessages > 0 || logStopRequested; });
+		if (logRingCount == 0 && logDroppedMessages == 0 && logStopRequested) {
+			break;
+		}
+		// claim everything queued so far; producers can't reuse these slots until they are released
+		int first = logRingTail;
+		logRingInFlight = logRingCount;
+		long long dropped = logDroppedMessages;
+		logDroppedMessages = 0;
+		lock.unlock();
+
+		for (int i = 0; i < logRingInFlight; i++) {
+			logWriteEntry(logRing[(first + i) % LOG_RING_CAPACITY]);
+		}
+		// nothing else queued behind this batch, so there is no more repetition to collapse
+		logWriteRepeatSummary();
+		if (dropped > 0) {
+			logStream(LOG_DESTINATION_STDERR) << "[log] " << dropped << " messages were dropped (log queue full)" << '\n';
+		}
+		std::cout.flush();
+		std::cerr.flush();
+		if (logFile.is_open()) { logFile.flush(); }
+
+		lock.lock();
+		logRingTail = (logRingTail + logRingInFlight) % LOG_RING_CAPACITY;
+		logRingCount -= logRingInFlight;
+		logRingInFlight = 0;
+		logWakeFlush.notify_all();
+	}
+	if (logFile.is_open()) { logFile.close(); }
+}
+
+void logStart() {
+	std::call_once(logStartFlag, [] {
+		logWriterThread = std::thread(logWriterLoop);
+		atexit(logStop); // exit() is used all over the program, make sure the queue still gets written
+	});
+}
+
+// never blocks on I/O; returns false if the message had to be dropped
+bool logMessage(logSeverity_t severity, logDestination_t destination, bool showTimestamp, const std::string& mesg) {
+	long long timestampNs = clockMonotonicNs();
+	logStart();
+	{
+		std::lock_guard<std::mutex> lock(logMutex);
+		if (logRingCount >= LOG_RING_CAPACITY || logStopRequested) {
+			logDroppedMessages++;
+			return false;
+		}
+		logEntry& entry = logRing[(logRingTail + logRingCount) % LOG_RING_CAPACITY];
+		entry.timestampNs   = timestampNs;
+		entry.severity      = severity;
+		entry.destination   = destination;
+		entry.showTimestamp = showTimestamp;
+		entry.length = (int)((mesg.length() < LOG_MESSAGE_MAX_LENGTH) ? mesg.length() : LOG_MESSAGE_MAX_LENGTH);
+		memcpy(entry.text, mesg.data(), entry.length);
+		logRingCount++;
+	}
+	logWakeWriter.notify_one();
+	return true;
+}
+
+// wait for queued messages to reach the console/file; needed before prompting the user
+bool logFlush() {
+	std::unique_lock<std::mutex> lock(logMutex);
+	if (!logWriterThread.joinable()) {
+		return true; // nothing was ever logged
+	}
+	logWakeWriter.notify_one();
+	return logWakeFlush.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_TIMEOUT),
+		[] { return logRingCount == 0 && logDroppedMessages == 0; });
+}
+
+void logStop() {
+	{
+		std::lock_guard<std::mutex> lock(logMutex);
+		logStopRequested = true;
+	}
+	logWakeWriter.notify_one();
+	if (logWriterThread.joinable() && logWriterThread.get_id() != std::this_thread::get_id()) {
+		logWriterThread.join();
+	}
+}
@@ -0,0 +1,471 @@
+#pragma once
+// plan files (-l file)
+// a whole sweep in one file, instead of -s's positional arguments, -f/-p, and the #defines for the SA settings and
+// instrument addresses. same layout as job files (see jobs.h): sections, then key = value lines.
+//
+//   [axes]      azimuth = min:max:step or a,b,c   elevation = (same)   sampling = (as -g; needs the min:max:step form)
+//   [signal]    frequency = Hz list or min:max:step   power = whole dBm list or min:max:step (default 0)
+//   [acquisition]  mode = (as -t)  settling = ms  sweeps = per position  keeprf = y|n  references = (as -n)  adaptive = (as -x)
+//   [analyzer]  span = Hz  rbw = Hz  vbw = Hz  points = n  detector = name    (anything left out keeps the default)
+//   [endpoints] fieldfox = ip[:port]  bind = ip  azimuth = visa address  elevation = visa address  generator = visa address
+//   [receivers] name = ip[:port]  (one line per analyzer measuring alongside the fieldfox, ie cross = 192.168.0.3)
+//   [output]    file = name  compress = y|n
+//
+// each receiver gets the fieldfox's analyzer settings, measures every position at the same time as it, and writes
+// its rows to the output file with its name before the extension (ie chamberTurntable.cross.csv), so a
+// dual polarisation run is one pass of the turntable rather than two.
+// every frequency and power is a full pass over the positions (frequency outermost), so the generator and analyzer
+// are only retuned between passes. the file is checked completely before anything is connected
+
+#define PLAN_LIST_MAX (100000)        // values in any one list
+#define PLAN_POSITIONS_MAX (10000000)
+#define PLAN_SWEEPS_MAX (1000)
+#define PLAN_POINTS_MAX (10001)
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cctype>
+
+#include "helperFunctions.h"
+#include "signalGenerator.h"
+#include "positions.h"
+#include "acquisition.h"
+#include "reference.h"
+#include "adaptive.h"
+#include "sampling.h"
+#include "jobs.h"
+#include "instrumentProfile.h"
+#include "chamberClock.h"
+
+// a list given as min:max:step keeps its range, for the sampling schemes
+struct planAxis {
+	std::vector<double> values;
+	bool isRange = false;
+	double min = 0;
+	double max = 0;
+	double step = 0;
+};
+
+struct planAnalyzer {
+	double span = 0;    // Hz; 0 keeps the default
+	double bwRes = 0;
+	double bwVideo = 0;
+	int points = 0;
+	std::string detector = "";
+};
+
+struct planEndpoints {
+	std::string fieldFoxIP = "";  // empty keeps the built-in address
+	int fieldFoxPort = 0;
+	std::string bindIP = "";
+	std::string azimuth = "";
+	std::string elevation = "";
+	std::string generator = "";
+};
+
+struct planReceiver {
+	std::string name = ""; // letters, digits, - and _, since it goes in a file name
+	std::string ip = "";
+	int port = 5024;
+};
+
+struct sweepPlan {
+	bool loaded = false;
+	planAxis azimuth;
+	planAxis elevation;
+	samplingScheme_t scheme = SAMPLING_GRID;
+	planAxis frequency;
+	planAxis power;
+	acquisitionSettings acquisition;
+	referenceSchedule references;
+	adaptivePlan adaptive;
+	planAnalyzer analyzer;
+	planEndpoints endpoints;
+	std::vector<planReceiver> receivers; // besides the fieldfox, up to SPECTRUM_ANALYZERS_MAX - 1
+	std::string output = "";
+	bool compress = false;
+};
+sweepPlan activePlan;
+
+// "min:max:step" (step > 0, both ends included) or "a,b,c"
+bool parsePlanAxis(std::string_view text, planAxis* axis) {
+	std::string value(text);
+	char* end = nullptr;
+	*axis = planAxis();
+	if (value.find(':') != std::string::npos) {
+		double parts[3];
+		const char* c = value.c_str();
+		for (int i = 0; i < 3; i++) {
+			parts[i] = strtod(c, &end);
+			if (end == c || !std::isfinite(parts[i]) || *end != ((i < 2) ? ':' : '\0')) {
+				return false;
+			}
+			c = end + 1;
+		}
+		if (parts[0] > parts[1] || !(parts[2] > 0) || (parts[1] - parts[0]) / parts[2] >= PLAN_LIST_MAX) {
+			return false;
+		}
+		(*axis).isRange = true;
+		(*axis).min = parts[0];
+		(*axis).max = parts[1];
+		(*axis).step = parts[2];
+		int count = (int)std::round((parts[1] - parts[0]) / parts[2]) + 1; // like createPositionTargets()
+		for (int i = 0; i < count; i++) {
+			(*axis).values.push_back((count == 1) ? parts[0] : parts[0] + (parts[1] - parts[0]) * i / (count - 1));
+		}
+		return true;
+	}
+	const char* c = value.c_str();
+	do {
+		double v = strtod(c, &end);
+		if (end == c || !std::isfinite(v) || (*axis).values.size() >= PLAN_LIST_MAX) {
+			return false;
+		}
+		(*axis).values.push_back(v);
+		while (*end == ' ') {
+			end++;
+		}
+		c = end + 1;
+	} while (*end == ',');
+	return *end == '\0';
+}
+
+bool parsePlanNumber(std::string_view text, double* value) {
+	std::string number(text);
+	char* end = nullptr;
+	*value = strtod(number.c_str(), &end);
+	return end != number.c_str() && *end == '\0' && std::isfinite(*value) && *value >= 0;
+}
+
+bool planSetKey(sweepPlan* plan, std::string_view section, std::string_view key, std::string_view value, std::string* problem) {
+	std::string text(value);
+	double number = 0;
+	bool ok = true;
+	bool known = true;
+	if (section == "axes") {
+		if (key == "azimuth") {
+			ok = parsePlanAxis(value, &((*plan).azimuth));
+		} else if (key == "elevation") {
+			ok = parsePlanAxis(value, &((*plan).elevation));
+		} else if (key == "sampling") {
+			ok = parseSamplingScheme(text, &((*plan).scheme));
+		} else {
+			known = false;
+		}
+	} else if (section == "signal") {
+		if (key == "frequency") {
+			ok = parsePlanAxis(value, &((*plan).frequency));
+		} else if (key == "power") {
+			ok = parsePlanAxis(value, &((*plan).power));
+		} else {
+			known = false;
+		}
+	} else if (section == "acquisition") {
+		if (key == "mode") {
+			ok = parseAcquisitionMode(text, &((*plan).acquisition.mode));
+		} else if (key == "settling") {
+			ok = parsePlanNumber(value, &number) && number <= ACQUISITION_SETTLING_TIME_MAX;
+			(*plan).acquisition.settlingTime = (int)number;
+		} else if (key == "sweeps") {
+			ok = parsePlanNumber(value, &number) && 1 <= number && number <= PLAN_SWEEPS_MAX;
+			(*plan).acquisition.sweepsPerPosition = (int)number;
+		} else if (key == "keeprf") {
+			ok = jobParseYesNo(value, &((*plan).acquisition.keepRfOn));
+		} else if (key == "references") {
+			ok = parseReferenceArgument(text, &((*plan).references));
+		} else if (key == "adaptive") {
+			ok = parseAdaptiveArgument(text, &((*plan).adaptive));
+		} else {
+			known = false;
+		}
+	} else if (section == "analyzer") {
+		if (key == "span") {
+			ok = parsePlanNumber(value, &((*plan).analyzer.span)) && (*plan).analyzer.span > 0;
+		} else if (key == "rbw") {
+			ok = parsePlanNumber(value, &((*plan).analyzer.bwRes)) && (*plan).analyzer.bwRes > 0;
+		} else if (key == "vbw") {
+			ok = parsePlanNumber(value, &((*plan).analyzer.bwVideo)) && (*plan).analyzer.bwVideo > 0;
+		} else if (key == "points") {
+			ok = parsePlanNumber(value, &number) && 2 <= number && number <= PLAN_POINTS_MAX;
+			(*plan).analyzer.points = (int)number;
+		} else if (key == "detector") {
+			(*plan).analyzer.detector = text;
+			ok = !text.empty();
+		} else {
+			known = false;
+		}
+	} else if (section == "endpoints") {
+		if (key == "fieldfox") {
+			size_t colon = text.find(':');
+			(*plan).endpoints.fieldFoxIP = text.substr(0, colon);
+			ok = !(*plan).endpoints.fieldFoxIP.empty();
+			if (colon != std::string::npos) {
+				ok = ok && parsePlanNumber(value.substr(colon + 1), &number) && 1 <= number && number <= 65535;
+				(*plan).endpoints.fieldFoxPort = (int)number;
+			}
+		} else if (key == "bind") {
+			(*plan).endpoints.bindIP = text;
+		} else if (key == "azimuth") {
+			(*plan).endpoints.azimuth = text;
+		} else if (key == "elevation") {
+			(*plan).endpoints.elevation = text;
+		} else if (key == "generator") {
+			(*plan).endpoints.generator = text;
+		} else {
+			known = false;
+		}
+		ok = ok && !text.empty();
+	} else if (section == "receivers") {
+		planReceiver receiver;
+		size_t colon = text.find(':');
+		receiver.name = std::string(key);
+		receiver.ip = text.substr(0, colon);
+		ok = !receiver.ip.empty();
+		if (colon != std::string::npos) {
+			ok = ok && parsePlanNumber(value.substr(colon + 1), &number) && 1 <= number && number <= 65535;
+			receiver.port = (int)number;
+		}
+		if (receiver.name.empty()) {
+			*problem = "a receiver needs a name";
+			return false;
+		}
+		for (char c : receiver.name) {
+			if (!isalnum((unsigned char)c) && c != '-' && c != '_') {
+				*problem = "receiver names can only have letters, digits, - and _";
+				return false;
+			}
+		}
+		for (const planReceiver& other : (*plan).receivers) {
+			if (other.name == receiver.name) {
+				*problem = "receiver \"" + receiver.name + "\" is given twice";
+				return false;
+			}
+		}
+		if ((*plan).receivers.size() + 1 >= SPECTRUM_ANALYZERS_MAX) {
+			*problem = "at most " + std::to_string(SPECTRUM_ANALYZERS_MAX - 1) + " receivers besides the fieldfox";
+			return false;
+		}
+		(*plan).receivers.push_back(receiver);
+	} else if (section == "output") {
+		if (key == "file") {
+			(*plan).output = text;
+			ok = !text.empty();
+		} else if (key == "compress") {
+			ok = jobParseYesNo(value, &((*plan).compress));
+		} else {
+			known = false;
+		}
+	} else {
+		*problem = "key outside of a known section";
+		return false;
+	}
+	if (!known) {
+		*problem = "unknown key \"" + std::string(key) + "\" in [" + std::string(section) + "]";
+		return false;
+	}
+	if (!ok) {
+		*problem = "bad value for " + std::string(key) + ": \"" + text + "\"";
+	}
+	return ok;
+}
+
+// the checks that need the whole plan
+bool planIsComplete(const sweepPlan& plan, std::string* problem) {
+	size_t spatial = plan.azimuth.values.size() * plan.elevation.values.size();
+	if (plan.azimuth.values.empty() || plan.elevation.values.empty()) {
+		*problem = "[axes] needs azimuth and elevation";
+	} else if (plan.frequency.values.empty()) {
+		*problem = "[signal] needs a frequency";
+	} else if (spatial * plan.frequency.values.size() * std::max<size_t>(plan.power.values.size(), 1) > PLAN_POSITIONS_MAX) {
+		*problem = "more than " + std::to_string(PLAN_POSITIONS_MAX) + " positions";
+	} else if (plan.scheme != SAMPLING_GRID && !(plan.azimuth.isRange && plan.elevation.isRange)) {
+		*problem = "sampling plans other than grid need azimuth and elevation as min:max:step";
+	} else if (plan.adaptive.enabled && (plan.scheme != SAMPLING_GRID || plan.frequency.values.size() > 1 || plan.power.values.size() > 1)) {
+		*problem = "adaptive refinement needs the grid, one frequency and one power";
+	} else {
+		for (double frequency : plan.frequency.values) {
+			if (frequency <= 0 || 1000000000000 < frequency) {
+				*problem = "frequencies must be positive, and below the THz range";
+				return false;
+			}
+		}
+		for (double power : plan.power.values) {
+			if (power < SIG_GEN_MIN_POWER || SIG_GEN_MAX_POWER < power || power != std::round(power)) {
+				*problem = "powers must be whole dBm, from " + std::to_string(SIG_GEN_MIN_POWER) + " to " + std::to_string(SIG_GEN_MAX_POWER);
+				return false;
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+// parses and checks the whole file into *plan; false (with the line) on the first problem
+bool parsePlanFile(const std::string& fileName, sweepPlan* plan) {
+	std::ifstream file(fileName);
+	if (!file.is_open()) {
+		errorOut("Could not open plan file " + fileName);
+		return false;
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+
+	long long startNs = clockMonotonicNs();
+	std::string section = "";
+	std::string problem = "";
+	int lineNumber = 0;
+	*plan = sweepPlan();
+	size_t start = 0;
+	std::string_view line;
+	while (jobNextLine(text, &start, &line)) {
+		lineNumber++;
+		if (line.empty() || line[0] == '#' || line[0] == ';') {
+			continue;
+		}
+		if (line.front() == '[') {
+			if (line.back() != ']') {
+				problem = "unclosed section header";
+			} else {
+				section = std::string(jobTrim(line.substr(1, line.size() - 2)));
+			}
+		} else {
+			size_t equals = line.find('=');
+			if (equals == std::string_view::npos) {
+				problem = "expected key = value";
+			} else {
+				planSetKey(plan, section, jobTrim(line.substr(0, equals)), jobTrim(line.substr(equals + 1)), &problem);
+			}
+		}
+		if (!problem.empty()) {
+			errorOut(fileName + " line " + std::to_string(lineNumber) + ": " + problem);
+			return false;
+		}
+	}
+	if ((*plan).power.values.empty()) {
+		(*plan).power.values.push_back(0); // the -p default
+	}
+	if (!planIsComplete(*plan, &problem)) {
+		errorOut(fileName + ": " + problem);
+		return false;
+	}
+	(*plan).loaded = true;
+	debugOut("Plan " + fileName + " checked in " + std::to_string((clockMonotonicNs() - startNs) / 1000) + " us");
+	return true;
+}
+
+// addresses from the plan, and its receivers, before anything connects. the plan has to outlive the sessions (activePlan does)
+void applyPlanEndpoints(const sweepPlan& plan) {
+	const planEndpoints& endpoints = plan.endpoints;
+	if (!endpoints.fieldFoxIP.empty()) {
+		telnetFieldFoxIP = endpoints.fieldFoxIP;
+	}
+	if (endpoints.fieldFoxPort != 0) {
+		telnetFieldFoxPort = endpoints.fieldFoxPort;
+	}
+	if (!endpoints.bindIP.empty()) {
+		telnetBindIP = endpoints.bindIP;
+	}
+	if (!endpoints.azimuth.empty()) {
+		turntableAzimuthRsrc = (ViRsrc)endpoints.azimuth.c_str();
+	}
+	if (!endpoints.elevation.empty()) {
+		turntableElevationRsrc = (ViRsrc)endpoints.elevation.c_str();
+	}
+	if (!endpoints.generator.empty()) {
+		signalGeneratorRsrc = (ViRsrc)endpoints.generator.c_str();
+	}
+	for (size_t i = 0; i < plan.receivers.size(); i++) {
+		spectrumAnalyzers[i + 1].name = plan.receivers[i].name;
+		spectrumAnalyzers[i + 1].address = plan.receivers[i].ip;
+		spectrumAnalyzers[i + 1].port = plan.receivers[i].port;
+	}
+	spectrumAnalyzerCount = 1 + (int)plan.receivers.size();
+}
+
+// the plan's analyzer settings over the ones setupFromTarget() picked
+void applyPlanAnalyzer(const planAnalyzer& analyzer, instrumentSetup* setup) {
+	if (analyzer.span > 0) {
+		double center = (*setup).signalGenFrequency;
+		(*setup).spectrumAnalyzerStart = std::max(center - analyzer.span / 2, 0.0);
+		(*setup).spectrumAnalyzerStop = (*setup).spectrumAnalyzerStart + analyzer.span;
+	}
+	if (analyzer.bwRes > 0) {
+		(*setup).spectrumAnalyzerBwRes = analyzer.bwRes;
+	}
+	if (analyzer.bwVideo > 0) {
+		(*setup).spectrumAnalyzerBwVideo = analyzer.bwVideo;
+	}
+	if (analyzer.points > 0) {
+		(*setup).spectrumAnalyzerPoints = analyzer.points;
+	}
+	if (!analyzer.detector.empty()) {
+		(*setup).spectrumAnalyzerDetector = analyzer.detector;
+	}
+}
+
+// grid from the axis lists, alternating azimuth direction on each row, without the positions outside the soft limits
+void planGridPositions(const sweepPlan& plan, std::vector<testPosition>* spatial) {
+	const std::vector<double>& azimuths = plan.azimuth.values;
+	int clipped = 0;
+	for (size_t row = 0; row < plan.elevation.values.size(); row++) {
+		for (size_t column = 0; column < azimuths.size(); column++) {
+			testPosition position;
+			position.azimuth = (float)azimuths[(row % 2 == 0) ? column : azimuths.size() - 1 - column];
+			position.elevation = (float)plan.elevation.values[row];
+			if (!isTurntablePosValid(position.azimuth, position.elevation)) {
+				clipped++;
+				continue;
+			}
+			(*spatial).push_back(position);
+		}
+	}
+	if (clipped > 0) {
+		interfaceOut("Plan grid: " + std::to_string(clipped) + " positions outside the turntable soft limits left out.", false);
+	}
+}
+
+// the executor's position array: one pass over the positions per frequency and power.
+// every scheme is clipped to the soft limits, so this comes after the instruments are up.
+// returns the count, or 0 (positions untouched) if there's nothing to measure
+int compilePlanPositions(const sweepPlan& plan, testPosition** positions) {
+	std::vector<testPosition> spatial;
+	if (plan.scheme == SAMPLING_GRID) {
+		planGridPositions(plan, &spatial);
+	} else {
+		samplingRange range = { (float)plan.azimuth.min, (float)plan.azimuth.max, (float)plan.elevation.min, (float)plan.elevation.max,
+								(float)plan.azimuth.step, (float)plan.elevation.step };
+		testPosition* sampled = nullptr;
+		int gridPositions = 0;
+		int count = createSampledPositionTargets(&sampled, plan.scheme, range, 0, 0, &gridPositions);
+		if (count == 0) {
+			return 0;
+		}
+		spatial.assign(sampled, sampled + count);
+		delete[] sampled;
+		printSamplingSummary(plan.scheme, count, gridPositions, sweepPositionEstimateMs());
+	}
+	size_t total = spatial.size() * plan.frequency.values.size() * plan.power.values.size();
+	if (total == 0) {
+		return 0;
+	}
+	testPosition* compiled = new testPosition[total];
+	size_t n = 0;
+	for (double frequency : plan.frequency.values) {
+		for (double power : plan.power.values) {
+			for (const testPosition& position : spatial) {
+				compiled[n] = position;
+				compiled[n].frequency = (long long)std::llround(frequency);
+				compiled[n].power = (int)std::lround(power);
+				n++;
+			}
+		}
+	}
+	delete[] *positions;
+	*positions = compiled;
+	return (int)total;
+}
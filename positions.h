@@ -0,0 +1,9 @@
+#pragma once
+// sweep positions - one per measurement, in the order they're measured
+
+struct testPosition {
+	float elevation;
+	float azimuth;
+	long long frequency; // need range to cover high GHz values, like 12GHz
+	int power;
+};
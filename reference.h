@@ -0,0 +1,174 @@
+#pragma once
+// reference captures (-n)
+// measuring the noise floor at every position would double the dwell, so references are only taken now and then:
+//   noise:     RF off, same position and settings - the receiver noise floor
+//   boresight: back to a fixed angle with RF on - drift of the whole chain over the run
+//   both:      one of each
+// at a cadence of once per elevation row ("row"), or every N minutes ("<N>m").
+// each reference is a line in its own file; result rows carry the id of the latest one taken before them
+// (the one after is id + 1), so results can be corrected later without sweeping again
+//
+// reference file format is | id, timestamp, kind, azimuth, elevation, frequency, powerRx, sweeps
+
+#define REFERENCE_FILE_DEFAULT ("chamberReferences.csv")
+
+#include <string>
+#include <fstream>
+#include <cmath>
+
+#include "helperFunctions.h"
+#include "turntable.h"
+#include "signalGenerator.h"
+#include "acquisition.h"
+
+enum referenceKind_t {
+	REFERENCE_NOISE,
+	REFERENCE_BORESIGHT,
+	REFERENCE_BOTH
+};
+
+struct referenceSchedule {
+	bool enabled = false;
+	referenceKind_t kind = REFERENCE_NOISE;
+	bool everyRow = true;
+	double intervalMinutes = 0; // when not every row
+	float boresightAzimuth = 0;
+	float boresightElevation = 0;
+};
+referenceSchedule sweepReferences;
+
+struct referenceState {
+	int lastId = 0;
+	bool haveCapture = false; // this run; a resume takes a fresh one before its first position
+	long long lastCaptureNs = 0;
+	float lastElevation = 0;
+};
+referenceState sweepReferenceState;
+
+// -n argument: kind,cadence[,azimuth,elevation] - ie "noise,row", "both,10m" or "boresight,row,0,0"
+bool parseReferenceArgument(const std::string& argument, referenceSchedule* schedule) {
+	std::string fields[4];
+	int count = 0;
+	size_t start = 0;
+	while (count < 4) {
+		size_t comma = argument.find(',', start);
+		fields[count++] = argument.substr(start, comma - start);
+		if (comma == std::string::npos) {
+			break;
+		}
+		start = comma + 1;
+	}
+	if (count != 2 && count != 4) {
+		return false;
+	}
+	if (fields[0] == "noise") {
+		(*schedule).kind = REFERENCE_NOISE;
+	} else if (fields[0] == "boresight") {
+		(*schedule).kind = REFERENCE_BORESIGHT;
+	} else if (fields[0] == "both") {
+		(*schedule).kind = REFERENCE_BOTH;
+	} else {
+		return false;
+	}
+	if (fields[1] == "row") {
+		(*schedule).everyRow = true;
+	} else {
+		char* end = nullptr;
+		(*schedule).everyRow = false;
+		(*schedule).intervalMinutes = strtod(fields[1].c_str(), &end);
+		if (end == fields[1].c_str() || std::string(end) != "m" || !((*schedule).intervalMinutes > 0)) {
+			return false;
+		}
+	}
+	if (count == 4) {
+		char* azimuthEnd = nullptr;
+		char* elevationEnd = nullptr;
+		(*schedule).boresightAzimuth = strtof(fields[2].c_str(), &azimuthEnd);
+		(*schedule).boresightElevation = strtof(fields[3].c_str(), &elevationEnd);
+		if (azimuthEnd == fields[2].c_str() || *azimuthEnd != '\0' || elevationEnd == fields[3].c_str() || *elevationEnd != '\0') {
+			return false;
+		}
+	}
+	(*schedule).enabled = true;
+	return true;
+}
+
+// ids carry on from the file, so a resumed run doesn't reuse them
+int referenceLastIdInFile(const std::string& fileName) {
+	std::ifstream file(fileName);
+	std::string line = "";
+	int lastId = 0;
+	while (std::getline(file, line)) {
+		int id = atoi(line.c_str());
+		lastId = (id > lastId) ? id : lastId;
+	}
+	return lastId;
+}
+
+bool referenceDue(const referenceSchedule& schedule, const referenceState& state, float nextElevation) {
+	if (!schedule.enabled) {
+		return false;
+	}
+	if (!state.haveCapture) {
+		return true;
+	}
+	if (schedule.everyRow) {
+		return nextElevation != state.lastElevation;
+	}
+	return clockElapsedMs(state.lastCaptureNs, clockMonotonicNs()) >= (long long)(schedule.intervalMinutes * 60000);
+}
+
+bool writeReference(int id, const std::string& kind, double azimuth, double elevation, double frequency, double powerRx, int sweeps) {
+	if (simulationActive) { // -d writes nothing
+		return true;
+	}
+	std::ofstream file(REFERENCE_FILE_DEFAULT, std::ios::out | std::ios::app);
+	if (!file.is_open()) {
+		return false;
+	}
+	file << id << "," << clockFormatUtc(clockUtcNs()) << "," << kind << "," << std::to_string(azimuth) << ","
+		<< std::to_string(elevation) << "," << std::to_string(frequency) << "," << std::to_string(powerRx) << "," << sweeps << std::endl;
+	return file.good();
+}
+
+// one reference of one kind, at the current position (noise) or at boresight; returns the new id, or 0 if it failed
+int captureReference(referenceKind_t kind, const acquisitionSettings& settings, int sweepsWanted, int sweepTimeMs) {
+	int sweeps = 0;
+	std::string azimuthText = "";
+	std::string elevationText = "";
+	std::string powerText = "";
+	if (kind == REFERENCE_BORESIGHT) {
+		moveTurntable(sweepReferences.boresightAzimuth, sweepReferences.boresightElevation);
+	}
+	double powerRx = measurePower(settings, sweepsWanted, sweepTimeMs, kind == REFERENCE_BORESIGHT, &sweeps, &powerText);
+	double azimuth = getTurntableAziPosition(&azimuthText);
+	double elevation = getTurntableElePosition(&elevationText);
+	int id = sweepReferenceState.lastId + 1;
+	std::string kindName = (kind == REFERENCE_BORESIGHT) ? "boresight" : "noise";
+	if (!writeReference(id, kindName, azimuth, elevation, getSignalGenFreq(), powerRx, sweeps)) {
+		errorOut("Failed to write reference " + std::to_string(id) + " to " + REFERENCE_FILE_DEFAULT);
+		return 0;
+	}
+	sweepReferenceState.lastId = id;
+	interfaceOut("Reference " + std::to_string(id) + " (" + kindName + "): " + powerText + " dBm", false);
+	return id;
+}
+
+// called before each position's move; noise is taken wherever the turntable happens to be
+void runScheduledReferences(float nextElevation, const acquisitionSettings& settings, int sweepsWanted, int sweepTimeMs) {
+	if (!referenceDue(sweepReferences, sweepReferenceState, nextElevation)) {
+		return;
+	}
+	if (sweepReferenceState.lastId == 0) {
+		sweepReferenceState.lastId = referenceLastIdInFile(REFERENCE_FILE_DEFAULT);
+	}
+	if (sweepReferences.kind != REFERENCE_BORESIGHT) {
+		captureReference(REFERENCE_NOISE, settings, sweepsWanted, sweepTimeMs);
+	}
+	if (sweepReferences.kind != REFERENCE_NOISE) {
+		captureReference(REFERENCE_BORESIGHT, settings, sweepsWanted, sweepTimeMs);
+	}
+	sweepReferenceState.haveCapture = true;
+	sweepReferenceState.lastCaptureNs = clockMonotonicNs();
+	sweepReferenceState.lastElevation = nextElevation;
+}
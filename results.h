@@ -0,0 +1,103 @@
+#pragma once
+// result rows - one per measured position
+// kept free of windows/visa headers, so companion tools can read result files too
+// csv format is | timestamp, index, azimuth, elevation, frequency, powerTx, powerRx, sweeps, referenceId
+// (older files stop after powerRx or sweeps, and read back with those as 0)
+
+#define RESULT_CSV_COLUMNS (9)
+#define RESULT_CSV_COLUMNS_WITHOUT_REFERENCE (8)
+#define RESULT_CSV_COLUMNS_WITHOUT_SWEEPS (7)
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "chamberClock.h"
+
+struct resultRow {
+	long long timestampUs; // UTC, microseconds since Jan 1, 1970
+	int index;             // position index in the sweep
+	double azimuth;
+	double elevation;
+	double frequency;      // in Hz
+	double powerTx;        // in dBm
+	double powerRx;        // in dBm
+	int sweeps;            // SA sweeps that went into powerRx; 0 if they weren't counted
+	int referenceId;       // latest reference capture before this row (see reference.h); 0 if none
+};
+
+std::string formatResultRowCsv(const resultRow& row) {
+	return clockFormatUtc(row.timestampUs * 1000) + "," + std::to_string(row.index) + ","
+		+ std::to_string(row.azimuth) + "," + std::to_string(row.elevation) + ","
+		+ std::to_string(row.frequency) + "," + std::to_string(row.powerTx) + "," + std::to_string(row.powerRx) + ","
+		+ std::to_string(row.sweeps) + "," + std::to_string(row.referenceId);
+}
+
+// "seconds.micro" (or plain seconds, from older files) to microseconds
+long long parseResultTimestampUs(const char* text, const char* end) {
+	long long seconds = 0;
+	long long micros = 0;
+	int fractionDigits = 0;
+	const char* c = text;
+	for (; c < end && '0' <= *c && *c <= '9'; c++) {
+		seconds = seconds * 10 + (*c - '0');
+	}
+	if (c < end && *c == '.') {
+		for (c++; c < end && '0' <= *c && *c <= '9'; c++) {
+			if (fractionDigits < 6) {
+				micros = micros * 10 + (*c - '0');
+				fractionDigits++;
+			}
+		}
+	}
+	for (; fractionDigits < 6; fractionDigits++) {
+		micros *= 10;
+	}
+	return seconds * 1000000 + micros;
+}
+
+bool parseResultRowCsv(const char* line, const char* end, resultRow* row) { // returns false on malformed lines (ie, a header)
+	const char* fieldStart[RESULT_CSV_COLUMNS];
+	int fields = 0;
+	fieldStart[fields++] = line;
+	for (const char* c = line; c < end && fields < RESULT_CSV_COLUMNS; c++) {
+		if (*c == ',') {
+			fieldStart[fields++] = c + 1;
+		}
+	}
+	if (fields < RESULT_CSV_COLUMNS_WITHOUT_SWEEPS || !('0' <= *line && *line <= '9')) {
+		return false;
+	}
+	char* parsedEnd = nullptr;
+	(*row).sweeps = (fields >= RESULT_CSV_COLUMNS_WITHOUT_REFERENCE) ? (int)strtol(fieldStart[7], nullptr, 10) : 0;
+	(*row).referenceId = (fields == RESULT_CSV_COLUMNS) ? (int)strtol(fieldStart[8], nullptr, 10) : 0;
+	(*row).timestampUs = parseResultTimestampUs(fieldStart[0], fieldStart[1] - 1);
+	(*row).index     = (int)strtol(fieldStart[1], nullptr, 10);
+	(*row).azimuth   = strtod(fieldStart[2], nullptr);
+	(*row).elevation = strtod(fieldStart[3], nullptr);
+	(*row).frequency = strtod(fieldStart[4], nullptr);
+	(*row).powerTx   = strtod(fieldStart[5], nullptr);
+	(*row).powerRx   = strtod(fieldStart[6], &parsedEnd);
+	return parsedEnd != fieldStart[6];
+}
+
+bool parseResultRowCsv(const std::string& line, resultRow* row) {
+	return parseResultRowCsv(line.c_str(), line.c_str() + line.length(), row);
+}
+
+// TRACE:DATA? answers with comma separated values, one per sweep point
+bool parseTraceData(const std::string& traceText, std::vector<float>* trace) {
+	(*trace).clear();
+	const char* c = traceText.c_str();
+	char* parsedEnd = nullptr;
+	while (*c != '\0') {
+		double value = strtod(c, &parsedEnd);
+		if (parsedEnd == c) {
+			break; // end of the numbers (prompt, newline, or garbage)
+		}
+		(*trace).push_back((float)value);
+		c = parsedEnd;
+		while (*c == ',' || *c == ' ') { c++; }
+	}
+	return !(*trace).empty();
+}
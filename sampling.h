@@ -0,0 +1,228 @@
+#pragma once
+// spherical sampling plans (-g scheme)
+// the -s grid has the same azimuth step at every elevation, but a degree of azimuth is only cos(elevation) of a
+// degree on the sphere - near the elevation extremes the grid measures nearly the same direction over and over.
+//   grid:      the -s grid as it always was (default)
+//   rings:     -s elevation rows, with the azimuth step widened to aziDensity / cos(elevation)
+//   equalarea: rows of equal area bands (equal steps in sin(elevation)), each split into equal area cells
+//   fibonacci: golden angle spiral over the sphere, keeping the points inside the range
+// all of them aim for the -s densities at the horizon, and are clipped to the turntable soft limits, which is why
+// they're generated after the instruments are up. rows alternate direction so the azimuth axis doesn't rewind
+
+#define SAMPLING_COS_MIN (0.01) // closer to +/-90 degrees than this, a row is a single point
+#define SAMPLING_DEGREES_PER_RADIAN (57.29577951308232)
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "helperFunctions.h"
+#include "positions.h"
+#include "turntable.h"
+
+enum samplingScheme_t {
+	SAMPLING_GRID,
+	SAMPLING_RINGS,
+	SAMPLING_EQUAL_AREA,
+	SAMPLING_FIBONACCI
+};
+const char* SAMPLING_SCHEME_NAMES[] = { "grid", "rings", "equalarea", "fibonacci" }; // same order as samplingScheme_t
+
+struct samplingRange {
+	float azimuthMin;
+	float azimuthMax;
+	float elevationMin;
+	float elevationMax;
+	float aziDensity;  // degrees, at the horizon
+	float elevDensity; // degrees
+};
+
+// -s style range: azimuthMin,azimuthMax,elevationMin,elevationMax[,aziDensity,elevDensity]
+bool parseSamplingRange(const std::string& argument, samplingRange* range) {
+	float values[6] = { 0, 0, 0, 0, 1, 1 };
+	const char* c = argument.c_str();
+	char* end = nullptr;
+	int count = 0;
+	do {
+		if (count == 6) {
+			return false;
+		}
+		if (count > 0) {
+			c = end + 1;
+		}
+		values[count] = strtof(c, &end);
+		if (end == c || !std::isfinite(values[count])) {
+			return false;
+		}
+		count++;
+	} while (*end == ',');
+	if (*end != '\0' || (count != 4 && count != 6) || values[0] > values[1] || values[2] > values[3] || !(values[4] > 0) || !(values[5] > 0)) {
+		return false;
+	}
+	*range = { values[0], values[1], values[2], values[3], values[4], values[5] };
+	return true;
+}
+
+bool parseSamplingScheme(const std::string& name, samplingScheme_t* scheme) {
+	for (int i = 0; i < (int)(sizeof(SAMPLING_SCHEME_NAMES) / sizeof(SAMPLING_SCHEME_NAMES[0])); i++) {
+		if (name == SAMPLING_SCHEME_NAMES[i]) {
+			*scheme = (samplingScheme_t)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// the part of the range the turntable can reach; false if none of it can be. unread limits leave the range alone
+bool samplingClipToLimits(samplingRange* range) {
+	if (turntableAziLimitMin > turntableAziLimitMax || turntableEleLimitMin > turntableEleLimitMax) {
+		errorOut("Turntable soft limits unknown; sampling plan uses the range as given.");
+		return true;
+	}
+	(*range).azimuthMin   = std::max((*range).azimuthMin,   turntableAziLimitMin);
+	(*range).azimuthMax   = std::min((*range).azimuthMax,   turntableAziLimitMax);
+	(*range).elevationMin = std::max((*range).elevationMin, turntableEleLimitMin);
+	(*range).elevationMax = std::min((*range).elevationMax, turntableEleLimitMax);
+	return (*range).azimuthMin <= (*range).azimuthMax && (*range).elevationMin <= (*range).elevationMax;
+}
+
+// n evenly spaced values covering [min, max], ends included (one value, in the middle, if n is 1)
+void samplingSpread(float min, float max, int n, std::vector<float>* values) {
+	(*values).clear();
+	for (int i = 0; i < n; i++) {
+		(*values).push_back((n == 1) ? (min + max) / 2 : min + (max - min) * i / (n - 1));
+	}
+}
+
+// points on one row, for a given azimuth step
+int samplingRowCount(const samplingRange& range, double azimuthStep) {
+	double span = range.azimuthMax - range.azimuthMin;
+	if (span <= 0 || azimuthStep <= 0) {
+		return 1;
+	}
+	return (int)std::ceil(span / azimuthStep - 1e-6) + 1;
+}
+
+// appends a row, alternating direction from the row before
+void samplingAddRow(float elevation, int count, const samplingRange& range, std::vector<testPosition>* plan) {
+	std::vector<float> azimuths;
+	samplingSpread(range.azimuthMin, range.azimuthMax, count, &azimuths);
+	bool backwards = !(*plan).empty() && std::fabs((*plan).back().azimuth - range.azimuthMax) < std::fabs((*plan).back().azimuth - range.azimuthMin);
+	if (backwards) {
+		std::reverse(azimuths.begin(), azimuths.end());
+	}
+	for (float azimuth : azimuths) {
+		testPosition position;
+		position.azimuth = azimuth;
+		position.elevation = elevation;
+		(*plan).push_back(position);
+	}
+}
+
+// points on a row at this elevation, with the azimuth step widened by 1 / cos(elevation); a pole is one direction
+int samplingRingCount(const samplingRange& range, double elevationDegrees) {
+	double c = std::cos(elevationDegrees / SAMPLING_DEGREES_PER_RADIAN);
+	return (c < SAMPLING_COS_MIN) ? 1 : samplingRowCount(range, range.aziDensity / c);
+}
+
+// constant elevation step; azimuth step grows as the rows get shorter
+void samplingRings(const samplingRange& range, std::vector<testPosition>* plan) {
+	std::vector<float> elevations;
+	int rows = (range.elevationMax > range.elevationMin) ? (int)std::round((range.elevationMax - range.elevationMin) / range.elevDensity) + 1 : 1;
+	samplingSpread(range.elevationMin, range.elevationMax, rows, &elevations);
+	for (float elevation : elevations) {
+		samplingAddRow(elevation, samplingRingCount(range, elevation), range, plan);
+	}
+}
+
+// bands of equal sin(elevation) (equal area), one row through the middle of each, with cells as wide as they are tall
+void samplingEqualArea(const samplingRange& range, std::vector<testPosition>* plan) {
+	double sinMin = std::sin(range.elevationMin / SAMPLING_DEGREES_PER_RADIAN);
+	double sinMax = std::sin(range.elevationMax / SAMPLING_DEGREES_PER_RADIAN);
+	double bandHeight = std::sin(range.elevDensity / SAMPLING_DEGREES_PER_RADIAN); // what elevDensity covers at the horizon
+	int bands = std::max(1, (int)std::round((sinMax - sinMin) / bandHeight));
+	if (range.elevationMax > range.elevationMin) {
+		bands++; // the ends get measured too, like the grid's
+	}
+	for (int band = 0; band < bands; band++) {
+		double s = (bands == 1) ? (sinMin + sinMax) / 2 : sinMin + (sinMax - sinMin) * band / (bands - 1);
+		float elevation = (float)(std::asin(std::clamp(s, -1.0, 1.0)) * SAMPLING_DEGREES_PER_RADIAN);
+		samplingAddRow(elevation, samplingRingCount(range, elevation), range, plan);
+	}
+}
+
+// golden angle spiral, as dense as one point per aziDensity x elevDensity at the horizon; then sorted into rows
+void samplingFibonacci(const samplingRange& range, std::vector<testPosition>* plan) {
+	const double goldenAngle = 180.0 * (3.0 - std::sqrt(5.0)); // degrees
+	double cellArea = (range.aziDensity / SAMPLING_DEGREES_PER_RADIAN) * (range.elevDensity / SAMPLING_DEGREES_PER_RADIAN);
+	int sphereCount = (int)std::ceil(4 * 3.14159265358979 / cellArea);
+	std::vector<testPosition> points;
+	for (int i = 0; i < sphereCount; i++) {
+		double s = 1 - (2.0 * i + 1) / sphereCount; // sin(elevation), evenly spaced
+		double elevation = std::asin(s) * SAMPLING_DEGREES_PER_RADIAN;
+		double azimuth = range.azimuthMin + std::fmod(goldenAngle * i, 360.0); // one turn from the start of the range
+		if (range.elevationMin <= elevation && elevation <= range.elevationMax && range.azimuthMin <= azimuth && azimuth <= range.azimuthMax) {
+			testPosition position;
+			position.azimuth = (float)azimuth;
+			position.elevation = (float)elevation;
+			points.push_back(position);
+		}
+	}
+	if (points.empty()) { // range narrower than one cell
+		samplingAddRow((range.elevationMin + range.elevationMax) / 2, 1, range, plan);
+		return;
+	}
+	// rows of elevDensity, alternating direction
+	std::sort(points.begin(), points.end(), [&](const testPosition& a, const testPosition& b) {
+		int rowA = (int)std::floor((a.elevation - range.elevationMin) / range.elevDensity);
+		int rowB = (int)std::floor((b.elevation - range.elevationMin) / range.elevDensity);
+		if (rowA != rowB) {
+			return rowA < rowB;
+		}
+		return ((rowA % 2 == 0) ? a.azimuth < b.azimuth : a.azimuth > b.azimuth);
+	});
+	(*plan).insert((*plan).end(), points.begin(), points.end());
+}
+
+// replaces *positions with the scheme's plan; returns the new count, or 0 (positions untouched) if there's nothing to measure.
+// *gridPositions is what the grid would need over the same (clipped) range
+int createSampledPositionTargets(testPosition** positions, samplingScheme_t scheme, samplingRange range, long long targetFreq, int targetPower,
+								 int* gridPositions) {
+	std::vector<testPosition> plan;
+	if (range.aziDensity <= 0 || range.elevDensity <= 0) {
+		errorOut("Sampling plans need positive densities.");
+		return 0;
+	}
+	if (!samplingClipToLimits(&range)) {
+		errorOut("None of the sweep range is inside the turntable soft limits.");
+		return 0;
+	}
+	int gridRows = (range.elevationMax > range.elevationMin) ? (int)std::round((range.elevationMax - range.elevationMin) / range.elevDensity) + 1 : 1;
+	*gridPositions = gridRows * samplingRowCount(range, range.aziDensity);
+	if (scheme == SAMPLING_RINGS) {
+		samplingRings(range, &plan);
+	} else if (scheme == SAMPLING_EQUAL_AREA) {
+		samplingEqualArea(range, &plan);
+	} else if (scheme == SAMPLING_FIBONACCI) {
+		samplingFibonacci(range, &plan);
+	} else {
+		return 0; // the grid comes from createPositionTargets()
+	}
+	for (testPosition& position : plan) {
+		position.frequency = targetFreq;
+		position.power = targetPower;
+	}
+	delete[] *positions;
+	*positions = new testPosition[plan.size()];
+	std::copy(plan.begin(), plan.end(), *positions);
+	return (int)plan.size();
+}
+
+// count, and the saving against the grid at positionMs per position
+void printSamplingSummary(samplingScheme_t scheme, int totalPositions, int gridPositions, long long positionMs) {
+	long long savedMs = (long long)(gridPositions - totalPositions) * positionMs;
+	interfaceOut(std::string("Sampling plan (") + SAMPLING_SCHEME_NAMES[scheme] + "): " + std::to_string(totalPositions) + " positions, against "
+		+ std::to_string(gridPositions) + " for the equivalent grid - about " + std::to_string(std::llabs(savedMs) / 1000 / 60) + " minutes "
+		+ ((savedMs >= 0) ? "saved" : "longer") + " (at " + std::to_string(positionMs / 1000) + " s per position)", false);
+}
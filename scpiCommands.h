@@ -0,0 +1,155 @@
+#pragma once
+// SCPI / turntable command formatting
+// every verb is a compile-time template (text before the value, fixed precision, text after it).
+// commands are formatted with to_chars into a fixed buffer on the caller's stack - no std::string, no heap -
+// and sent with an explicit length, so nothing in a command is ever treated as a printf format
+
+#define SCPI_COMMAND_BUFFER_SIZE (128)
+#define SCPI_PRECISION_INTEGER (-1)
+
+#include <charconv>
+#include <cstring>
+#include <string>
+
+struct scpiTemplate {
+	const char* prefix;
+	int prefixLength;
+	int precision; // digits after the decimal point, or SCPI_PRECISION_INTEGER
+	const char* suffix;
+	int suffixLength;
+};
+
+constexpr scpiTemplate scpiMakeTemplate(const char* prefix, int precision, const char* suffix) {
+	return { prefix, (int)std::char_traits<char>::length(prefix), precision, suffix, (int)std::char_traits<char>::length(suffix) };
+}
+
+constexpr scpiTemplate scpiMakeTemplate(const char* fixedCommand) { // commands without a value
+	return scpiMakeTemplate(fixedCommand, SCPI_PRECISION_INTEGER, "");
+}
+
+// signal generator
+constexpr scpiTemplate SCPI_SIGNAL_GEN_FREQUENCY  = scpiMakeTemplate("FREQ ", 3, " Hz\r\n");
+constexpr scpiTemplate SCPI_SIGNAL_GEN_POWER      = scpiMakeTemplate("POW ", 2, " dBm\r\n");
+constexpr scpiTemplate SCPI_SIGNAL_GEN_MOD_ON     = scpiMakeTemplate("OUTP:MOD ON\r\n");
+constexpr scpiTemplate SCPI_SIGNAL_GEN_MOD_OFF    = scpiMakeTemplate("OUTP:MOD OFF\r\n");
+constexpr scpiTemplate SCPI_SIGNAL_GEN_OUTPUT_ON  = scpiMakeTemplate("OUTPUT ON\r\n");
+constexpr scpiTemplate SCPI_SIGNAL_GEN_OUTPUT_OFF = scpiMakeTemplate("OUTPUT OFF\r\n");
+constexpr scpiTemplate SCPI_SIGNAL_GEN_RESET      = scpiMakeTemplate("*RST\r\n");
+constexpr scpiTemplate SCPI_SIGNAL_GEN_SAVE       = scpiMakeTemplate("*SAV ", SCPI_PRECISION_INTEGER, "\r\n"); // state register
+constexpr scpiTemplate SCPI_SIGNAL_GEN_RECALL     = scpiMakeTemplate("*RCL ", SCPI_PRECISION_INTEGER, "\r\n");
+constexpr scpiTemplate SCPI_SIGNAL_GEN_READBACK   = scpiMakeTemplate("FREQ?;POW?;OUTP:MOD?;OUTP?\r\n"); // everything configured, in one reply
+
+// spectrum analyzer (fieldfox, over telnet)
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_PRESET          = scpiMakeTemplate("SYST:PRES;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_MODE            = scpiMakeTemplate("INST:SEL '", SCPI_PRECISION_INTEGER, "';\r\n"); // takes a name, not a number
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_FREQ_START      = scpiMakeTemplate("SENS:FREQ:START ", 3, " Hz;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_FREQ_STOP       = scpiMakeTemplate("SENS:FREQ:STOP ", 3, " Hz;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_FREQ_CENTER     = scpiMakeTemplate("SENS:FREQ:CENT ", 3, " Hz;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_FREQ_SPAN       = scpiMakeTemplate("SENS:FREQ:SPAN ", 3, " Hz;\r\n"); // 0 is zero span
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_SWEEP_TIME      = scpiMakeTemplate("SENS:SWE:TIME ", 6, ";\r\n");  // seconds; the time record in zero span
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_BW_RES          = scpiMakeTemplate("SENS:BAND:RES ", 3, " Hz;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_BW_VIDEO        = scpiMakeTemplate("SENS:BAND:VID ", 3, " Hz;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_SWEEP_POINTS    = scpiMakeTemplate("SENS:SWEEP:POINTS ", SCPI_PRECISION_INTEGER, ";\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_DETECTOR        = scpiMakeTemplate("SENS:DET:FUNC ", SCPI_PRECISION_INTEGER, ";\r\n"); // takes a name (POS, SAMP, AVER...)
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_ATTENUATION     = scpiMakeTemplate("SENS:POW:ATT ", SCPI_PRECISION_INTEGER, ";\r\n"); // dB; turns auto attenuation off
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_CONTINUOUS_ON   = scpiMakeTemplate("INIT:CONT ON;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_CONTINUOUS_OFF  = scpiMakeTemplate("INIT:CONT OFF;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_INIT_IMMEDIATE  = scpiMakeTemplate("INIT:IMM;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_SINGLE_SWEEP    = scpiMakeTemplate("INIT:IMM;*OPC?\r\n"); // answers 1 once the sweep is done
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_MARKER          = scpiMakeTemplate("CALC:MARK", SCPI_PRECISION_INTEGER, "");  // followed by one of the below
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_MARKER_NORMAL   = scpiMakeTemplate(" NORM;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_MARKER_X        = scpiMakeTemplate(":X ", 3, ";\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_MARKER_Y_QUERY  = scpiMakeTemplate(":Y?;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_TRACE_CLEAR     = scpiMakeTemplate("TRAC:TYPE CLRW;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_TRACE_MAX_HOLD  = scpiMakeTemplate("TRAC:TYPE MAXH;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_TRACE_DATA      = scpiMakeTemplate("TRACE:DATA?;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_STATE_SAVE      = scpiMakeTemplate("MMEM:STOR:STAT \"", SCPI_PRECISION_INTEGER, "\";\r\n"); // takes a file name
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_STATE_LOAD      = scpiMakeTemplate("MMEM:LOAD:STAT \"", SCPI_PRECISION_INTEGER, "\";\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_ACQUISITION     = scpiMakeTemplate( // what sets the sweep time
+	"SENS:SWE:TIME?;:SENS:FREQ:SPAN?;:SENS:BAND:RES?;:SENS:BAND:VID?;:SENS:SWEEP:POINTS?;\r\n");
+constexpr scpiTemplate SCPI_SPECTRUM_ANALYZER_READBACK        = scpiMakeTemplate(
+	"SENS:FREQ:START?;:SENS:FREQ:STOP?;:SENS:BAND:RES?;:SENS:BAND:VID?;:SENS:SWEEP:POINTS?;:CALC:MARK1:X?;\r\n");
+
+// turntable controller - positions to the hundredth of a degree
+constexpr scpiTemplate SCPI_TURNTABLE_GOTO                = scpiMakeTemplate("GOTO ", 2, "\r\n");
+constexpr scpiTemplate SCPI_TURNTABLE_CURRENT_POSITION    = scpiMakeTemplate("CP\r\n");
+constexpr scpiTemplate SCPI_TURNTABLE_UPPER_LIMIT         = scpiMakeTemplate("UL\r\n");
+constexpr scpiTemplate SCPI_TURNTABLE_LOWER_LIMIT         = scpiMakeTemplate("LL\r\n");
+
+struct scpiCommand {
+	char text[SCPI_COMMAND_BUFFER_SIZE];
+	int length;
+	bool overflow; // set if anything didn't fit; the command must not be sent
+};
+
+void scpiBegin(scpiCommand* command) {
+	(*command).length = 0;
+	(*command).overflow = false;
+	(*command).text[0] = '\0';
+}
+
+void scpiAppendText(scpiCommand* command, const char* text, int textLength) {
+	if ((*command).length + textLength >= SCPI_COMMAND_BUFFER_SIZE) {
+		(*command).overflow = true;
+		return;
+	}
+	memcpy((*command).text + (*command).length, text, textLength);
+	(*command).length += textLength;
+	(*command).text[(*command).length] = '\0';
+}
+
+void scpiAppendNumber(scpiCommand* command, double value, int precision) {
+	char* first = (*command).text + (*command).length;
+	char* last = (*command).text + SCPI_COMMAND_BUFFER_SIZE - 1; // keep room for the terminator
+	std::to_chars_result result;
+	if (precision == SCPI_PRECISION_INTEGER) {
+		result = std::to_chars(first, last, (long long)value);
+	} else {
+		result = std::to_chars(first, last, value, std::chars_format::fixed, precision);
+	}
+	if (result.ec != std::errc()) {
+		(*command).overflow = true;
+		return;
+	}
+	(*command).length = (int)(result.ptr - (*command).text);
+	(*command).text[(*command).length] = '\0';
+}
+
+void scpiAppend(scpiCommand* command, const scpiTemplate& verb) { // verb without a value
+	scpiAppendText(command, verb.prefix, verb.prefixLength);
+	scpiAppendText(command, verb.suffix, verb.suffixLength);
+}
+
+void scpiAppend(scpiCommand* command, const scpiTemplate& verb, double value) {
+	scpiAppendText(command, verb.prefix, verb.prefixLength);
+	scpiAppendNumber(command, value, verb.precision);
+	scpiAppendText(command, verb.suffix, verb.suffixLength);
+}
+
+void scpiAppend(scpiCommand* command, const scpiTemplate& verb, const char* text, int textLength) { // verb with a name in place of the value
+	scpiAppendText(command, verb.prefix, verb.prefixLength);
+	scpiAppendText(command, text, textLength);
+	scpiAppendText(command, verb.suffix, verb.suffixLength);
+}
+
+// the usual case: one verb, one value
+scpiCommand scpiFormat(const scpiTemplate& verb, double value) {
+	scpiCommand command;
+	scpiBegin(&command);
+	scpiAppend(&command, verb, value);
+	return command;
+}
+
+scpiCommand scpiFormat(const scpiTemplate& verb) {
+	scpiCommand command;
+	scpiBegin(&command);
+	scpiAppend(&command, verb);
+	return command;
+}
+
+scpiCommand scpiFormat(const scpiTemplate& verb, const std::string& text) {
+	scpiCommand command;
+	scpiBegin(&command);
+	scpiAppend(&command, verb, text.c_str(), (int)text.length());
+	return command;
+}
@@ -0,0 +1,209 @@
+#pragma once
+// decoding instrument responses
+// numbers come back as SCPI NR1 (123), NR2 (12.3) or NR3 (1.23E+01), maybe with a unit suffix.
+// every parse says whether it worked, instead of quietly returning 0 like strtod/atof did on garbage
+
+#define SCPI_RESPONSE_NAN       (9.91e37) // what SCPI instruments send for "no valid value"
+#define SCPI_RESPONSE_INFINITY  (9.9e37)  // and for +/- infinity (overrange)
+
+#include <charconv>
+#include <string>
+#include <string_view>
+#include <cmath>
+#include <limits>
+
+enum responseStatus_t {
+	RESPONSE_OK,
+	RESPONSE_EMPTY,            // nothing came back (timeout, or a blank line)
+	RESPONSE_NOT_A_NUMBER,     // text that isn't a number at all
+	RESPONSE_TRAILING_GARBAGE, // a number, followed by something that isn't whitespace or a known unit
+	RESPONSE_WRONG_UNIT,       // a unit, but not one that fits the quantity asked for
+	RESPONSE_OUT_OF_RANGE,     // too large for a double
+	RESPONSE_INSTRUMENT_NAN,   // the instrument said 9.91E37; value is NaN
+	RESPONSE_INSTRUMENT_INFINITY // +/-9.9E37; value is +/-inf
+};
+
+// what the caller expects, so units can be checked and scaled
+enum responseUnit_t {
+	RESPONSE_UNIT_NONE,      // plain number, units not allowed
+	RESPONSE_UNIT_HERTZ,     // Hz, kHz, MHz, GHz (MHz is mega here, like the instruments mean it)
+	RESPONSE_UNIT_DBM,       // dBm or dB
+	RESPONSE_UNIT_DEGREES,   // DEG
+	RESPONSE_UNIT_SECONDS    // s, ms, us, ns
+};
+
+struct responseUnitSuffix {
+	const char* name; // upper case
+	responseUnit_t unit;
+	double scale;
+};
+
+const responseUnitSuffix RESPONSE_UNIT_SUFFIXES[] = {
+	{ "HZ",  RESPONSE_UNIT_HERTZ, 1 },    { "KHZ", RESPONSE_UNIT_HERTZ, 1e3 },
+	{ "MHZ", RESPONSE_UNIT_HERTZ, 1e6 },  { "GHZ", RESPONSE_UNIT_HERTZ, 1e9 },
+	{ "DBM", RESPONSE_UNIT_DBM, 1 },      { "DB",  RESPONSE_UNIT_DBM, 1 },
+	{ "DEG", RESPONSE_UNIT_DEGREES, 1 },
+	{ "S",   RESPONSE_UNIT_SECONDS, 1 },  { "MS",  RESPONSE_UNIT_SECONDS, 1e-3 },
+	{ "US",  RESPONSE_UNIT_SECONDS, 1e-6 }, { "NS", RESPONSE_UNIT_SECONDS, 1e-9 }
+};
+
+std::string responseStatusText(responseStatus_t status) {
+	switch (status) {
+	case RESPONSE_OK:                  return "ok";
+	case RESPONSE_EMPTY:               return "empty response";
+	case RESPONSE_NOT_A_NUMBER:        return "not a number";
+	case RESPONSE_TRAILING_GARBAGE:    return "unexpected text after the number";
+	case RESPONSE_WRONG_UNIT:          return "wrong unit";
+	case RESPONSE_OUT_OF_RANGE:        return "number out of range";
+	case RESPONSE_INSTRUMENT_NAN:      return "instrument reported no valid value";
+	case RESPONSE_INSTRUMENT_INFINITY: return "instrument reported overrange";
+	}
+	return "unknown";
+}
+
+bool responseIsSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+char responseUpper(char c) {
+	return (c >= 'a' && c <= 'z') ? (char)(c - 'a' + 'A') : c;
+}
+
+// matches [first, last) against the suffix table, case insensitive; false if it's not a unit we know for this quantity
+bool responseMatchUnit(const char* first, const char* last, responseUnit_t unit, double* scale, bool* knownUnit) {
+	size_t length = (size_t)(last - first);
+	*knownUnit = false;
+	for (const responseUnitSuffix& suffix : RESPONSE_UNIT_SUFFIXES) {
+		size_t i = 0;
+		while (suffix.name[i] != '\0' && i < length && responseUpper(first[i]) == suffix.name[i]) {
+			i++;
+		}
+		if (suffix.name[i] == '\0' && i == length) {
+			*knownUnit = true;
+			if (suffix.unit == unit) {
+				*scale = suffix.scale;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// one number, optionally followed by a unit. *value is only changed on RESPONSE_OK, NaN, and infinity
+responseStatus_t parseResponseNumber(std::string_view text, double* value, responseUnit_t unit = RESPONSE_UNIT_NONE) {
+	const char* c = text.data();
+	const char* end = text.data() + text.length();
+	bool negative = false;
+	double parsed = 0;
+	double scale = 1;
+
+	while (c < end && responseIsSpace(*c)) { c++; }
+	while (end > c && responseIsSpace(*(end - 1))) { end--; }
+	if (c == end) {
+		return RESPONSE_EMPTY;
+	}
+	if (*c == '+' || *c == '-') { // from_chars takes '-' but not '+', so handle both here
+		negative = (*c == '-');
+		c++;
+	}
+	if (c == end || !((*c >= '0' && *c <= '9') || *c == '.')) { // also rejects "inf"/"nan" words, which from_chars would take
+		return RESPONSE_NOT_A_NUMBER;
+	}
+	std::from_chars_result result = std::from_chars(c, end, parsed, std::chars_format::general);
+	if (result.ec == std::errc::result_out_of_range) {
+		return RESPONSE_OUT_OF_RANGE;
+	}
+	if (result.ec != std::errc() || result.ptr == c) {
+		return RESPONSE_NOT_A_NUMBER;
+	}
+	c = result.ptr;
+	while (c < end && responseIsSpace(*c)) { c++; }
+	if (c < end) {
+		bool knownUnit = false;
+		if (!responseMatchUnit(c, end, unit, &scale, &knownUnit)) {
+			return knownUnit ? RESPONSE_WRONG_UNIT : RESPONSE_TRAILING_GARBAGE;
+		}
+	}
+	if (negative) {
+		parsed = -parsed;
+	}
+
+	// sentinels are compared before scaling, since they're sent as-is regardless of unit
+	if (std::fabs(parsed - SCPI_RESPONSE_NAN) <= 1e-6 * SCPI_RESPONSE_NAN) {
+		*value = std::numeric_limits<double>::quiet_NaN();
+		return RESPONSE_INSTRUMENT_NAN;
+	}
+	if (std::fabs(std::fabs(parsed) - SCPI_RESPONSE_INFINITY) <= 1e-6 * SCPI_RESPONSE_INFINITY) {
+		*value = negative ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity();
+		return RESPONSE_INSTRUMENT_INFINITY;
+	}
+	*value = parsed * scale;
+	return RESPONSE_OK;
+}
+
+// whole numbers (NR1), for counts like sweep points. NR2/NR3 forms are accepted as long as they're integral
+responseStatus_t parseResponseInteger(std::string_view text, long long* value) {
+	double parsed = 0;
+	responseStatus_t status = parseResponseNumber(text, &parsed);
+	if (status != RESPONSE_OK) {
+		return status;
+	}
+	if (parsed != std::floor(parsed)) {
+		return RESPONSE_NOT_A_NUMBER;
+	}
+	if (std::fabs(parsed) > 9.0e18) {
+		return RESPONSE_OUT_OF_RANGE;
+	}
+	*value = (long long)parsed;
+	return RESPONSE_OK;
+}
+
+// 0/1 answers, ie *OPC? and ON/OFF queries
+responseStatus_t parseResponseBool(std::string_view text, bool* value) {
+	long long parsed = 0;
+	size_t first = 0;
+	size_t last = text.length();
+	while (first < last && responseIsSpace(text[first])) { first++; }
+	while (last > first && responseIsSpace(text[last - 1])) { last--; }
+	std::string_view word = text.substr(first, last - first);
+	if (word == "ON" || word == "on") { *value = true; return RESPONSE_OK; }
+	if (word == "OFF" || word == "off") { *value = false; return RESPONSE_OK; }
+	responseStatus_t status = parseResponseInteger(word, &parsed);
+	if (status != RESPONSE_OK) {
+		return status;
+	}
+	if (parsed != 0 && parsed != 1) {
+		return RESPONSE_NOT_A_NUMBER;
+	}
+	*value = (parsed == 1);
+	return RESPONSE_OK;
+}
+
+// usable values: ok, and the instrument's NaN/overrange (which the caller may want to record as such)
+bool responseHasValue(responseStatus_t status) {
+	return status == RESPONSE_OK || status == RESPONSE_INSTRUMENT_NAN || status == RESPONSE_INSTRUMENT_INFINITY;
+}
+
+// replies to compound queries (A?;B?) and lists come back separated by ';' or ','.
+// returns how many values were read; stops at the first one that doesn't parse, and reports it in *status
+int parseResponseList(std::string_view text, double* values, int maxValues, responseStatus_t* status) {
+	int count = 0;
+	size_t start = 0;
+	*status = RESPONSE_OK;
+	while (count < maxValues && start <= text.length()) {
+		size_t end = text.find_first_of(";,", start);
+		if (end == std::string_view::npos) {
+			end = text.length();
+		}
+		responseStatus_t fieldStatus = parseResponseNumber(text.substr(start, end - start), &values[count]);
+		if (!responseHasValue(fieldStatus)) {
+			if (!(fieldStatus == RESPONSE_EMPTY && end == text.length() && count > 0)) { // a trailing separator is fine
+				*status = fieldStatus;
+			}
+			return count;
+		}
+		count++;
+		start = end + 1;
+	}
+	return count;
+}
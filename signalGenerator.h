@@ -18,64 +18,95 @@
 
 #include <visa.h> //https://edadocs.software.keysight.com/connect/setting-up-a-visual-studio-c++-visa-project-482552069.html
 #include "helperFunctions.h"
+#include "instrumentShadow.h"
+#include "scpiCommands.h"
+#include "scpiResponse.h"
 #include "chamber.h"
 
 
 extern ViSession globalVisaResourceManager;
 extern ViStatus  globalVisaStatus;
-extern std::string visaReceiveText;
 
 extern ViSession visaSignalGeneratorSession;
+extern visaReceiveBuffer visaSignalGeneratorReceive;
 extern ViRsrc signalGeneratorRsrc;
 
-extern bool deviceConnectionStatus[4];
+extern bool deviceConnectionStatus[DEVICE_STATUS_DEVICES_MAX];
+
+instrumentShadow signalGenShadow; // last confirmed settings, see instrumentShadow.h
 
 
 bool isSignalGenConnected() {
 	return deviceConnectionStatus[DEVICE_STATUS_INDEX_SIGNAL_GENERATOR];
 }
 bool isSignalGenReady() {
-	//visaClearReceiveBuffer(&visaSignalGeneratorSession);
-	visaCommand(&visaSignalGeneratorSession, VISA_COMMAND_CHECK_OPERATION_COMPLETE, &visaReceiveText);
-	if (visaReceiveText == VISA_RESPONSE_TRUE || visaReceiveText == VISA_RESPONSE_TRUE_2) {
-		return true;
-	} else if (visaReceiveText == VISA_RESPONSE_FALSE || visaReceiveText == VISA_RESPONSE_FALSE_2) {
-		return false;
+	//visaClearReceiveBuffer(&visaSignalGeneratorSession, &visaSignalGeneratorReceive);
+	std::string_view response;
+	visaCommand(&visaSignalGeneratorSession, VISA_COMMAND_CHECK_OPERATION_COMPLETE, &visaSignalGeneratorReceive, &response);
+	bool ready = false;
+	if (parseResponseBool(response, &ready) == RESPONSE_OK) {
+		return ready;
 	} else {
 		errorOut("Unreconized response from VISA Device (SignalGenerator).");
-		errorOut(visaReceiveText);
+		errorOut(std::string(response));
 		return false;
 	}
 }
 bool resetSignalGen() {
-	visaSend(&visaSignalGeneratorSession, "*RST\r\n");
+	shadowInvalidate(&signalGenShadow);
+	visaSend(&visaSignalGeneratorSession, scpiFormat(SCPI_SIGNAL_GEN_RESET));
 	return isSignalGenReady();
 }
+// writes a setting unless the shadow says the generator already has it; a real write is always followed by *OPC?
+bool setSignalGenSetting(int setting, double value, const scpiCommand& command) {
+	if (shadowSkipWrite(&signalGenShadow, setting, value, 2)) { // command, and *OPC?
+		return true;
+	}
+	visaSend(&visaSignalGeneratorSession, command);
+	if (isSignalGenReady()) {
+		shadowWritten(&signalGenShadow, setting, value);
+		return true;
+	}
+	shadowForget(&signalGenShadow, setting);
+	return false;
+}
+// reads a setting back, unless the shadow can answer. NaN if the generator's answer couldn't be read
+double getSignalGenSetting(int setting, const char* query, responseUnit_t unit, std::string description) {
+	double d = 0;
+	std::string_view response;
+	if (shadowRead(&signalGenShadow, setting, &d)) {
+		return d;
+	}
+	visaCommand(&visaSignalGeneratorSession, query, &visaSignalGeneratorReceive, &response);
+	responseStatus_t status = parseResponseNumber(response, &d, unit);
+	if (status != RESPONSE_OK) {
+		errorOut("Signal generator " + description + " could not be read (" + responseStatusText(status) + "): \"" + std::string(response) + "\"");
+		shadowForget(&signalGenShadow, setting);
+		return NAN;
+	}
+	if (!shadowConfirm(&signalGenShadow, setting, d)) {
+		errorOut("Signal generator " + description + " changed since it was last set (now " + std::string(response) + ").");
+	}
+	return d;
+}
 float getSignalGenPower() { // in dBm
-	visaCommand(&visaSignalGeneratorSession, VISA_COMMAND_SIGNAL_GENERATOR_GET_POWER, &visaReceiveText);
-	double d = strtod(visaReceiveText.c_str(), nullptr);
-	return (float)d;
+	return (float)getSignalGenSetting(SHADOW_SIGNAL_GEN_POWER, VISA_COMMAND_SIGNAL_GENERATOR_GET_POWER, RESPONSE_UNIT_DBM, "power");
 }
-int getSignalGenFreq() { // in Hz
-	visaCommand(&visaSignalGeneratorSession, VISA_COMMAND_SIGNAL_GENERATOR_GET_FREQUENCY, &visaReceiveText);
-	double d = strtod(visaReceiveText.c_str(), nullptr);
-	return (int)d;
+double getSignalGenFreq() { // in Hz; double, since an int overflows above 2.1 GHz
+	return getSignalGenSetting(SHADOW_SIGNAL_GEN_FREQUENCY, VISA_COMMAND_SIGNAL_GENERATOR_GET_FREQUENCY, RESPONSE_UNIT_HERTZ, "frequency");
 }
 bool setSignalGenPower(float powerInDB) {
-	visaSend(&visaSignalGeneratorSession, "POW " + std::to_string(powerInDB) + "dBm" + "\r\n");
-	return isSignalGenReady();
+	return setSignalGenSetting(SHADOW_SIGNAL_GEN_POWER, powerInDB, scpiFormat(SCPI_SIGNAL_GEN_POWER, powerInDB));
 }
 bool setSignalGenFreq(double freqInHz, int exponent) {
-	visaSend(&visaSignalGeneratorSession, "FREQ " + std::to_string(freqInHz) + "E" + std::to_string(exponent) + "Hz" + "\r\n");
-	return isSignalGenReady();
+	double freq = freqInHz * pow(10, exponent);
+	return setSignalGenSetting(SHADOW_SIGNAL_GEN_FREQUENCY, freq, scpiFormat(SCPI_SIGNAL_GEN_FREQUENCY, freq));
 }
 bool setSignalGenModOn() {
-	visaSend(&visaSignalGeneratorSession, "OUTP:MOD ON\r\n");
-	return isSignalGenReady();
+	return setSignalGenSetting(SHADOW_SIGNAL_GEN_MODULATION, 1, scpiFormat(SCPI_SIGNAL_GEN_MOD_ON));
 }
 bool setSignalGenModOff() {
-	visaSend(&visaSignalGeneratorSession, "OUTP:MOD OFF\r\n");
-	return isSignalGenReady();
+	return setSignalGenSetting(SHADOW_SIGNAL_GEN_MODULATION, 0, scpiFormat(SCPI_SIGNAL_GEN_MOD_OFF));
 }
 bool setSignalGenMod(bool modStatus) { // on or off, but will always use off
 	if (modStatus) {
@@ -85,12 +116,10 @@ bool setSignalGenMod(bool modStatus) { // on or off, but will always use off
 	}
 }
 bool setSignalGenOn() {
-	visaSend(&visaSignalGeneratorSession, "OUTPUT ON\r\n");
-	return isSignalGenReady();
+	return setSignalGenSetting(SHADOW_SIGNAL_GEN_OUTPUT, 1, scpiFormat(SCPI_SIGNAL_GEN_OUTPUT_ON));
 }
 bool setSignalGenOff() {
-	visaSend(&visaSignalGeneratorSession, "OUTPUT OFF\r\n");
-	return isSignalGenReady();
+	return setSignalGenSetting(SHADOW_SIGNAL_GEN_OUTPUT, 0, scpiFormat(SCPI_SIGNAL_GEN_OUTPUT_OFF));
 }
 bool setSignalGenState(bool powerStatus) {
 	if (powerStatus) {
@@ -0,0 +1,555 @@
+#pragma once
+// dry run (-d)
+// runs the real executor with timing models in place of the instruments and turntable. the transports
+// (visaHelperFunctions.h, telnetHelperFunctions.h) hand each command to a simulated device here, which answers it
+// and moves the virtual clock (chamberClock.h) on by about as long as the hardware would have taken; waits go
+// through chamberSleep(). nothing is written to disk. the report at the end has the total time, where it went,
+// how busy each bus was, and how far each axis travelled - enough to compare plans and settings before booking
+// the chamber. the numbers below are rough; change them to match the real equipment
+
+#define SIMULATION_SESSION_BASE (1000) // simulated session and socket values are this plus the device index
+
+#define SIMULATION_TURNTABLE_AZIMUTH_SPEED   (6.0) // degrees per second
+#define SIMULATION_TURNTABLE_ELEVATION_SPEED (3.0)
+#define SIMULATION_TURNTABLE_START_STOP      (400) // ms per move, accelerating and settling
+#define SIMULATION_TURNTABLE_AZIMUTH_MIN     (-180.0)
+#define SIMULATION_TURNTABLE_AZIMUTH_MAX     (180.0)
+#define SIMULATION_TURNTABLE_ELEVATION_MIN   (-90.0)
+#define SIMULATION_TURNTABLE_ELEVATION_MAX   (90.0)
+
+// ms, unless noted
+#define SIMULATION_GPIB_LATENCY       (2)    // per message, besides the bytes
+#define SIMULATION_GPIB_BYTES_PER_MS  (500)
+#define SIMULATION_LAN_LATENCY        (1)
+#define SIMULATION_LAN_BYTES_PER_MS   (5000)
+#define SIMULATION_GPIB_CONNECT       (50)
+#define SIMULATION_LAN_CONNECT        (400)
+#define SIMULATION_TURNTABLE_RESPONSE (15)
+#define SIMULATION_GENERATOR_RESPONSE (5)
+#define SIMULATION_GENERATOR_SETTLE   (20)   // after a frequency, power or output change, before *OPC? answers
+#define SIMULATION_ANALYZER_RESPONSE  (10)
+#define SIMULATION_ANALYZER_PRESET    (2000)
+#define SIMULATION_ANALYZER_MIN_SWEEP (0.02) // seconds
+#define SIMULATION_ANALYZER_SWEEP_K   (2.5)  // as SPECTRUM_ANALYZER_SWEEP_MODEL_K
+
+// what the analyzer sees: generator power, less the path loss and a gaussian main lobe at (0, 0), over thermal noise
+#define SIMULATION_PATH_LOSS     (40.0)   // dB at boresight
+#define SIMULATION_BEAMWIDTH     (30.0)   // degrees, -3 dB
+#define SIMULATION_NOISE_DENSITY (-164.0) // dBm/Hz, -174 plus a 10 dB noise figure, at the preset attenuation
+#define SIMULATION_ATTENUATION   (10.0)   // dB, the preset; every dB more raises the noise by as much
+#define SIMULATION_CROSS_POLAR   (20.0)   // dB less of the tone at the receivers after the fieldfox (a plan's [receivers])
+
+#define SIMULATION_ANALYZERS (4) // as SPECTRUM_ANALYZERS_MAX
+#define SIMULATION_DEVICES   (3 + SIMULATION_ANALYZERS)
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <visa.h>
+#include <Windows.h>
+
+#include "chamberClock.h"
+
+bool interfaceOut(std::string mesg, bool needsAnswer); // from helperFunctions.h
+
+enum simulationBus_t {
+	SIMULATION_BUS_GPIB,
+	SIMULATION_BUS_LAN
+};
+
+// indexed like deviceConnectionStatus (DEVICE_STATUS_INDEX_*); only the fields for its kind of device are used
+struct simulationDevice {
+	std::string name = "";
+	simulationBus_t bus = SIMULATION_BUS_GPIB;
+	int responseMs = 0;
+	bool open = false;
+	std::string reply = "";
+	long long replyReadyNs = 0;
+	long long replyOperationNs = 0; // of the wait for the reply, how much is an operation finishing (sweep, settling)
+	long long pendingUntilNs = 0;   // the operation *OPC? waits for
+
+	long long transactions = 0;
+	long long bytes = 0;
+	long long busyNs = 0;      // on the bus: bytes, latency, and waiting on replies
+	long long hostNs = 0;      // the transports' own delays after each send
+	long long operationNs = 0; // of busyNs, waiting on operations
+
+	// turntable axis
+	double speed = 1;
+	double limitMin = 0;
+	double limitMax = 0;
+	double from = 0;
+	double target = 0;
+	long long moveStartNs = 0;
+	long long moveEndNs = 0;
+	double travel = 0; // degrees
+	int moves = 0;
+
+	// signal generator
+	double frequency = 1e9;
+	double power = -10;
+	bool output = false;
+	bool modulation = false;
+
+	// spectrum analyzer
+	double start = 1e9 - 5e6;
+	double stop = 1e9 + 5e6;
+	double bwRes = 0;   // 0 is auto
+	double bwVideo = 0;
+	int points = 401;
+	double sweepTime = 0; // seconds, 0 is auto
+	double attenuation = SIMULATION_ATTENUATION;
+	double isolation = 0; // dB less of the tone than the fieldfox sees
+	double markerX = 0;
+	double heldPower = -INFINITY; // at the marker, over the sweeps since the trace was last cleared (max hold)
+	bool continuous = true;
+	int sweeps = 0;
+};
+
+bool simulationActive = false;
+simulationDevice simulationDevices[SIMULATION_DEVICES];
+long long simulationStartNs = 0;
+long long simulationConnectNs = 0;
+long long simulationWaitNs = 0;
+int simulationUnknownCommands = 0;
+std::string simulationFirstUnknown = "";
+
+void simulationStart() {
+	const char* names[4] = { "Turntable Azimuth", "Turntable Elevation", "Signal Generator", "Field Fox" };
+	for (int i = 0; i < 3; i++) {
+		simulationDevices[i] = simulationDevice();
+		simulationDevices[i].name = names[i];
+	}
+	simulationDevices[0].speed = SIMULATION_TURNTABLE_AZIMUTH_SPEED;
+	simulationDevices[0].limitMin = SIMULATION_TURNTABLE_AZIMUTH_MIN;
+	simulationDevices[0].limitMax = SIMULATION_TURNTABLE_AZIMUTH_MAX;
+	simulationDevices[1].speed = SIMULATION_TURNTABLE_ELEVATION_SPEED;
+	simulationDevices[1].limitMin = SIMULATION_TURNTABLE_ELEVATION_MIN;
+	simulationDevices[1].limitMax = SIMULATION_TURNTABLE_ELEVATION_MAX;
+	simulationDevices[0].responseMs = SIMULATION_TURNTABLE_RESPONSE;
+	simulationDevices[1].responseMs = SIMULATION_TURNTABLE_RESPONSE;
+	simulationDevices[2].responseMs = SIMULATION_GENERATOR_RESPONSE;
+	for (int i = 3; i < SIMULATION_DEVICES; i++) { // the fieldfox, then any other receivers
+		simulationDevices[i] = simulationDevice();
+		simulationDevices[i].name = (i == 3) ? names[3] : "Receiver " + std::to_string(i - 3);
+		simulationDevices[i].responseMs = SIMULATION_ANALYZER_RESPONSE;
+		simulationDevices[i].bus = SIMULATION_BUS_LAN;
+		simulationDevices[i].isolation = (i == 3) ? 0 : SIMULATION_CROSS_POLAR;
+	}
+	clockStartSimulated();
+	simulationStartNs = clockMonotonicNs();
+	simulationActive = true;
+}
+
+// every wait in the program; free in a dry run, but counted
+void chamberSleep(int ms) {
+	if (!simulationActive) {
+		Sleep(ms);
+		return;
+	}
+	if (ms > 0) {
+		simulationWaitNs += ms * 1000000LL;
+		clockAdvanceSimulated(ms * 1000000LL);
+	}
+}
+
+simulationDevice* simulationDeviceFor(long long session) {
+	long long index = session - SIMULATION_SESSION_BASE;
+	if (index < 0 || index >= SIMULATION_DEVICES || !simulationDevices[index].open) {
+		return nullptr;
+	}
+	return &simulationDevices[index];
+}
+
+// opens device (a DEVICE_STATUS_INDEX_*); returns the session value for it
+long long simulationOpen(int device) {
+	clockAdvanceSimulated((simulationDevices[device].bus == SIMULATION_BUS_LAN ? SIMULATION_LAN_CONNECT : SIMULATION_GPIB_CONNECT) * 1000000LL);
+	simulationDevices[device].open = true;
+	return SIMULATION_SESSION_BASE + device;
+}
+
+void simulationClose(long long session) {
+	simulationDevice* device = simulationDeviceFor(session);
+	if (device != nullptr) {
+		(*device).open = false;
+	}
+}
+
+long long simulationTransferNs(const simulationDevice& device, size_t bytes) {
+	if (device.bus == SIMULATION_BUS_LAN) {
+		return SIMULATION_LAN_LATENCY * 1000000LL + (long long)bytes * 1000000LL / SIMULATION_LAN_BYTES_PER_MS;
+	}
+	return SIMULATION_GPIB_LATENCY * 1000000LL + (long long)bytes * 1000000LL / SIMULATION_GPIB_BYTES_PER_MS;
+}
+
+// where an axis is now, moving at a constant speed between the start and stop
+double simulationAxisPosition(const simulationDevice& axis, long long nowNs) {
+	if (nowNs >= axis.moveEndNs || axis.moveEndNs <= axis.moveStartNs) {
+		return axis.target;
+	}
+	return axis.from + (axis.target - axis.from) * (double)(nowNs - axis.moveStartNs) / (double)(axis.moveEndNs - axis.moveStartNs);
+}
+
+// the bandwidths the analyzer is using, auto included
+double simulationAnalyzerBwRes(const simulationDevice& analyzer) {
+	return (analyzer.bwRes > 0) ? analyzer.bwRes : std::max(10.0, (analyzer.stop - analyzer.start) / 100);
+}
+double simulationAnalyzerBwVideo(const simulationDevice& analyzer) {
+	return (analyzer.bwVideo > 0) ? analyzer.bwVideo : simulationAnalyzerBwRes(analyzer);
+}
+
+double simulationAnalyzerSweepSeconds(const simulationDevice& analyzer) {
+	if (analyzer.sweepTime > 0) {
+		return analyzer.sweepTime;
+	}
+	double bwRes = simulationAnalyzerBwRes(analyzer);
+	double narrowest = std::min(bwRes, simulationAnalyzerBwVideo(analyzer));
+	return std::max(SIMULATION_ANALYZER_MIN_SWEEP, SIMULATION_ANALYZER_SWEEP_K * (analyzer.stop - analyzer.start) / (bwRes * narrowest));
+}
+
+// dBm at one analyzer frequency: the tone (if it's within the RBW) on top of the noise
+double simulationReceivedPower(const simulationDevice& analyzer, double frequency) {
+	const simulationDevice& generator = simulationDevices[2];
+	long long nowNs = clockMonotonicNs();
+	double bwRes = simulationAnalyzerBwRes(analyzer);
+	double noiseMw = std::pow(10, (SIMULATION_NOISE_DENSITY + analyzer.attenuation - SIMULATION_ATTENUATION + 10 * std::log10(bwRes)) / 10);
+	double toneMw = 0;
+	if (generator.output && std::fabs(frequency - generator.frequency) <= bwRes) {
+		double azimuth = simulationAxisPosition(simulationDevices[0], nowNs) / SIMULATION_BEAMWIDTH;
+		double elevation = simulationAxisPosition(simulationDevices[1], nowNs) / SIMULATION_BEAMWIDTH;
+		toneMw = std::pow(10, (generator.power - SIMULATION_PATH_LOSS - analyzer.isolation - 12 * (azimuth * azimuth + elevation * elevation)) / 10);
+	}
+	return 10 * std::log10(toneMw + noiseMw);
+}
+
+std::string simulationNumber(double value) {
+	char text[32];
+	snprintf(text, sizeof(text), "%.10g", value);
+	return text;
+}
+
+// "KEYWORD value" (or just "KEYWORD"); *value is NaN if there isn't a number
+bool simulationKeyword(std::string_view command, const char* keyword, double* value) {
+	size_t length = strlen(keyword);
+	if (command.substr(0, length) != keyword || (command.length() > length && command[length] != ' ')) {
+		return false;
+	}
+	std::string rest(command.substr(std::min(length, command.length())));
+	char* end = nullptr;
+	*value = strtod(rest.c_str(), &end);
+	if (end == rest.c_str()) {
+		*value = NAN;
+	}
+	return true;
+}
+
+// one command of a (possibly compound) message; false if the device doesn't know it
+bool simulationTurntableCommand(simulationDevice* axis, std::string_view command, long long nowNs, std::string* reply) {
+	double value = 0;
+	if (command == "*OPC?") {
+		*reply = (nowNs >= (*axis).moveEndNs) ? "1" : "0"; // the executor polls this while the axis moves
+	} else if (command == "CP") {
+		*reply = simulationNumber(simulationAxisPosition(*axis, nowNs));
+	} else if (command == "UL") {
+		*reply = simulationNumber((*axis).limitMax);
+	} else if (command == "LL") {
+		*reply = simulationNumber((*axis).limitMin);
+	} else if (simulationKeyword(command, "GOTO", &value)) {
+		if (!std::isfinite(value) || value < (*axis).limitMin || (*axis).limitMax < value) {
+			return true; // a real controller ignores it too
+		}
+		(*axis).from = simulationAxisPosition(*axis, nowNs);
+		(*axis).target = value;
+		(*axis).travel += std::fabs(value - (*axis).from);
+		(*axis).moves++;
+		(*axis).moveStartNs = nowNs;
+		(*axis).moveEndNs = nowNs + (long long)((SIMULATION_TURNTABLE_START_STOP + 1000 * std::fabs(value - (*axis).from) / (*axis).speed) * 1000000);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool simulationGeneratorCommand(simulationDevice* generator, std::string_view command, long long nowNs, std::string* reply) {
+	double value = 0;
+	long long settledNs = nowNs + SIMULATION_GENERATOR_SETTLE * 1000000LL;
+	if (command == "FREQ?") {
+		*reply = simulationNumber((*generator).frequency);
+	} else if (command == "POW?") {
+		*reply = simulationNumber((*generator).power);
+	} else if (command == "OUTP:MOD?") {
+		*reply = (*generator).modulation ? "1" : "0";
+	} else if (command == "OUTP?") {
+		*reply = (*generator).output ? "1" : "0";
+	} else if (simulationKeyword(command, "FREQ", &value) && std::isfinite(value)) {
+		(*generator).frequency = value;
+		(*generator).pendingUntilNs = settledNs;
+	} else if (simulationKeyword(command, "POW", &value) && std::isfinite(value)) {
+		(*generator).power = value;
+		(*generator).pendingUntilNs = settledNs;
+	} else if (command == "OUTPUT ON" || command == "OUTPUT OFF") {
+		(*generator).output = (command == "OUTPUT ON");
+		(*generator).pendingUntilNs = settledNs;
+	} else if (command == "OUTP:MOD ON" || command == "OUTP:MOD OFF") {
+		(*generator).modulation = (command == "OUTP:MOD ON");
+	} else if (command == "*RST") {
+		(*generator).output = false;
+		(*generator).modulation = false;
+		(*generator).pendingUntilNs = settledNs;
+	} else if (!simulationKeyword(command, "*SAV", &value) && !simulationKeyword(command, "*RCL", &value)) {
+		return false;
+	}
+	return true;
+}
+
+bool simulationAnalyzerCommand(simulationDevice* analyzer, std::string_view command, long long nowNs, std::string* reply) {
+	double value = 0;
+	double span = (*analyzer).stop - (*analyzer).start;
+	double center = ((*analyzer).start + (*analyzer).stop) / 2;
+	if (command.substr(0, 9) == "CALC:MARK" && command.length() > 9) {
+		command.remove_prefix(10); // and the marker number; there's only one marker here
+		if (command == ":Y?") { // a free running analyzer is sweeping as it's read
+			double live = (*analyzer).continuous ? simulationReceivedPower(*analyzer, ((*analyzer).markerX > 0) ? (*analyzer).markerX : center) : -INFINITY;
+			*reply = simulationNumber(std::max((*analyzer).heldPower, live));
+		} else if (command == ":X?") {
+			*reply = simulationNumber((*analyzer).markerX);
+		} else if (simulationKeyword(command, ":X", &value)) {
+			(*analyzer).markerX = value;
+		} else if (command != " NORM") {
+			return false;
+		}
+	} else if (command == "SENS:SWE:TIME?") {
+		*reply = simulationNumber(simulationAnalyzerSweepSeconds(*analyzer));
+	} else if (command == "SENS:FREQ:SPAN?") {
+		*reply = simulationNumber(span);
+	} else if (command == "SENS:FREQ:START?") {
+		*reply = simulationNumber((*analyzer).start);
+	} else if (command == "SENS:FREQ:STOP?") {
+		*reply = simulationNumber((*analyzer).stop);
+	} else if (command == "SENS:BAND:RES?") {
+		*reply = simulationNumber(simulationAnalyzerBwRes(*analyzer));
+	} else if (command == "SENS:BAND:VID?") {
+		*reply = simulationNumber(simulationAnalyzerBwVideo(*analyzer));
+	} else if (command == "SENS:SWEEP:POINTS?") {
+		*reply = std::to_string((*analyzer).points);
+	} else if (command == "TRACE:DATA?") {
+		for (int i = 0; i < (*analyzer).points; i++) {
+			double frequency = ((*analyzer).points > 1) ? (*analyzer).start + span * i / ((*analyzer).points - 1) : center;
+			*reply += ((i > 0) ? "," : "") + simulationNumber(simulationReceivedPower(*analyzer, frequency));
+		}
+	} else if (command == "INIT:IMM") {
+		(*analyzer).pendingUntilNs = std::max((*analyzer).pendingUntilNs, nowNs) + (long long)(simulationAnalyzerSweepSeconds(*analyzer) * 1e9);
+		(*analyzer).sweeps++;
+		(*analyzer).heldPower = std::max((*analyzer).heldPower, simulationReceivedPower(*analyzer, ((*analyzer).markerX > 0) ? (*analyzer).markerX : center));
+	} else if (command == "SYST:PRES") {
+		simulationDevice preset;
+		(*analyzer).start = preset.start;
+		(*analyzer).stop = preset.stop;
+		(*analyzer).bwRes = 0;
+		(*analyzer).bwVideo = 0;
+		(*analyzer).points = preset.points;
+		(*analyzer).sweepTime = 0;
+		(*analyzer).attenuation = SIMULATION_ATTENUATION;
+		(*analyzer).pendingUntilNs = nowNs + SIMULATION_ANALYZER_PRESET * 1000000LL;
+	} else if (simulationKeyword(command, "SENS:FREQ:START", &value) && std::isfinite(value)) {
+		(*analyzer).start = value;
+	} else if (simulationKeyword(command, "SENS:FREQ:STOP", &value) && std::isfinite(value)) {
+		(*analyzer).stop = value;
+	} else if (simulationKeyword(command, "SENS:FREQ:CENT", &value) && std::isfinite(value)) {
+		(*analyzer).start = value - span / 2;
+		(*analyzer).stop = value + span / 2;
+	} else if (simulationKeyword(command, "SENS:FREQ:SPAN", &value) && std::isfinite(value)) {
+		(*analyzer).start = center - value / 2;
+		(*analyzer).stop = center + value / 2;
+	} else if (simulationKeyword(command, "SENS:SWE:TIME", &value) && std::isfinite(value)) {
+		(*analyzer).sweepTime = value;
+	} else if (simulationKeyword(command, "SENS:BAND:RES", &value) && std::isfinite(value)) {
+		(*analyzer).bwRes = value;
+	} else if (simulationKeyword(command, "SENS:BAND:VID", &value) && std::isfinite(value)) {
+		(*analyzer).bwVideo = value;
+	} else if (simulationKeyword(command, "SENS:POW:ATT", &value) && value >= 0) {
+		(*analyzer).attenuation = value;
+	} else if (simulationKeyword(command, "SENS:SWEEP:POINTS", &value) && value >= 1) {
+		(*analyzer).points = (int)value;
+	} else if (!simulationKeyword(command, "SENS:DET:FUNC", &value) && !simulationKeyword(command, "INST:SEL", &value)
+		&& !simulationKeyword(command, "MMEM:STOR:STAT", &value) && !simulationKeyword(command, "MMEM:LOAD:STAT", &value)
+		&& command != "INIT:CONT ON" && command != "INIT:CONT OFF" && command != "TRAC:TYPE CLRW" && command != "TRAC:TYPE MAXH") {
+		return false;
+	}
+	if (command == "INIT:CONT ON" || command == "INIT:CONT OFF") {
+		(*analyzer).continuous = (command == "INIT:CONT ON");
+	} else if (command == "TRAC:TYPE CLRW" || command == "TRAC:TYPE MAXH") {
+		(*analyzer).heldPower = -INFINITY;
+	}
+	return true;
+}
+
+// a whole message: commands split on ';', answers joined with ';' like the instruments do
+void simulationHandle(simulationDevice* device, std::string_view message) {
+	long long nowNs = clockMonotonicNs();
+	int index = (int)(device - simulationDevices);
+	(*device).reply = "";
+	(*device).replyReadyNs = nowNs + (*device).responseMs * 1000000LL;
+	(*device).replyOperationNs = 0;
+	size_t start = 0;
+	while (start < message.length()) {
+		size_t end = message.find(';', start);
+		end = (end == std::string_view::npos) ? message.length() : end;
+		std::string_view command = message.substr(start, end - start);
+		start = end + 1;
+		while (!command.empty() && (command.front() == ':' || command.front() == ' ')) { command.remove_prefix(1); }
+		while (!command.empty() && (command.back() == '\r' || command.back() == '\n' || command.back() == ' ')) { command.remove_suffix(1); }
+		if (command.empty()) {
+			continue;
+		}
+		std::string answer = "";
+		bool known = false;
+		if (index <= 1) {
+			known = simulationTurntableCommand(device, command, nowNs, &answer);
+		} else if (command == "*OPC?") { // waits for whatever is still going on
+			long long waitNs = std::max(0LL, (*device).pendingUntilNs - nowNs);
+			(*device).replyReadyNs = nowNs + waitNs + (*device).responseMs * 1000000LL;
+			(*device).replyOperationNs = waitNs;
+			answer = "1";
+			known = true;
+		} else if (index == 2) {
+			known = simulationGeneratorCommand(device, command, nowNs, &answer);
+		} else {
+			known = simulationAnalyzerCommand(device, command, nowNs, &answer);
+		}
+		if (!known) {
+			if (simulationUnknownCommands++ == 0) {
+				simulationFirstUnknown = (*device).name + ": " + std::string(command);
+			}
+			if (command.back() == '?') {
+				answer = "0";
+			}
+		}
+		if (!answer.empty()) {
+			(*device).reply += ((*device).reply.empty() ? "" : ";") + answer;
+		}
+	}
+}
+
+// the transports call these instead of the bus, in a dry run
+int simulationSend(long long session, const char* command, int commandLength, int hostDelayMs) {
+	simulationDevice* device = simulationDeviceFor(session);
+	if (device == nullptr) {
+		return 1;
+	}
+	long long transferNs = simulationTransferNs(*device, commandLength);
+	clockAdvanceSimulated(transferNs);
+	(*device).busyNs += transferNs;
+	(*device).bytes += commandLength;
+	(*device).transactions++;
+	simulationHandle(device, std::string_view(command, commandLength));
+	clockAdvanceSimulated(hostDelayMs * 1000000LL);
+	(*device).hostNs += hostDelayMs * 1000000LL;
+	return 0;
+}
+
+// waits for the reply to the last message; false if it doesn't come within timeoutMs
+bool simulationReceive(long long session, int timeoutMs, std::string* reply) {
+	simulationDevice* device = simulationDeviceFor(session);
+	if (device == nullptr) {
+		return false;
+	}
+	long long waitNs = std::max(0LL, (*device).replyReadyNs - clockMonotonicNs());
+	if (waitNs > timeoutMs * 1000000LL) {
+		clockAdvanceSimulated(timeoutMs * 1000000LL);
+		(*device).busyNs += timeoutMs * 1000000LL;
+		return false;
+	}
+	long long transferNs = simulationTransferNs(*device, (*device).reply.length() + 1);
+	clockAdvanceSimulated(waitNs + transferNs);
+	(*device).busyNs += waitNs + transferNs;
+	(*device).operationNs += std::min(waitNs, (*device).replyOperationNs);
+	(*device).bytes += (*device).reply.length() + 1;
+	*reply = (*device).reply;
+	(*device).reply = "";
+	return true;
+}
+
+// bring-up is reported on its own; everything after it is what the report breaks down
+void simulationEndConnect() {
+	simulationConnectNs = clockMonotonicNs() - simulationStartNs;
+	for (simulationDevice& device : simulationDevices) {
+		device.transactions = 0;
+		device.bytes = 0;
+		device.busyNs = 0;
+		device.hostNs = 0;
+		device.operationNs = 0;
+	}
+	simulationWaitNs = 0;
+}
+
+std::string simulationDurationText(long long ns) {
+	long long seconds = ns / 1000000000;
+	char text[48];
+	snprintf(text, sizeof(text), "%lld:%02lld:%02lld", seconds / 3600, seconds / 60 % 60, seconds % 60);
+	return text;
+}
+
+std::string simulationStageText(const char* name, long long ns, long long totalNs) {
+	char text[96];
+	snprintf(text, sizeof(text), "  %-26s %10s  %5.1f%%", name, simulationDurationText(ns).c_str(), (totalNs > 0) ? 100.0 * ns / totalNs : 0.0);
+	return text;
+}
+
+// rejectedPositions < 0 leaves that line out (no position list, ie boresight searches)
+void printSimulationReport(int positions, int rejectedPositions) {
+	const simulationDevice& azimuth = simulationDevices[0];
+	const simulationDevice& elevation = simulationDevices[1];
+	const simulationDevice& generator = simulationDevices[2];
+	const simulationDevice& analyzer = simulationDevices[3];
+	long long totalNs = clockMonotonicNs() - simulationStartNs;
+	long long runNs = totalNs - simulationConnectNs;
+	long long turntableNs = azimuth.busyNs + azimuth.hostNs + elevation.busyNs + elevation.hostNs;
+	long long generatorNs = generator.busyNs + generator.hostNs;
+	long long analyzerNs = analyzer.busyNs + analyzer.hostNs - analyzer.operationNs;
+	long long otherNs = runNs - turntableNs - generatorNs - analyzerNs - analyzer.operationNs - simulationWaitNs;
+	long long gpibNs = azimuth.busyNs + elevation.busyNs + generator.busyNs;
+	// the other receivers overlap the fieldfox's time, so they only add to the bus and sweep counts
+	long long lanNs = 0;
+	long long lanTransactions = 0;
+	long long lanBytes = 0;
+	int analyzerSweeps = 0;
+	int receivers = 0;
+	for (int i = 3; i < SIMULATION_DEVICES; i++) {
+		lanNs += simulationDevices[i].busyNs;
+		lanTransactions += simulationDevices[i].transactions;
+		lanBytes += simulationDevices[i].bytes;
+		analyzerSweeps += simulationDevices[i].sweeps;
+		receivers += (simulationDevices[i].transactions > 0) ? 1 : 0;
+	}
+
+	interfaceOut("Dry run: " + std::to_string(positions) + " positions in " + simulationDurationText(totalNs) + " (h:mm:ss, simulated)", false);
+	if (rejectedPositions >= 0) {
+		interfaceOut("  " + std::to_string(rejectedPositions) + " positions outside the turntable soft limits (isTurntablePosValid)", false);
+	}
+	interfaceOut(simulationStageText("connecting", simulationConnectNs, totalNs), false);
+	interfaceOut(simulationStageText("turntable moves and polls", turntableNs, totalNs), false);
+	interfaceOut(simulationStageText("analyzer sweeps", analyzer.operationNs, totalNs), false);
+	interfaceOut(simulationStageText("analyzer commands", analyzerNs, totalNs), false);
+	interfaceOut(simulationStageText("signal generator", generatorNs, totalNs), false);
+	interfaceOut(simulationStageText("settling, dwell and beeps", simulationWaitNs, totalNs), false);
+	if (otherNs > 0) {
+		interfaceOut(simulationStageText("other", otherNs, totalNs), false);
+	}
+	char text[160];
+	snprintf(text, sizeof(text), "  bus use after connecting: GPIB %.1f%% (%lld messages, %lld bytes), LAN %.1f%% (%lld messages, %lld bytes)",
+		(runNs > 0) ? 100.0 * gpibNs / runNs : 0.0, azimuth.transactions + elevation.transactions + generator.transactions,
+		azimuth.bytes + elevation.bytes + generator.bytes, (runNs > 0) ? 100.0 * lanNs / runNs : 0.0, lanTransactions, lanBytes);
+	interfaceOut(text, false);
+	snprintf(text, sizeof(text), "  travel: azimuth %.1f degrees in %d moves, elevation %.1f degrees in %d moves; %d analyzer sweeps%s",
+		azimuth.travel, azimuth.moves, elevation.travel, elevation.moves, analyzerSweeps,
+		(receivers > 1) ? (" on " + std::to_string(receivers) + " receivers").c_str() : "");
+	interfaceOut(text, false);
+	if (simulationUnknownCommands > 0) {
+		interfaceOut("  " + std::to_string(simulationUnknownCommands) + " commands the models don't know (first: " + simulationFirstUnknown + ")", false);
+	}
+}
@@ -0,0 +1,218 @@
+#pragma once
+// keeps a sweep going through instrument faults. each device is checked on its own, and one that times out, drops
+// its connection or answers nonsense gets only its own session closed and opened again, waiting twice as long
+// after every try that fails. the sweep measures the interrupted position again; the time it all took is counted as lost
+
+#define SUPERVISION_BACKOFF_START    (1000)  // ms before the second reconnect
+#define SUPERVISION_BACKOFF_MAX      (60000) // ms; the wait doubles up to this, and stays there until the device is back
+#define SUPERVISION_POSITION_RETRIES (3)     // times one position is measured again before its row is written as it is
+
+#include <string>
+#include <algorithm>
+
+#include "helperFunctions.h"
+#include "deviceFault.h"
+#include "signalGenerator.h"
+#include "fieldfox.h"
+#include "turntable.h"
+
+bool shouldSaveAndClose(); // from chamber.h
+
+const char* SUPERVISED_DEVICE_NAMES[] = { "turntable azimuth", "turntable elevation", "signal generator", "field fox" }; // DEVICE_STATUS_INDEX_* order
+
+// the fixed ones, then the other receivers (a plan's [receivers]) after the fieldfox
+int supervisedDeviceCount() {
+	return DEVICE_STATUS_INDEX_FIELDFOX + spectrumAnalyzerCount;
+}
+
+std::string supervisedDeviceName(int device) {
+	if (device > DEVICE_STATUS_INDEX_FIELDFOX) {
+		return "receiver " + spectrumAnalyzers[device - DEVICE_STATUS_INDEX_FIELDFOX].name;
+	}
+	return SUPERVISED_DEVICE_NAMES[device];
+}
+
+struct deviceSupervision {
+	int faults[DEVICE_FAULT_KINDS] = {};
+	int reconnects = 0;
+	long long lostMs = 0; // from finding the fault to the device answering again
+};
+deviceSupervision supervisedDevices[DEVICE_STATUS_DEVICES_MAX];
+int supervisionRetriedPositions = 0;
+long long supervisionLostMs = 0; // all of it, including the positions that were measured again
+
+// puts a reconnected generator or analyzer (a DEVICE_STATUS_INDEX_*) back to the sweep's settings (set by chamberOps.cpp)
+void (*supervisionRestore)(int device, long long frequency, int power) = nullptr;
+
+// while nothing is being measured, whether there's something better to do than wait on a device that stays down (set by daemon.h)
+bool (*supervisionIdleInterrupted)() = nullptr;
+
+bool supervisionShouldStop(bool idle) {
+	return shouldSaveAndClose() || (idle && supervisionIdleInterrupted != nullptr && supervisionIdleInterrupted());
+}
+
+// the session, the same way for startup and for a reconnect; the turntables report their soft limits again too.
+// an analyzer is selected for the call, so this works from any thread
+bool openDeviceSession(int device) {
+	switch (device) {
+	case DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH:
+		return setupVisaInstrument(turntableAzimuthRsrc, &visaTurntableAzimuthSession, device, DEVICE_TIMEOUT_TURNTABLE) && getTurntableSoftLimitsAzi();
+	case DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION:
+		return setupVisaInstrument(turntableElevationRsrc, &visaTurntableElevationSession, device, DEVICE_TIMEOUT_TURNTABLE) && getTurntableSoftLimitsEle();
+	case DEVICE_STATUS_INDEX_SIGNAL_GENERATOR:
+		return setupVisaInstrument(signalGeneratorRsrc, &visaSignalGeneratorSession, device, DEVICE_TIMEOUT_SIGNAL_GENERATOR);
+	}
+	int previous = selectSpectrumAnalyzer(device - DEVICE_STATUS_INDEX_FIELDFOX);
+	bool opened = setupTelnet(DEVICE_TIMEOUT_FIELDFOX);
+	selectSpectrumAnalyzer(previous);
+	return opened;
+}
+
+void closeDeviceSession(int device) {
+	switch (device) {
+	case DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH:   visaCloseInstrument(&visaTurntableAzimuthSession);   break;
+	case DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION: visaCloseInstrument(&visaTurntableElevationSession); break;
+	case DEVICE_STATUS_INDEX_SIGNAL_GENERATOR:    visaCloseInstrument(&visaSignalGeneratorSession);    break;
+	default: telnetStopControl(&spectrumAnalyzers[device - DEVICE_STATUS_INDEX_FIELDFOX].socket); break;
+	}
+	deviceConnectionStatus[device] = false;
+	// it may come back power cycled, so nothing it was told before counts
+	if (device == DEVICE_STATUS_INDEX_SIGNAL_GENERATOR) {
+		shadowInvalidate(&signalGenShadow);
+	} else if (device >= DEVICE_STATUS_INDEX_FIELDFOX) {
+		shadowInvalidate(&spectrumAnalyzers[device - DEVICE_STATUS_INDEX_FIELDFOX].shadow);
+	}
+}
+
+bool isDeviceReady(int device) {
+	switch (device) {
+	case DEVICE_STATUS_INDEX_TURNTABLE_AZIMUTH:   return isTurntableAziReady();
+	case DEVICE_STATUS_INDEX_TURNTABLE_ELEVATION: return isTurntableEleReady();
+	case DEVICE_STATUS_INDEX_SIGNAL_GENERATOR:    return isSignalGenReady();
+	}
+	int previous = selectSpectrumAnalyzer(device - DEVICE_STATUS_INDEX_FIELDFOX);
+	bool ready = isSpectrumAnalyzerReady();
+	selectSpectrumAnalyzer(previous);
+	return ready;
+}
+
+// one *OPC? round trip; if it doesn't come back as "1", the transport says why (or the answer was the problem)
+deviceFault_t probeDevice(int device) {
+	if (!deviceConnectionStatus[device]) {
+		return DEVICE_FAULT_DISCONNECTED; // a reconnect that didn't get as far as a session
+	}
+	long long faultsBefore = transportFaultCount;
+	bool ready = isDeviceReady(device);
+	if (transportFaultCount != faultsBefore) { // a send that failed leaves the last reply behind, which can still read as "1"
+		return (deviceFault_t)transportLastFault.load();
+	}
+	return ready ? DEVICE_FAULT_NONE : DEVICE_FAULT_ERROR_REPLY;
+}
+
+// waits in short steps, so ctrl+c (or, idle, a new job) doesn't have to sit out a long backoff
+void supervisionWait(int waitMs, bool idle) {
+	for (int waited = 0; waited < waitMs && !supervisionShouldStop(idle); waited += 1000) {
+		chamberSleep(std::min(1000, waitMs - waited));
+	}
+}
+
+// brings one device back; false only if ctrl+c (or, idle, a new job or shutdown) came first
+bool recoverDevice(int device, deviceFault_t fault, bool idle) {
+	long long startNs = clockMonotonicNs();
+	int backoffMs = SUPERVISION_BACKOFF_START;
+	supervisedDevices[device].faults[fault]++;
+	if (fault == DEVICE_FAULT_ERROR_REPLY) { // may just have been a late reply to an earlier command; asking again reads it out of the way
+		fault = probeDevice(device);
+	}
+	for (int attempt = 1; fault != DEVICE_FAULT_NONE && !supervisionShouldStop(idle); attempt++) {
+		interfaceOut("Reconnecting to the " + supervisedDeviceName(device) + " (" + DEVICE_FAULT_NAMES[fault]
+			+ "), attempt " + std::to_string(attempt) + "...", false);
+		supervisedDevices[device].reconnects++;
+		closeDeviceSession(device);
+		fault = openDeviceSession(device) ? probeDevice(device) : DEVICE_FAULT_DISCONNECTED;
+		if (fault != DEVICE_FAULT_NONE) {
+			interfaceOut("  no luck, trying again in " + std::to_string(backoffMs / 1000) + " s", false);
+			supervisionWait(backoffMs, idle);
+			backoffMs = std::min(backoffMs * 2, SUPERVISION_BACKOFF_MAX);
+		}
+	}
+	long long lostMs = clockElapsedMs(startNs, clockMonotonicNs());
+	supervisedDevices[device].lostMs += lostMs;
+	if (fault != DEVICE_FAULT_NONE) {
+		return false;
+	}
+	interfaceOut("The " + supervisedDeviceName(device) + " is answering again (" + std::to_string(lostMs / 1000) + " s).", false);
+	return true;
+}
+
+// checks every device, and recovers the ones that don't answer. the rest keep their sessions.
+// frequency and power are what a reconnected generator or analyzer gets set back to
+// (a negative frequency is for when nothing is being measured; supervisionRestore decides what that means)
+bool superviseDevices(long long frequency, int power) {
+	deviceFault_t faults[DEVICE_STATUS_DEVICES_MAX];
+	std::string faulty = "";
+	for (int i = 0; i < supervisedDeviceCount(); i++) {
+		faults[i] = probeDevice(i);
+		if (faults[i] != DEVICE_FAULT_NONE) {
+			faulty += (faulty.empty() ? "" : ", ") + supervisedDeviceName(i) + " (" + DEVICE_FAULT_NAMES[faults[i]] + ")";
+		}
+	}
+	if (faulty.empty()) {
+		return true;
+	}
+	long long startNs = clockMonotonicNs();
+	bool idle = (frequency < 0);
+	errorOut("Not responding: " + faulty);
+	if (!idle) {
+		errorBeep(); // an idle daemon's checks would beep at an empty room every time; the watching clients get the error
+	}
+	if (faults[DEVICE_STATUS_INDEX_SIGNAL_GENERATOR] == DEVICE_FAULT_NONE) {
+		setSignalGenOff(); // nobody should walk in to a live chamber; the next acquisition turns it back on
+	}
+	bool recovered = true;
+	for (int i = 0; i < supervisedDeviceCount() && recovered; i++) {
+		if (faults[i] != DEVICE_FAULT_NONE) {
+			recovered = recoverDevice(i, faults[i], idle);
+		}
+	}
+	// only the ones that came back need their settings again; the turntables have none to lose
+	for (int i = DEVICE_STATUS_INDEX_SIGNAL_GENERATOR; i < supervisedDeviceCount() && recovered; i++) {
+		if (faults[i] != DEVICE_FAULT_NONE && supervisionRestore != nullptr) {
+			supervisionRestore(i, frequency, power);
+		}
+	}
+	supervisionLostMs += clockElapsedMs(startNs, clockMonotonicNs());
+	return recovered;
+}
+
+// the position had to be measured again; the time already spent on it is lost too
+void supervisionRetryPosition(long long positionStartNs) {
+	supervisionRetriedPositions++;
+	supervisionLostMs += clockElapsedMs(positionStartNs, clockMonotonicNs());
+}
+
+void printSupervisionSummary() {
+	std::string devices = "";
+	int faults = 0;
+	for (int i = 0; i < supervisedDeviceCount(); i++) {
+		int deviceFaults = 0;
+		std::string kinds = "";
+		for (int kind = DEVICE_FAULT_TIMEOUT; kind < DEVICE_FAULT_KINDS; kind++) {
+			if (supervisedDevices[i].faults[kind] > 0) {
+				kinds += (kinds.empty() ? "" : ", ") + std::to_string(supervisedDevices[i].faults[kind]) + " " + DEVICE_FAULT_NAMES[kind];
+				deviceFaults += supervisedDevices[i].faults[kind];
+			}
+		}
+		if (deviceFaults > 0) {
+			devices += "\n  " + supervisedDeviceName(i) + ": " + kinds + ", " + std::to_string(supervisedDevices[i].reconnects)
+				+ " reconnect(s), " + std::to_string(supervisedDevices[i].lostMs / 1000) + " s";
+			faults += deviceFaults;
+		}
+	}
+	if (faults == 0 && supervisionRetriedPositions == 0) {
+		return;
+	}
+	interfaceOut("Recovered from " + std::to_string(faults) + " instrument fault(s), " + std::to_string(supervisionRetriedPositions)
+		+ " position(s) measured again; " + std::to_string(supervisionLostMs / 1000 / 60) + " min " + std::to_string(supervisionLostMs / 1000 % 60)
+		+ " sec lost" + devices, false);
+}
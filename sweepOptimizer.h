@@ -0,0 +1,255 @@
+#pragma once
+// SA settings optimiser (-a minLevel,maxLevel,snr)
+// the default setup (1 GHz span, 500 kHz RBW, 5 kHz VBW, 1001 points) is far more than reading one CW tone needs.
+// a short pilot measurement on the default setup finds the tone, the noise floor (RF off), and how the
+// analyzer's sweep time compares with the span/RBW/VBW model. the strongest expected level sets the input
+// attenuation, so it can't compress the mixer, and the noise floor moves up with it. then every RBW in the
+// analyzer's 1-3 sequence is tried: the noise floor scales with RBW, so the narrowest RBW still meeting the SNR at
+// the weakest expected level bounds it, and span, points and VBW follow from the RBW. the one with the shortest
+// predicted sweep wins. results are kept per frequency and power, so the pilot runs once for each
+
+#define OPTIMIZER_RBW_MIN (10)        // Hz
+#define OPTIMIZER_RBW_MAX (3000000)   // Hz
+#define OPTIMIZER_SPAN_PER_RBW (10)   // the tone's filter shape needs a few RBWs either side
+#define OPTIMIZER_POINTS_MIN (101)
+#define OPTIMIZER_POINTS_MAX (10001)
+#define OPTIMIZER_VBW_MARGIN (6.0)    // dB over the required SNR before VBW can open up to the RBW
+#define OPTIMIZER_DETECTOR ("POS")    // peak detector; a max hold on a CW tone wants the top of every bin
+#define OPTIMIZER_MIXER_LEVEL_MAX (-10.0)  // dBm past the attenuator, comfortably under the fieldfox's compression
+#define OPTIMIZER_ATTENUATION_STEP (5)     // dB
+#define OPTIMIZER_ATTENUATION_MAX (30)     // dB
+#define OPTIMIZER_PILOT_ATTENUATION (10)   // dB, set for the pilot so its noise floor is measured at a known attenuation
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "helperFunctions.h"
+#include "signalGenerator.h"
+#include "fieldfox.h"
+#include "acquisition.h"
+#include "instrumentProfile.h"
+
+struct optimizerTarget {
+	double minLevel = 0; // dBm, weakest the tone is expected to get over the sweep
+	double maxLevel = 0; // dBm, strongest
+	double snr = 0;      // dB, needed at minLevel
+};
+optimizerTarget sweepOptimizerTarget;
+
+struct optimizerPilot {
+	double toneFrequency = 0; // Hz, where the tone actually showed up
+	double toneLevel = 0;     // dBm
+	double noisePerHz = 0;    // dBm/Hz, from the RF off sweep
+	double sweepModelScale = 1; // analyzer's sweep time over the model's, for the pilot settings
+	int attenuation = OPTIMIZER_PILOT_ATTENUATION; // dB the noise was measured at
+};
+
+// chosen settings, by what they were chosen for; a plan or job queue coming back to a frequency and power reuses them
+struct optimizerCacheEntry {
+	double frequency = 0;
+	double power = 0;
+	int analyzerDevice = 0; // DEVICE_STATUS_INDEX_* the pilot ran on
+	optimizerTarget target;
+	instrumentSetup optimized;
+	double sweepTime = 0;
+};
+std::vector<optimizerCacheEntry> optimizerCache;
+
+// -a argument: "minLevel,maxLevel,snr", levels in dBm and snr in dB
+bool parseOptimizerArgument(const std::string& argument, optimizerTarget* target) {
+	double values[3];
+	const char* c = argument.c_str();
+	for (int i = 0; i < 3; i++) {
+		char* end = nullptr;
+		values[i] = strtod(c, &end);
+		if (end == c || !std::isfinite(values[i]) || (i < 2 && *end != ',') || (i == 2 && *end != '\0')) {
+			return false;
+		}
+		c = end + 1;
+	}
+	if (values[0] > values[1] || values[2] <= 0) {
+		return false;
+	}
+	(*target).minLevel = values[0];
+	(*target).maxLevel = values[1];
+	(*target).snr = values[2];
+	return true;
+}
+
+// one counted single sweep into a fresh trace, returned as dBm per point
+bool optimizerPilotSweep(int sweepTimeMs, std::vector<float>* trace) {
+	std::string traceText = "";
+	setSpectrumAnalyzerTraceModeClearRewriteLive();
+	if (acquireSpectrumAnalyzerSweeps(1, sweepTimeMs) != 1) {
+		return false;
+	}
+	getSpectrumAnalyzerTraceData(&traceText);
+	return parseTraceData(traceText, trace);
+}
+
+// needs the default setup already applied
+bool runOptimizerPilot(const instrumentSetup& setup, optimizerPilot* pilot) {
+	spectrumAnalyzerAcquisition acquisition;
+	std::vector<float> trace;
+	if (!getSpectrumAnalyzerAcquisition(&acquisition)) {
+		return false;
+	}
+	int sweepTimeMs = (int)std::ceil(spectrumAnalyzerSweepSeconds(acquisition) * 1000);
+	if (acquisition.sweepTime > 0 && acquisition.modelSweepTime > 0) {
+		(*pilot).sweepModelScale = acquisition.sweepTime / acquisition.modelSweepTime;
+	}
+
+	setSignalGenOn();
+	chamberSleep(ACQUISITION_SETTLING_TIME_DEFAULT);
+	bool toneSwept = optimizerPilotSweep(sweepTimeMs, &trace);
+	setSignalGenOff();
+	if (!toneSwept || trace.size() < 2) {
+		errorOut("Optimiser pilot: no trace with RF on.");
+		return false;
+	}
+	size_t peak = (size_t)(std::max_element(trace.begin(), trace.end()) - trace.begin());
+	(*pilot).toneLevel = trace[peak];
+	(*pilot).toneFrequency = setup.spectrumAnalyzerStart
+		+ (setup.spectrumAnalyzerStop - setup.spectrumAnalyzerStart) * (double)peak / (double)(trace.size() - 1);
+
+	chamberSleep(ACQUISITION_SETTLING_TIME_DEFAULT);
+	if (!optimizerPilotSweep(sweepTimeMs, &trace)) {
+		errorOut("Optimiser pilot: no trace with RF off.");
+		return false;
+	}
+	std::nth_element(trace.begin(), trace.begin() + trace.size() / 2, trace.end()); // median, so spurs don't count
+	(*pilot).noisePerHz = trace[trace.size() / 2] - 10 * std::log10(acquisition.bwRes);
+	return true;
+}
+
+// least attenuation (in the analyzer's steps) that keeps maxLevel under OPTIMIZER_MIXER_LEVEL_MAX
+int optimizerAttenuation(const optimizerTarget& target) {
+	double needed = target.maxLevel - OPTIMIZER_MIXER_LEVEL_MAX;
+	int attenuation = (int)std::ceil(needed / OPTIMIZER_ATTENUATION_STEP) * OPTIMIZER_ATTENUATION_STEP;
+	return std::clamp(attenuation, 0, OPTIMIZER_ATTENUATION_MAX);
+}
+
+// fills in the SA part of setup; returns the predicted sweep time in seconds, or 0 if nothing meets the SNR
+double chooseOptimizerSettings(const optimizerTarget& target, const optimizerPilot& pilot, double targetFrequency, instrumentSetup* setup) {
+	double bestTime = 0;
+	int attenuation = optimizerAttenuation(target);
+	double noisePerHz = pilot.noisePerHz + (attenuation - pilot.attenuation); // the attenuator's loss comes straight off the noise figure
+	double toneOffset = std::fabs(pilot.toneFrequency - targetFrequency);
+	double uncertainty = targetFrequency * ACQUISITION_FREQUENCY_UNCERTAINTY_PPM * 1e-6;
+	for (double decade = OPTIMIZER_RBW_MIN; decade <= OPTIMIZER_RBW_MAX; decade *= 10) {
+		for (double step : { 1.0, 3.0 }) {
+			double rbw = decade * step;
+			if (rbw > OPTIMIZER_RBW_MAX) {
+				continue;
+			}
+			double margin = target.minLevel - (noisePerHz + 10 * std::log10(rbw));
+			if (margin < target.snr) {
+				continue; // too much noise in this bandwidth
+			}
+			double vbw = (margin >= target.snr + OPTIMIZER_VBW_MARGIN) ? rbw : rbw / 10;
+			double span = std::max(OPTIMIZER_SPAN_PER_RBW * rbw, 2 * (toneOffset + uncertainty) + 2 * rbw);
+			int points = (int)std::ceil(2 * span / rbw) + 1; // at least two points per RBW, so the peak isn't missed
+			points = std::clamp(points | 1, OPTIMIZER_POINTS_MIN, OPTIMIZER_POINTS_MAX); // odd, for a middle point
+			double time = pilot.sweepModelScale * SPECTRUM_ANALYZER_SWEEP_MODEL_K * span / (rbw * std::min(rbw, vbw));
+			if (bestTime == 0 || time < bestTime) {
+				bestTime = time;
+				(*setup).spectrumAnalyzerStart = targetFrequency - span / 2;
+				(*setup).spectrumAnalyzerStop = targetFrequency + span / 2;
+				(*setup).spectrumAnalyzerBwRes = rbw;
+				(*setup).spectrumAnalyzerBwVideo = vbw;
+				(*setup).spectrumAnalyzerPoints = points;
+			}
+		}
+	}
+	if (bestTime > 0) {
+		(*setup).spectrumAnalyzerDetector = OPTIMIZER_DETECTOR;
+		(*setup).spectrumAnalyzerAttenuation = attenuation;
+		if ((*setup).spectrumAnalyzerStart < 0) {
+			(*setup).spectrumAnalyzerStop -= (*setup).spectrumAnalyzerStart;
+			(*setup).spectrumAnalyzerStart = 0;
+		}
+	}
+	return bestTime;
+}
+
+// copies the SA settings the optimiser chooses; the rest of setup (generator, marker) stays as given
+void copyOptimizerSettings(const instrumentSetup& optimized, instrumentSetup* setup) {
+	(*setup).spectrumAnalyzerStart = optimized.spectrumAnalyzerStart;
+	(*setup).spectrumAnalyzerStop = optimized.spectrumAnalyzerStop;
+	(*setup).spectrumAnalyzerBwRes = optimized.spectrumAnalyzerBwRes;
+	(*setup).spectrumAnalyzerBwVideo = optimized.spectrumAnalyzerBwVideo;
+	(*setup).spectrumAnalyzerPoints = optimized.spectrumAnalyzerPoints;
+	(*setup).spectrumAnalyzerDetector = optimized.spectrumAnalyzerDetector;
+	(*setup).spectrumAnalyzerAttenuation = optimized.spectrumAnalyzerAttenuation;
+}
+
+optimizerCacheEntry* findOptimizerCache(const optimizerTarget& target, const instrumentSetup& setup) {
+	for (optimizerCacheEntry& entry : optimizerCache) {
+		if (entry.frequency == setup.signalGenFrequency && entry.power == setup.signalGenPower && entry.analyzerDevice == spectrumAnalyzerDevice()
+			&& entry.target.minLevel == target.minLevel && entry.target.maxLevel == target.maxLevel && entry.target.snr == target.snr) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+void printOptimizerSettings(const instrumentSetup& optimized, double sweepTime, int sweepsPerPosition) {
+	interfaceOut("Optimiser: span " + std::to_string((long long)std::llround(optimized.spectrumAnalyzerStop - optimized.spectrumAnalyzerStart))
+		+ " Hz, RBW " + std::to_string((long long)std::llround(optimized.spectrumAnalyzerBwRes))
+		+ " Hz, VBW " + std::to_string((long long)std::llround(optimized.spectrumAnalyzerBwVideo))
+		+ " Hz, " + std::to_string(optimized.spectrumAnalyzerPoints) + " points, " + optimized.spectrumAnalyzerDetector + " detector, "
+		+ std::to_string(optimized.spectrumAnalyzerAttenuation) + " dB attenuation", false);
+	interfaceOut("Optimiser: predicted " + std::to_string((long long)std::llround(sweepTime * 1000 * sweepsPerPosition + sweepAcquisition.settlingTime))
+		+ " ms per position (" + std::to_string(sweepsPerPosition) + " sweeps of " + std::to_string(sweepTime * 1000) + " ms, plus settling)", false);
+}
+
+// pilot on the setup as given, then swaps in the optimised SA settings. false leaves setup untouched.
+// a frequency and power that already had a pilot (on this analyzer, for this target) reuses its settings without one
+bool optimizeInstrumentSetup(const optimizerTarget& target, int sweepsPerPosition, instrumentSetup* setup) {
+	optimizerCacheEntry* cached = findOptimizerCache(target, *setup);
+	if (cached != nullptr) {
+		copyOptimizerSettings((*cached).optimized, setup);
+		debugOut("Optimiser: reusing the settings from the pilot at " + std::to_string((*setup).signalGenFrequency) + " Hz");
+		printOptimizerSettings((*cached).optimized, (*cached).sweepTime, sweepsPerPosition);
+		return true;
+	}
+	optimizerPilot pilot;
+	instrumentSetup pilotSetup = *setup;
+	instrumentSetup optimized = *setup;
+	pilotSetup.spectrumAnalyzerAttenuation = OPTIMIZER_PILOT_ATTENUATION;
+	interfaceOut("Optimiser: pilot measurement...", false);
+	applyInstrumentSetup(pilotSetup);
+	if (!runOptimizerPilot(pilotSetup, &pilot)) {
+		errorOut("Optimiser pilot failed; keeping the default SA settings.");
+		return false;
+	}
+	debugOut("Pilot: tone " + std::to_string(pilot.toneLevel) + " dBm at " + std::to_string(pilot.toneFrequency)
+		+ " Hz, noise " + std::to_string(pilot.noisePerHz) + " dBm/Hz, sweep time " + std::to_string(pilot.sweepModelScale) + "x model");
+	if (pilot.toneLevel < target.minLevel || target.maxLevel < pilot.toneLevel) {
+		errorOut("Pilot tone level " + std::to_string(pilot.toneLevel) + " dBm is outside the expected range.");
+	}
+	if (target.maxLevel - OPTIMIZER_ATTENUATION_MAX > OPTIMIZER_MIXER_LEVEL_MAX) {
+		errorOut("The strongest expected level (" + std::to_string(target.maxLevel) + " dBm) may compress the spectrum analyzer, even with "
+			+ std::to_string(OPTIMIZER_ATTENUATION_MAX) + " dB of attenuation.");
+	}
+	double sweepTime = chooseOptimizerSettings(target, pilot, (*setup).signalGenFrequency, &optimized);
+	if (sweepTime <= 0) {
+		errorOut("No RBW reaches " + std::to_string(target.snr) + " dB SNR at " + std::to_string(target.minLevel)
+			+ " dBm (noise is " + std::to_string(pilot.noisePerHz) + " dBm/Hz at " + std::to_string(pilot.attenuation) + " dB attenuation, and "
+			+ std::to_string(optimizerAttenuation(target)) + " dB is needed for the strongest level); keeping the default SA settings.");
+		return false;
+	}
+	copyOptimizerSettings(optimized, setup);
+	optimizerCacheEntry entry;
+	entry.frequency = (*setup).signalGenFrequency;
+	entry.power = (*setup).signalGenPower;
+	entry.analyzerDevice = spectrumAnalyzerDevice();
+	entry.target = target;
+	entry.optimized = optimized;
+	entry.sweepTime = sweepTime;
+	optimizerCache.push_back(entry);
+	printOptimizerSettings(optimized, sweepTime, sweepsPerPosition);
+	return true;
+}
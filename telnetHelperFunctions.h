@@ -3,35 +3,60 @@
 #define TELNET_SEND_BUFFER_SIZE (128)
 #define TELNET_RECEIVE_BUFFER_SIZE (2048)
 #define TELNET_SEND_DELAY (500)
-#define TELNET_RECEIVE_TIMEOUT (5000)
+#define TELNET_RECEIVE_TIMEOUT (30000) // since last received data; *OPC? after a slow sweep can take a while
 #define TELNET_EXPECTED_PROMPT ("\r\nSCPI> ")
+#define TELNET_CONNECT_TIMEOUT (5000) // an unplugged fieldfox would otherwise wait for the OS connect timeout (~20 s)
+
+#include <cstring>
+#include "chamberClock.h"
+#include "scpiCommands.h"
+#include "simulation.h"
+#include "deviceFault.h"
 
 extern WSADATA wsaDataConnection; // used for telent socket environment
-extern SOCKET telnetFieldFox;
-extern std::string telnetReceiveText;
+void errorOut(std::string mesg); // from helperFunctions.h
 
 const std::string telnetExpExtra = TELNET_EXPECTED_PROMPT;
 
 int telnetInitWSA(WSADATA* wsaDataConnection) {
+	if (simulationActive) {
+		return 0;
+	}
 	return WSAStartup(MAKEWORD(2, 2), wsaDataConnection); // return 0 if no error
 }
 
 int telnetCleanupWSA(WSADATA* wsaDataConnection) {
+	if (simulationActive) {
+		return 0;
+	}
 	return WSACleanup();
 }
 
 int telnetStopControl(SOCKET* socketObj) {
+	if (simulationActive) {
+		simulationClose((long long)(*socketObj));
+		return 0;
+	}
 	return closesocket((*socketObj));
 }
 
-int telnetSend(SOCKET* socketObj, std::string command) {
+int telnetSend(SOCKET* socketObj, const char* command, int commandLength) {
 	// end lines with \r\n
-	//char buf[TELNET_SEND_BUFFER_SIZE];
-	const char* buf = command.c_str();
-	int result = send((*socketObj), buf, command.length(), 0);
-	Sleep(TELNET_SEND_DELAY);
+	int result = SOCKET_ERROR;
+	if (simulationActive) {
+		result = (simulationSend((long long)(*socketObj), command, commandLength, TELNET_SEND_DELAY) == 0) ? commandLength : SOCKET_ERROR;
+	} else {
+		result = send((*socketObj), command, commandLength, 0);
+		Sleep(TELNET_SEND_DELAY);
+	}
+	if (result == SOCKET_ERROR) {
+		transportFault(DEVICE_FAULT_DISCONNECTED);
+	}
 	return result;
 }
+int telnetSend(SOCKET* socketObj, const std::string& command) {
+	return telnetSend(socketObj, command.c_str(), (int)command.length());
+}
 int telnetRecv(SOCKET* socketObj, std::string* receivedText) {
 	//(*receivedText) = "Hello!\r\n";
 	char buf[TELNET_RECEIVE_BUFFER_SIZE];
@@ -51,24 +76,42 @@ int telnetRecv(SOCKET* socketObj, std::string* receivedText) {
 		buf[TELNET_RECEIVE_BUFFER_SIZE - 1] = '\0';
 	}
 	(*receivedText) = buf;
-	return (int)(bytesReceived == 0); // return 0 if bytes received
+	// 0 bytes is the fieldfox closing the connection; -1 is normal for a non-blocking socket with nothing waiting, unless it's some other error
+	if (bytesReceived == 0 || (bytesReceived < 0 && WSAGetLastError() != WSAEWOULDBLOCK)) {
+		transportFault(DEVICE_FAULT_DISCONNECTED);
+		return 2;
+	}
+	return (int)(bytesReceived < 0); // return 0 if bytes received, 1 if nothing yet, 2 if the connection is gone
 }
 
-int telnetCommand(SOCKET* socketObj, std::string command, std::string* receivedText) {
+// returns 0 with the response, 2 on a timeout, 3 if the connection is gone
+int telnetCommand(SOCKET* socketObj, const char* command, int commandLength, std::string* receivedText, int timeoutMs) {
 	int status;
 	size_t nextPromptSubStringLocation = std::string::npos;
 	std::string tempString = "";
 	std::string workspace = ""; // the total response, until end of response is reached
 	bool endOfTransmission = false;
 	bool timeoutExceeded = false;
-	SYSTEMTIME currentTime, startTime;
-	telnetSend(socketObj, command);
-	GetSystemTime(&startTime);
+	long long lastReceiveNs = 0;
+	if (telnetSend(socketObj, command, commandLength) == SOCKET_ERROR) {
+		return 3;
+	}
+	if (simulationActive) {
+		if (!simulationReceive((long long)(*socketObj), timeoutMs, receivedText)) {
+			transportFault(DEVICE_FAULT_TIMEOUT);
+			return 2;
+		}
+		return 0;
+	}
+	lastReceiveNs = clockMonotonicNs();
 	do
 	{
 		status = telnetRecv(socketObj, &tempString);
+		if (status == 2) {
+			return 3; // no point waiting out the timeout
+		}
 		if (status == 0) { // did receive
-			GetSystemTime(&startTime);
+			lastReceiveNs = clockMonotonicNs();
 			workspace.append(tempString);
 			//std::cout << "Current workspace is: " << workspace << std::endl; // has two sets of newlines - from command, and by fieldfox for result
 			nextPromptSubStringLocation = workspace.find(TELNET_EXPECTED_PROMPT);
@@ -77,20 +120,40 @@ int telnetCommand(SOCKET* socketObj, std::string command, std::string* receivedT
 				endOfTransmission = true;
 			}
 		}
-		GetSystemTime(&currentTime);
 		tempString = "";
-		timeoutExceeded = (currentTime.wMilliseconds - startTime.wMilliseconds > TELNET_RECEIVE_TIMEOUT);
+		timeoutExceeded = (clockElapsedMs(lastReceiveNs, clockMonotonicNs()) > timeoutMs);
 	} while (!(endOfTransmission || timeoutExceeded));
 
 	if (endOfTransmission) {
-		(*receivedText) = workspace.substr(command.length(), workspace.length() - command.length() - telnetExpExtra.length());
+		(*receivedText) = workspace.substr(commandLength, workspace.length() - commandLength - telnetExpExtra.length());
 	}
 	else {
+		transportFault(DEVICE_FAULT_TIMEOUT);
 		return 2; // we did receive something, just timed out
 	}
 	return status;
 }
 
+int telnetCommand(SOCKET* socketObj, const char* command, int commandLength, std::string* receivedText) {
+	return telnetCommand(socketObj, command, commandLength, receivedText, TELNET_RECEIVE_TIMEOUT);
+}
+int telnetCommand(SOCKET* socketObj, const char* command, std::string* receivedText) {
+	return telnetCommand(socketObj, command, (int)strlen(command), receivedText);
+}
+int telnetCommand(SOCKET* socketObj, const std::string& command, std::string* receivedText) {
+	return telnetCommand(socketObj, command.c_str(), (int)command.length(), receivedText);
+}
+int telnetCommand(SOCKET* socketObj, const scpiCommand& command, std::string* receivedText, int timeoutMs) {
+	if (command.overflow) { // never send a truncated command
+		errorOut("Instrument command too long to send: \"" + std::string(command.text, command.length) + "\"");
+		return 1;
+	}
+	return telnetCommand(socketObj, command.text, command.length, receivedText, timeoutMs);
+}
+int telnetCommand(SOCKET* socketObj, const scpiCommand& command, std::string* receivedText) {
+	return telnetCommand(socketObj, command, receivedText, TELNET_RECEIVE_TIMEOUT);
+}
+
 // used in telnetStartControl()
 int telnetClearReceiveBuffer(SOCKET* socketObj) {
 	std::string tempString;
@@ -98,8 +161,29 @@ int telnetClearReceiveBuffer(SOCKET* socketObj) {
 	return 0;
 }
 
-int telnetStartControl(SOCKET* socketObj, const char* targetIP, int targetPort, const char* bindIP) {
+// waits until the socket can be read (or written, ie a connect finished); false on timeout
+bool telnetWaitSocket(SOCKET* socketObj, bool forReading, int timeoutMs) {
+	fd_set socketSet;
+	fd_set errorSet;
+	timeval timeout;
+	FD_ZERO(&socketSet);
+	FD_ZERO(&errorSet);
+	FD_SET((*socketObj), &socketSet);
+	FD_SET((*socketObj), &errorSet); // windows reports a refused connect here, not as writable
+	timeout.tv_sec = timeoutMs / 1000;
+	timeout.tv_usec = (timeoutMs % 1000) * 1000;
+	if (forReading) {
+		return select((int)(*socketObj) + 1, &socketSet, nullptr, &errorSet, &timeout) > 0;
+	}
+	return select((int)(*socketObj) + 1, nullptr, &socketSet, &errorSet, &timeout) > 0;
+}
+
+// returns 0 on success; 1 no socket, 2 bind failed, 3 connection refused, 4 no answer within timeoutMs
+int telnetStartControl(SOCKET* socketObj, const char* targetIP, int targetPort, const char* bindIP, int timeoutMs) {
 	sockaddr_in bindAddr, targetAddr;
+	unsigned long nonBlocking = 1;
+	int socketError = 0;
+	int socketErrorLength = sizeof(socketError);
 	(*socketObj) = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 	if ((*socketObj) == INVALID_SOCKET) {
 		return 1; // couldn't make the socket... should end program
@@ -109,19 +193,39 @@ int telnetStartControl(SOCKET* socketObj, const char* targetIP, int targetPort,
 	bindAddr.sin_port = 0; // winsock will assign between 1024 and 5000
 	bindAddr.sin_addr.S_un.S_addr = inet_addr(bindIP);
 	if (bind((*socketObj), (sockaddr*)(&bindAddr), sizeof(bindAddr)) != 0) {
+		closesocket((*socketObj));
 		return 2; // couldn't bind the address... should end program
 	}
-	// now, connect to target ip address
+	// now, connect to target ip address - without blocking, so the wait is ours to limit
 	targetAddr.sin_family = AF_INET;
 	targetAddr.sin_port = htons(targetPort);
 	targetAddr.sin_addr.S_un.S_addr = inet_addr(targetIP);
-	if (connect((*socketObj), (sockaddr*)(&targetAddr), sizeof(targetAddr)) != 0) {
+	ioctlsocket((*socketObj), FIONBIO, &nonBlocking);
+	if (connect((*socketObj), (sockaddr*)(&targetAddr), sizeof(targetAddr)) != 0 && WSAGetLastError() != WSAEWOULDBLOCK) {
+		closesocket((*socketObj));
 		return 3; // could't connect to target ip... should end program
 	}
-	// all steps successful
-	Sleep(TELNET_SEND_DELAY); // to allow response time if immediate read is needed
-	telnetClearReceiveBuffer(socketObj); // clear the welcome message at the top of the session, so that command responses are processed properly
-	telnetCommand(socketObj, "\r\n",&telnetReceiveText); // to reset the line prompt on received text
-	Sleep(TELNET_SEND_DELAY);
+	if (!telnetWaitSocket(socketObj, false, timeoutMs)) {
+		closesocket((*socketObj));
+		return 4;
+	}
+	getsockopt((*socketObj), SOL_SOCKET, SO_ERROR, (char*)(&socketError), &socketErrorLength);
+	if (socketError != 0) {
+		closesocket((*socketObj));
+		return 3;
+	}
+	// all steps successful; the socket stays non-blocking from here on
+	if (telnetWaitSocket(socketObj, true, TELNET_SEND_DELAY)) { // welcome message; no need to sleep the full delay if it's already here
+		telnetClearReceiveBuffer(socketObj); // clear the welcome message at the top of the session, so that command responses are processed properly
+	}
+	std::string promptText;
+	if (telnetCommand(socketObj, "\r\n", 2, &promptText, timeoutMs) != 0) { // to reset the line prompt on received text - returns once the prompt is back
+		closesocket((*socketObj));
+		return 4;
+	}
 	return 0;
 }
+
+int telnetStartControl(SOCKET* socketObj, const char* targetIP, int targetPort, const char* bindIP) {
+	return telnetStartControl(socketObj, targetIP, targetPort, bindIP, TELNET_CONNECT_TIMEOUT);
+}
@@ -17,15 +17,18 @@
 //#define VISA_RECEIVE_TIMEOUT (1000)
 
 #include "helperFunctions.h"
+#include "scpiCommands.h"
+#include "scpiResponse.h"
 #include <visa.h> //https://edadocs.software.keysight.com/connect/setting-up-a-visual-studio-c++-visa-project-482552069.html
 #include "chamber.h"
 
 extern ViSession globalVisaResourceManager;
 extern ViStatus  globalVisaStatus;
-extern std::string visaReceiveText;
 
 extern ViSession visaTurntableAzimuthSession;
 extern ViSession visaTurntableElevationSession;
+extern visaReceiveBuffer visaTurntableAzimuthReceive;
+extern visaReceiveBuffer visaTurntableElevationReceive;
 
 extern ViRsrc turntableAzimuthRsrc;
 extern ViRsrc turntableElevationRsrc;
@@ -55,26 +58,26 @@ bool isTurntableConnected() { //checks both axis
 	return isTurntableAziConnected() && isTurntableEleConnected();
 }
 bool isTurntableAziReady() {
-	visaCommand(&visaTurntableAzimuthSession, VISA_COMMAND_CHECK_OPERATION_COMPLETE, &visaReceiveText);
-	if (visaReceiveText == VISA_RESPONSE_TRUE || visaReceiveText == VISA_RESPONSE_TRUE_2) {
-		return true;
-	} else if (visaReceiveText == VISA_RESPONSE_FALSE || visaReceiveText == VISA_RESPONSE_FALSE_2) {
-		return false;
+	std::string_view response;
+	visaCommand(&visaTurntableAzimuthSession, VISA_COMMAND_CHECK_OPERATION_COMPLETE, &visaTurntableAzimuthReceive, &response);
+	bool ready = false;
+	if (parseResponseBool(response, &ready) == RESPONSE_OK) {
+		return ready;
 	} else {
 		errorOut("Unreconized response from VISA Device (Turntable-Azimuth).");
-		errorOut(visaReceiveText);
+		errorOut(std::string(response));
 		return false;
 	}
 }
 bool isTurntableEleReady() {
-	visaCommand(&visaTurntableElevationSession, VISA_COMMAND_CHECK_OPERATION_COMPLETE, &visaReceiveText);
-	if (visaReceiveText == VISA_RESPONSE_TRUE || visaReceiveText == VISA_RESPONSE_TRUE_2) {
-		return true;
-	} else if (visaReceiveText == VISA_RESPONSE_FALSE || visaReceiveText == VISA_RESPONSE_FALSE_2) {
-		return false;
+	std::string_view response;
+	visaCommand(&visaTurntableElevationSession, VISA_COMMAND_CHECK_OPERATION_COMPLETE, &visaTurntableElevationReceive, &response);
+	bool ready = false;
+	if (parseResponseBool(response, &ready) == RESPONSE_OK) {
+		return ready;
 	} else {
 		errorOut("Unreconized response from VISA Device (Turntable-Elevation).");
-		errorOut(visaReceiveText);
+		errorOut(std::string(response));
 		return false;
 	}
 }
@@ -87,37 +90,77 @@ bool isTurntableReady() { // only works well after another command - will always
 }
 
 double getTurntableAziPosition(std::string* textValue) {
-	visaCommand(&visaTurntableAzimuthSession, "CP\r\n", &visaReceiveText);
-	*(textValue) = visaReceiveText;
-	return strtod((*(textValue)).c_str(), nullptr);
+	std::string_view response;
+	double position = 0;
+	visaCommand(&visaTurntableAzimuthSession, scpiFormat(SCPI_TURNTABLE_CURRENT_POSITION), &visaTurntableAzimuthReceive, &response);
+	*(textValue) = response;
+	responseStatus_t status = parseResponseNumber(response, &position, RESPONSE_UNIT_DEGREES);
+	if (status != RESPONSE_OK) {
+		errorOut("Turntable azimuth position could not be read (" + responseStatusText(status) + "): \"" + *(textValue) + "\"");
+		return NAN;
+	}
+	return position;
 }
 
 double getTurntableElePosition(std::string* textValue) {
-	visaCommand(&visaTurntableElevationSession, "CP\r\n", &visaReceiveText);
-	*(textValue) = visaReceiveText;
-	return strtod((*(textValue)).c_str(), nullptr);
+	std::string_view response;
+	double position = 0;
+	visaCommand(&visaTurntableElevationSession, scpiFormat(SCPI_TURNTABLE_CURRENT_POSITION), &visaTurntableElevationReceive, &response);
+	*(textValue) = response;
+	responseStatus_t status = parseResponseNumber(response, &position, RESPONSE_UNIT_DEGREES);
+	if (status != RESPONSE_OK) {
+		errorOut("Turntable elevation position could not be read (" + responseStatusText(status) + "): \"" + *(textValue) + "\"");
+		return NAN;
+	}
+	return position;
 }
 
 bool getTurntableSoftLimitsAzi() {
-	visaCommand(&visaTurntableAzimuthSession, "UL\r\n", &visaReceiveText); // Upper limit
-	turntableAziLimitMax = strtod(visaReceiveText.c_str(), nullptr);
-	visaCommand(&visaTurntableAzimuthSession, "LL\r\n", &visaReceiveText); // Lower limit
-	turntableAziLimitMin = strtod(visaReceiveText.c_str(), nullptr);
+	std::string_view response;
+	double upper = 0;
+	double lower = 0;
+	visaCommand(&visaTurntableAzimuthSession, scpiFormat(SCPI_TURNTABLE_UPPER_LIMIT), &visaTurntableAzimuthReceive, &response); // Upper limit
+	responseStatus_t status = parseResponseNumber(response, &upper, RESPONSE_UNIT_DEGREES);
+	if (status != RESPONSE_OK) {
+		errorOut("Turntable azimuth upper limit could not be read (" + responseStatusText(status) + "): \"" + std::string(response) + "\"");
+		return false; // limits stay at the nonsense defaults, so moves are refused
+	}
+	visaCommand(&visaTurntableAzimuthSession, scpiFormat(SCPI_TURNTABLE_LOWER_LIMIT), &visaTurntableAzimuthReceive, &response); // Lower limit
+	status = parseResponseNumber(response, &lower, RESPONSE_UNIT_DEGREES);
+	if (status != RESPONSE_OK) {
+		errorOut("Turntable azimuth lower limit could not be read (" + responseStatusText(status) + "): \"" + std::string(response) + "\"");
+		return false;
+	}
+	turntableAziLimitMax = (float)upper;
+	turntableAziLimitMin = (float)lower;
 	return true;
 }
 
 bool getTurntableSoftLimitsEle() {
-	visaCommand(&visaTurntableElevationSession, "UL\r\n", &visaReceiveText); // Upper limit
-	turntableEleLimitMax = strtod(visaReceiveText.c_str(), nullptr);
-	visaCommand(&visaTurntableElevationSession, "LL\r\n", &visaReceiveText); // Lower limit
-	turntableEleLimitMin = strtod(visaReceiveText.c_str(), nullptr);
+	std::string_view response;
+	double upper = 0;
+	double lower = 0;
+	visaCommand(&visaTurntableElevationSession, scpiFormat(SCPI_TURNTABLE_UPPER_LIMIT), &visaTurntableElevationReceive, &response); // Upper limit
+	responseStatus_t status = parseResponseNumber(response, &upper, RESPONSE_UNIT_DEGREES);
+	if (status != RESPONSE_OK) {
+		errorOut("Turntable elevation upper limit could not be read (" + responseStatusText(status) + "): \"" + std::string(response) + "\"");
+		return false; // limits stay at the nonsense defaults, so moves are refused
+	}
+	visaCommand(&visaTurntableElevationSession, scpiFormat(SCPI_TURNTABLE_LOWER_LIMIT), &visaTurntableElevationReceive, &response); // Lower limit
+	status = parseResponseNumber(response, &lower, RESPONSE_UNIT_DEGREES);
+	if (status != RESPONSE_OK) {
+		errorOut("Turntable elevation lower limit could not be read (" + responseStatusText(status) + "): \"" + std::string(response) + "\"");
+		return false;
+	}
+	turntableEleLimitMax = (float)upper;
+	turntableEleLimitMin = (float)lower;
 	return true;
 }
 
 bool getTurntableSoftLimits() {
-	getTurntableSoftLimitsAzi();
-	getTurntableSoftLimitsEle();
-	return true;
+	bool limitsAzi = getTurntableSoftLimitsAzi();
+	bool limitsEle = getTurntableSoftLimitsEle();
+	return limitsAzi && limitsEle;
 }
 
 bool setTurntableAziPosition(float pos) { // use with isTurntableReady()
@@ -128,7 +171,7 @@ bool setTurntableAziPosition(float pos) { // use with isTurntableReady()
 		errorOut("azimuth limits exceeded by value " + std::to_string(pos));
 		return false;
 	}
-	visaSend(&visaTurntableAzimuthSession, "GOTO " + std::to_string((int)pos) + "." + std::to_string((pos-(int)pos)*100) + "\r\n");
+	visaSend(&visaTurntableAzimuthSession, scpiFormat(SCPI_TURNTABLE_GOTO, pos));
 	return true;
 }
 
@@ -140,14 +183,19 @@ bool setTurntableElePosition(float pos) { // use with isTurntableReady()
 		errorOut("elevation limits exceeded by value " + std::to_string(pos));
 		return false;
 	}
-	visaSend(&visaTurntableElevationSession, "GOTO " + std::to_string((int)pos) + "." + std::to_string((pos - (int)pos) * 100) + "\r\n");
+	visaSend(&visaTurntableElevationSession, scpiFormat(SCPI_TURNTABLE_GOTO, pos));
 	return true;
 }
 
-bool moveTurntable(float aziPos, float elePos) { // blocks until turntable is finished moving
+bool moveTurntable(float aziPos, float elePos) { // blocks until turntable is finished moving; false if it stops answering on the way
+	long long faultsBefore = transportFaultCount;
 	setTurntableAziPosition(aziPos);
 	setTurntableElePosition(elePos);
-	while (!(isTurntableReady()));
+	while (!(isTurntableReady())) {
+		if (transportFaultCount != faultsBefore) {
+			return false; // would poll forever otherwise; the supervisor reconnects it (see supervision.h)
+		}
+	}
 	return true;
 }
 
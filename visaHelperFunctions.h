@@ -2,111 +2,191 @@
 // visa helper functions
 
 #include <visa.h> //https://edadocs.software.keysight.com/connect/setting-up-a-visual-studio-c++-visa-project-482552069.html
+#include <cstring>
+#include <string_view>
+#include "scpiCommands.h"
+#include "simulation.h"
+#include "deviceFault.h"
 
 #define VISA_MAX_RESPONSE_SIZE (8192)
+#define VISA_TERMINATION_CHARACTER ('\n')
 #define VISA_SEND_DELAY (100)
 #define VISA_RECEIVE_TIMEOUT (1000)
 
-#define VISA_RESPONSE_TRUE  ("1")
-#define VISA_RESPONSE_FALSE ("0")
-#define VISA_RESPONSE_TRUE_2  (" 1")
-#define VISA_RESPONSE_FALSE_2 (" 0")
-
 extern ViSession globalVisaResourceManager = 0;
 extern ViStatus  globalVisaStatus = 0;
-extern std::string visaReceiveText = "";
+
+// one per session, so a response stays valid until the next read on the same instrument
+struct visaReceiveBuffer {
+	char data[VISA_MAX_RESPONSE_SIZE];
+	int length = 0;
+	bool truncated = false; // the response didn't fit, and the rest was discarded
+};
+
+void errorOut(std::string mesg); // from helperFunctions.h
+
+// a VISA error, for the supervisor; anything but a timeout means the session can't be trusted any more
+deviceFault_t visaFaultKind(ViStatus status) {
+	return (status == VI_ERROR_TMO) ? DEVICE_FAULT_TIMEOUT : DEVICE_FAULT_DISCONNECTED;
+}
 
 int visaInitResourceManager(ViSession* resourceManager) {
 	ViStatus status = 0;
+	if (simulationActive) {
+		*resourceManager = SIMULATION_SESSION_BASE;
+		return VI_SUCCESS;
+	}
 	status = viOpenDefaultRM(resourceManager);
 	if (status < VI_SUCCESS) {
-		std::cerr << "There was a problem with the visa default resource manager. ";
-		std::cerr << "Error Code: " << status << std::endl;
+		errorOut("There was a problem with the visa default resource manager. Error Code: " + std::to_string(status));
 	}
 	return status;
 }
 int visaCloseResourceManager(ViSession* resourceManager) {
 	ViStatus status = 0;
+	if (simulationActive) {
+		return VI_SUCCESS;
+	}
 	status = viClose((*resourceManager));
 	if (status < VI_SUCCESS) {
-		std::cerr << "There was a problem closing the visa default resource manager. ";
-		std::cerr << "Error Code: " << status << std::endl;
+		errorOut("There was a problem closing the visa default resource manager. Error Code: " + std::to_string(status));
 	}
 	return status;
 }
-int visaOpenInstrument(ViSession* resourceManager, ViRsrc visaAddress, ViSession* instSession) {
+// timeoutMs bounds every read and write on the session, so a missing instrument fails fast instead of hanging
+int visaOpenInstrument(ViSession* resourceManager, ViRsrc visaAddress, ViSession* instSession, int timeoutMs) {
 	ViStatus status = 0;
 	ViChar fullAddress[100];
-	status = viOpen((*resourceManager), visaAddress, VI_NO_LOCK, VISA_RECEIVE_TIMEOUT, instSession);
+	status = viOpen((*resourceManager), visaAddress, VI_NO_LOCK, timeoutMs, instSession);
 	if (status < VI_SUCCESS) {
-		std::cerr << "There was a problem opening instrument " << visaAddress << " ";
-		std::cerr << "Error Code: " << status << std::endl;
+		errorOut("There was a problem opening instrument " + std::string(visaAddress) + " Error Code: " + std::to_string(status));
 		return 1;
 	}
-	// For Serial and TCP/IP connections, enable read Termination Char or it read will timeout
+	viSetAttribute((*instSession), VI_ATTR_TMO_VALUE, (ViAttrState)timeoutMs);
+	// reads end at the termination character on every bus (GPIB also ends on EOI); serial and TCP/IP would time out without it
 	viGetAttribute((*instSession), VI_ATTR_RSRC_NAME, fullAddress);
-	if ((strstr(fullAddress, "ASRL")) || (strstr(fullAddress, "SOCKET"))) {
-		viSetAttribute((*instSession), VI_ATTR_TERMCHAR_EN, VI_TRUE);
-	}
+	viSetAttribute((*instSession), VI_ATTR_TERMCHAR, VISA_TERMINATION_CHARACTER);
+	viSetAttribute((*instSession), VI_ATTR_TERMCHAR_EN, VI_TRUE);
 	Sleep(VISA_SEND_DELAY);
 	return 0;
 }
+int visaOpenInstrument(ViSession* resourceManager, ViRsrc visaAddress, ViSession* instSession) {
+	return visaOpenInstrument(resourceManager, visaAddress, instSession, VISA_RECEIVE_TIMEOUT);
+}
 int visaCloseInstrument(ViSession* instSession) {
 	ViStatus status = 0;
+	if (simulationActive) {
+		simulationClose(*instSession);
+		return 0;
+	}
 	viClose((*instSession));
 	if (status < VI_SUCCESS) {
-		std::cerr << "There was a problem closing instrument." << " ";
-		std::cerr << "Error Code: " << status << std::endl;
+		errorOut("There was a problem closing instrument. Error Code: " + std::to_string(status));
 		return 1;
 	}
 	return 0;
 }
-int visaSend(ViSession* instSession, std::string command) {
+int visaSend(ViSession* instSession, const char* command, int commandLength) {
 	ViStatus status = 0;
-	ViConstString tempCommand = command.c_str();
-	status = viPrintf((*instSession), tempCommand);
-	if (status < VI_SUCCESS) {
-		std::cerr << "There was a problem writing instrument command \""
-			<< command << "\" " << "Error Code: " << status << std::endl;
+	ViUInt32 bytesWritten = 0;
+	if (simulationActive) {
+		if (simulationSend(*instSession, command, commandLength, VISA_SEND_DELAY) != 0) {
+			transportFault(DEVICE_FAULT_DISCONNECTED);
+			return 1;
+		}
+		return 0;
+	}
+	// viWrite sends the bytes as they are; viPrintf would have treated any '%' in the command as a format
+	status = viWrite((*instSession), (ViConstBuf)command, (ViUInt32)commandLength, &bytesWritten);
+	if (status < VI_SUCCESS || bytesWritten != (ViUInt32)commandLength) {
+		transportFault(visaFaultKind(status));
+		errorOut("There was a problem writing instrument command \"" + std::string(command, commandLength) + "\" Error Code: " + std::to_string(status));
 		return 1;
 	}
 	Sleep(VISA_SEND_DELAY);
 	return 0;
 }
-int visaRecv(ViSession* instSession, std::string* receivedText) {
-	ViStatus status = 0;
-	ViChar idnResponse[VISA_MAX_RESPONSE_SIZE];
-	int responseLength = 0;
-	//idnResponse[VISA_MAX_RESPONSE_SIZE - 1] = "\0"; // null terminate, just in case
-	// replace with a safer scan function?
-	status = viScanf((*instSession), "%t", idnResponse);
-	if (status < VI_SUCCESS) {
-		std::cerr << "There was a problem reading instrument" << " "
-			<< "Error Code: " << status << std::endl;
+int visaSend(ViSession* instSession, const char* command) {
+	return visaSend(instSession, command, (int)strlen(command));
+}
+int visaSend(ViSession* instSession, const std::string& command) {
+	return visaSend(instSession, command.c_str(), (int)command.length());
+}
+int visaSend(ViSession* instSession, const scpiCommand& command) {
+	if (command.overflow) {
+		errorOut("Instrument command too long to send: \"" + std::string(command.text, command.length) + "\"");
 		return 1;
 	}
-	(*receivedText) = idnResponse;
-	responseLength = (int)(*receivedText).length();
-	//here, I remove trailing enter... probobly should be handled by a modifier to results in main?
-	if (responseLength > 1) {
-		(*receivedText) = (*receivedText).substr(0, responseLength - 1);
+	return visaSend(instSession, command.text, command.length);
+}
+// reads one response into the session's buffer. *response points into that buffer (trailing newline removed),
+// and is only valid until the next visaRecv()/visaCommand() with the same buffer
+int visaRecv(ViSession* instSession, visaReceiveBuffer* buffer, std::string_view* response) {
+	ViStatus status = VI_SUCCESS;
+	ViUInt32 bytesRead = 0;
+	(*buffer).length = 0;
+	(*buffer).truncated = false;
+	(*response) = std::string_view();
+	if (simulationActive) {
+		std::string reply = "";
+		if (!simulationReceive(*instSession, VISA_RECEIVE_TIMEOUT, &reply)) {
+			transportFault(simulationDeviceFor(*instSession) == nullptr ? DEVICE_FAULT_DISCONNECTED : DEVICE_FAULT_TIMEOUT);
+			errorOut("There was a problem reading instrument Error Code: " + std::to_string(VI_ERROR_TMO));
+			return 1;
+		}
+		(*buffer).length = (int)std::min(reply.length(), (size_t)VISA_MAX_RESPONSE_SIZE);
+		memcpy((*buffer).data, reply.data(), (*buffer).length);
+		(*response) = std::string_view((*buffer).data, (*buffer).length);
+		return 0;
+	}
+	do {
+		status = viRead((*instSession), (ViBuf)((*buffer).data + (*buffer).length), (ViUInt32)(VISA_MAX_RESPONSE_SIZE - (*buffer).length), &bytesRead);
+		if (status < VI_SUCCESS) {
+			transportFault(visaFaultKind(status));
+			errorOut("There was a problem reading instrument Error Code: " + std::to_string(status));
+			return 1;
+		}
+		(*buffer).length += (int)bytesRead;
+	} while (status == VI_SUCCESS_MAX_CNT && (*buffer).length < VISA_MAX_RESPONSE_SIZE);
+	if (status == VI_SUCCESS_MAX_CNT) { // full, and the instrument still has more - throw the rest away so the next read starts clean
+		char discard[256];
+		(*buffer).truncated = true;
+		while (status == VI_SUCCESS_MAX_CNT) {
+			status = viRead((*instSession), (ViBuf)discard, (ViUInt32)sizeof(discard), &bytesRead);
+		}
+		errorOut("Instrument response longer than " + std::to_string(VISA_MAX_RESPONSE_SIZE) + " bytes was cut off.");
+	}
+	int length = (*buffer).length;
+	while (length > 0 && ((*buffer).data[length - 1] == '\n' || (*buffer).data[length - 1] == '\r')) {
+		length--;
 	}
-	//std::cout << "visaRecv got length " << (*receivedText).length() << " string: " << (*receivedText) << std::endl;
+	(*response) = std::string_view((*buffer).data, length);
 	return 0;
 }
-int visaCommand(ViSession* instSession, std::string command, std::string* receivedText) {
+int visaCommand(ViSession* instSession, const char* command, int commandLength, visaReceiveBuffer* buffer, std::string_view* response) {
 	ViStatus status = 0;
-	status = visaSend(instSession, command);
+	status = visaSend(instSession, command, commandLength);
 	if (status != 0) {
-		std::cerr << "visaCommand::Error in send..." << std::endl;
+		errorOut("visaCommand::Error in send...");
 	}
-	status = visaRecv(instSession, receivedText);
+	status = visaRecv(instSession, buffer, response);
 	if (status != 0) {
-		std::cerr << "###### visaCommand::Error in receive...\n### Command was " << command << std::endl;
+		errorOut("###### visaCommand::Error in receive...\n### Command was " + std::string(command, commandLength));
 	}
 	return status;
 }
-int visaClearReceiveBuffer(ViSession* instSession) {
-	std::string tempString;
-	return visaRecv(instSession, &tempString);
-}
\ No newline at end of file
+int visaCommand(ViSession* instSession, const char* command, visaReceiveBuffer* buffer, std::string_view* response) {
+	return visaCommand(instSession, command, (int)strlen(command), buffer, response);
+}
+int visaCommand(ViSession* instSession, const scpiCommand& command, visaReceiveBuffer* buffer, std::string_view* response) {
+	if (command.overflow) {
+		errorOut("Instrument command too long to send: \"" + std::string(command.text, command.length) + "\"");
+		return 1;
+	}
+	return visaCommand(instSession, command.text, command.length, buffer, response);
+}
+int visaClearReceiveBuffer(ViSession* instSession, visaReceiveBuffer* buffer) {
+	std::string_view discarded;
+	return visaRecv(instSession, buffer, &discarded);
+}
+